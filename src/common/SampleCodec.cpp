@@ -0,0 +1,194 @@
+#include <string.h>
+#include <math.h>
+#include <values.h>
+
+#include "SampleCodec.h"
+
+// the smallest subnormal half stands in for MINFLOAT
+#define HALF_SOLID	0x0001
+
+static unsigned short toHalf(double value)
+{
+    float f = (float) value;
+    unsigned int bits;
+
+    memcpy(&bits, &f, sizeof(bits));
+
+    unsigned short sign = (bits >> 16) & 0x8000;
+    int exponent = ((bits >> 23) & 0xff) - 127 + 15;
+    unsigned int mantissa = bits & 0x7fffff;
+
+    // NaN stays NaN, everything too large becomes infinity
+    if (((bits >> 23) & 0xff) == 0xff)
+        return sign | 0x7c00 | (mantissa ? 0x200 : 0);
+    if (exponent >= 31)
+        return sign | 0x7c00;
+
+    if (exponent <= 0) {
+        if (exponent < -10)
+            return sign;
+
+        // subnormal, the implicit bit becomes explicit
+        mantissa |= 0x800000;
+        unsigned int shift = 14 - exponent;
+        unsigned int half = mantissa >> shift;
+
+        if ((mantissa >> (shift - 1)) & 1)
+            half++;
+        return sign | half;
+    }
+
+    unsigned int half = (exponent << 10) | (mantissa >> 13);
+
+    // round to nearest, a carry into the exponent is fine
+    if (mantissa & 0x1000)
+        half++;
+    return sign | half;
+}
+
+static double fromHalf(unsigned short half)
+{
+    int exponent = (half >> 10) & 0x1f;
+    int mantissa = half & 0x3ff;
+    double value;
+
+    if (exponent == 0)
+        value = ldexp((double) mantissa, -24);
+    else if (exponent == 31)
+        value = mantissa ? NAN : INFINITY;
+    else
+        value = ldexp((double) (mantissa | 0x400), exponent - 25);
+
+    return (half & 0x8000) ? -value : value;
+}
+
+unsigned int sampleSize(int format)
+{
+    switch (format) {
+    case SAMPLEFORMAT_DOUBLE:
+        return sizeof(double);
+    case SAMPLEFORMAT_FLOAT:
+        return sizeof(float);
+    case SAMPLEFORMAT_HALF:
+    case SAMPLEFORMAT_FIXED:
+        return sizeof(unsigned short);
+    case SAMPLEFORMAT_BYTE:
+        return 1;
+    }
+    return 0;
+}
+
+int sampleFormat(const char *name)
+{
+    if (name && !strcmp(name, "float"))
+        return SAMPLEFORMAT_FLOAT;
+    if (name && !strcmp(name, "half"))
+        return SAMPLEFORMAT_HALF;
+    if (name && !strcmp(name, "fixed"))
+        return SAMPLEFORMAT_FIXED;
+    if (name && !strcmp(name, "byte"))
+        return SAMPLEFORMAT_BYTE;
+    return SAMPLEFORMAT_DOUBLE;
+}
+
+void encodeSamples(const double *values, unsigned long count, int format,
+                   double min, double max, unsigned char *out)
+{
+    switch (format) {
+    case SAMPLEFORMAT_DOUBLE:
+        memcpy(out, values, count * sizeof(double));
+        break;
+
+    case SAMPLEFORMAT_HALF:
+        for (unsigned long n = 0; n < count; n++) {
+            unsigned short half = values[n] == MINFLOAT ? HALF_SOLID : toHalf(values[n]);
+
+            if (half == HALF_SOLID && values[n] != MINFLOAT)
+                half = 0;
+            memcpy(out + 2 * n, &half, sizeof(half));
+        }
+        break;
+
+    case SAMPLEFORMAT_FLOAT:
+        for (unsigned long n = 0; n < count; n++) {
+            float f = (float) values[n];
+
+            memcpy(out + 4 * n, &f, sizeof(f));
+        }
+        break;
+
+    case SAMPLEFORMAT_FIXED:
+        {
+            double scale = max > min ? 65534.0 / (max - min) : 0.0;
+
+            for (unsigned long n = 0; n < count; n++) {
+                unsigned short fixed = 0;
+
+                if (values[n] != MINFLOAT) {
+                    double q = floor((values[n] - min) * scale + 0.5);
+                    fixed = 1 + (unsigned short) (q < 0.0 ? 0.0 : q > 65534.0 ? 65534.0 : q);
+                }
+                memcpy(out + 2 * n, &fixed, sizeof(fixed));
+            }
+            break;
+        }
+
+    case SAMPLEFORMAT_BYTE:
+        {
+            double scale = max > min ? 254.0 / (max - min) : 0.0;
+
+            for (unsigned long n = 0; n < count; n++) {
+                if (values[n] == MINFLOAT) {
+                    out[n] = 0;
+                    continue;
+                }
+
+                double q = floor((values[n] - min) * scale + 0.5);
+                out[n] = 1 + (unsigned char) (q < 0.0 ? 0.0 : q > 254.0 ? 254.0 : q);
+            }
+            break;
+        }
+    }
+}
+
+void decodeSamples(const unsigned char *in, unsigned long count, int format,
+                   double min, double max, double *values)
+{
+    switch (format) {
+    case SAMPLEFORMAT_DOUBLE:
+        memcpy(values, in, count * sizeof(double));
+        break;
+
+    case SAMPLEFORMAT_HALF:
+        for (unsigned long n = 0; n < count; n++) {
+            unsigned short half;
+
+            memcpy(&half, in + 2 * n, sizeof(half));
+            values[n] = half == HALF_SOLID ? MINFLOAT : fromHalf(half);
+        }
+        break;
+
+    case SAMPLEFORMAT_FLOAT:
+        for (unsigned long n = 0; n < count; n++) {
+            float f;
+
+            memcpy(&f, in + 4 * n, sizeof(f));
+            values[n] = f;
+        }
+        break;
+
+    case SAMPLEFORMAT_FIXED:
+        for (unsigned long n = 0; n < count; n++) {
+            unsigned short fixed;
+
+            memcpy(&fixed, in + 2 * n, sizeof(fixed));
+            values[n] = fixed ? min + (fixed - 1) * (max - min) / 65534.0 : MINFLOAT;
+        }
+        break;
+
+    case SAMPLEFORMAT_BYTE:
+        for (unsigned long n = 0; n < count; n++)
+            values[n] = in[n] ? min + (in[n] - 1) * (max - min) / 254.0 : MINFLOAT;
+        break;
+    }
+}
@@ -0,0 +1,35 @@
+#ifndef SAMPLE_CODEC_H
+#define SAMPLE_CODEC_H
+
+/*
+ * Wire formats for the values of a sample on their way from the model
+ * to the vis. Solid cells carry MINFLOAT (see computePlanarSample()),
+ * which every format keeps as a marker of its own.
+ *
+ *	double	8 bytes, as computed
+ *	float	4 bytes, IEEE 754 binary32, which holds MINFLOAT exactly
+ *	half	2 bytes, IEEE 754 binary16
+ *	fixed	2 bytes, linear between min and max, 0 marks solid
+ *	byte	1 byte, linear between min and max, 0 marks solid; an index
+ *		into a colour table of 255 entries spread over min .. max
+ */
+#define SAMPLEFORMAT_DOUBLE	0
+#define SAMPLEFORMAT_HALF	1
+#define SAMPLEFORMAT_BYTE	2
+#define SAMPLEFORMAT_FLOAT	3
+#define SAMPLEFORMAT_FIXED	4
+
+// bytes per value, 0 for an unknown format
+unsigned int sampleSize(int format);
+
+// "double", "float", "half", "fixed" or "byte" from the config, double
+// for anything else
+int sampleFormat(const char *name);
+
+// out must hold count * sampleSize(format) bytes
+void encodeSamples(const double *values, unsigned long count, int format,
+                   double min, double max, unsigned char *out);
+void decodeSamples(const unsigned char *in, unsigned long count, int format,
+                   double min, double max, double *values);
+
+#endif
@@ -0,0 +1,139 @@
+#include <string.h>
+
+#include "SampleStream.h"
+
+// zeros in a row worth ending a literal run for
+#define STREAM_MINRUN	3
+
+static void putVarint(std::vector<unsigned char> &out, unsigned long value)
+{
+    while (value >= 0x80) {
+        out.push_back((unsigned char) (value | 0x80));
+        value >>= 7;
+    }
+    out.push_back((unsigned char) value);
+}
+
+static bool getVarint(const unsigned char *&in, const unsigned char *end, unsigned long &value)
+{
+    value = 0;
+
+    for (int shift = 0; in < end && shift < 64; shift += 7) {
+        unsigned char byte = *in++;
+
+        value |= (unsigned long) (byte & 0x7f) << shift;
+        if (!(byte & 0x80))
+            return true;
+    }
+    return false;
+}
+
+SampleStream::SampleStream()
+{
+    keyframes = 16;
+}
+
+void SampleStream::reset()
+{
+    frames.clear();
+}
+
+void SampleStream::forget(int id)
+{
+    frames.erase(id);
+}
+
+void SampleStream::encode(int id, const unsigned char *frame, unsigned long size, std::vector<unsigned char> &out)
+{
+    bool key = frames.find(id) == frames.end();
+    history &h = frames[id];
+
+    key = key || h.last.size() != size || h.age + 1 >= keyframes;
+
+    // the residual: the frame itself or what changed since the last one
+    std::vector<unsigned char> residual(frame, frame + size);
+
+    if (key) {
+        h.age = 0;
+    } else {
+        for (unsigned long n = 0; n < size; n++)
+            residual[n] ^= h.last[n];
+        h.age++;
+    }
+    h.last.assign(frame, frame + size);
+
+    out.clear();
+    out.push_back(key ? STREAM_KEY : STREAM_DELTA);
+    putVarint(out, size);
+
+    unsigned long i = 0;
+
+    while (i < size) {
+        unsigned long start = i;
+
+        while (i < size && !residual[i])
+            i++;
+        putVarint(out, i - start);
+
+        // literals up to the next run of zeros long enough to pay off
+        unsigned long literal = i;
+
+        while (i < size) {
+            unsigned long zeros = 0;
+
+            while (i + zeros < size && !residual[i + zeros])
+                zeros++;
+            if (zeros >= STREAM_MINRUN || i + zeros == size)
+                break;
+            i += zeros ? zeros : 1;
+        }
+        putVarint(out, i - literal);
+        out.insert(out.end(), residual.begin() + literal, residual.begin() + i);
+    }
+}
+
+bool SampleStream::decode(int id, const unsigned char *in, unsigned long size, std::vector<unsigned char> &frame)
+{
+    const unsigned char *end = in + size;
+    unsigned long length;
+
+    if (size < 1)
+        return false;
+
+    int kind = *in++;
+
+    if (!getVarint(in, end, length))
+        return false;
+
+    if (kind == STREAM_DELTA && (frames.find(id) == frames.end() || frames[id].last.size() != length))
+        return false;
+
+    history &h = frames[id];
+
+    frame.assign(length, 0);
+
+    unsigned long n = 0;
+
+    while (n < length) {
+        unsigned long zeros, literal;
+
+        if (!getVarint(in, end, zeros) || !getVarint(in, end, literal))
+            return false;
+        if (zeros > length - n || literal > length - n - zeros || literal > (unsigned long) (end - in))
+            return false;
+
+        n += zeros;
+        if (literal)
+            memcpy(&frame[n], in, literal);
+        in += literal;
+        n += literal;
+    }
+
+    if (kind == STREAM_DELTA) {
+        for (n = 0; n < length; n++)
+            frame[n] ^= h.last[n];
+    }
+
+    h.last = frame;
+    return true;
+}
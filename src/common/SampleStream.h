@@ -0,0 +1,59 @@
+#ifndef SAMPLE_STREAM_H
+#define SAMPLE_STREAM_H
+
+#include <map>
+#include <vector>
+
+/*
+ * Frame to frame compression of the packed values of a sample (see
+ * SampleCodec.h), for the samples which are pushed to the vis on every
+ * filter tick.
+ *
+ * Both ends remember the last frame of every sample id. A delta frame
+ * is the XOR of the new frame with that one, which leaves zeros wherever
+ * the flow did not change; a key frame is the frame itself. Either is
+ * run length coded: pairs of varint counts of zero bytes and of literal
+ * bytes, the literals following their count.
+ *
+ *	byte	STREAM_KEY or STREAM_DELTA
+ *	varint	size of the frame
+ *	...	runs
+ *
+ * Every keyframes-th frame of an id, and every frame whose size changed,
+ * is a key frame, so a decoder which lost track (the vis logged in
+ * again, say) catches up after a while.
+ */
+#define STREAM_KEY	0
+#define STREAM_DELTA	1
+
+class SampleStream
+{
+public:
+	SampleStream();
+
+	void setKeyframes(int n) { keyframes = n > 0 ? n : 1; };
+
+	// forgets all frames, the next one of every id is a key frame
+	void reset();
+	// forgets the frame of a deleted sample
+	void forget(int id);
+
+	void encode(int id, const unsigned char *frame, unsigned long size,
+	            std::vector<unsigned char> &out);
+
+	// false if the frame is broken or a delta to a frame we never saw
+	bool decode(int id, const unsigned char *in, unsigned long size,
+	            std::vector<unsigned char> &frame);
+
+private:
+	struct history
+	{
+		std::vector<unsigned char> last;
+		int age;		// frames since the last key frame
+	};
+
+	std::map<int, history> frames;
+	int keyframes;
+};
+
+#endif
@@ -68,6 +68,8 @@ FAN::FAN(FAN *fan)
 {
     threaded 	= fan->threaded;
     clearText 	= fan->clearText;
+    binaryFrames = 0;
+    sendBuffer = NULL;
     theDaemon = NULL;
 
     setDefaultSignalHandlers();
@@ -113,6 +115,8 @@ FAN::FAN(char *file,bool connect)
     returnHash = NULL;
 
     clearText = 0;
+    binaryFrames = 0;
+    sendBuffer = NULL;
 
     LOG_LVL      = FAN_ERROR;
     LOG_FACILITY = FAN_CONSOLE;
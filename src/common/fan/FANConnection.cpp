@@ -21,6 +21,51 @@
 #include "FANClasses.h"
 #include <sys/socket.h>
 
+/**
+ * A call sent by #FAN_Connection::post
+ */
+typedef struct {
+    FAN_Hash *reply;		// NULL until the reply was read
+    bool failed;		// the connection broke before the reply
+    bool notified;		// hand the reply to the handler instead of keeping it
+    FAN_ReplyHandler handler;
+    void *data;
+} FAN_Call;
+
+static FAN_Call *FAN_getCall(FAN_Hash *calls, int id)
+{
+    char key[16];
+    sprintf(key, "%d", id);
+    return (FAN_Call*)calls->getPointer(key);
+}
+
+/*
+ * the hash frees the call itself
+ */
+static void FAN_removeCall(FAN_Hash *calls, int id)
+{
+    char key[16];
+    sprintf(key, "%d", id);
+    calls->removePointer(key);
+}
+
+/*
+ * the ids of all calls, so that they can be removed while walking them
+ */
+static int *FAN_getCallIds(FAN_Hash *calls, int *count)
+{
+    *count = calls->getPointerLength();
+    char **keys = (char**)malloc(*count * sizeof(char*) + 1);
+    int *ids = (int*)malloc(*count * sizeof(int) + 1);
+
+    calls->getPointerKeys(keys);
+    for(int i=0; i<*count; i++)
+        ids[i] = atoi(keys[i]);
+
+    free(keys);
+    return ids;
+}
+
 FAN_Connection::FAN_Connection(char *service, char *host, int port) {
     if(service != NULL)
         this->service=strdup(service);
@@ -31,6 +76,12 @@ FAN_Connection::FAN_Connection(char *service, char *host, int port) {
     this->port = port;
     this->connSock = 0;
     this->connected = false;
+    this->binary = false;
+    this->tagged = false;
+    this->lastId = 0;
+    this->outstanding = 0;
+    this->pushAcks = 0;
+    calls = new FAN_Hash();
     returnHash = new FAN_Hash();
 }
 
@@ -41,6 +92,12 @@ FAN_Connection::FAN_Connection(char *service){
         this->service=NULL;
     this->connSock = 0;
     this->isFileSocket=false;
+    this->binary = false;
+    this->tagged = false;
+    this->lastId = 0;
+    this->outstanding = 0;
+    this->pushAcks = 0;
+    calls = new FAN_Hash();
     returnHash = new FAN_Hash();
 }
 
@@ -49,6 +106,21 @@ FAN_Connection::~FAN_Connection(){
 
     if(isConnected())
 	disconnect();
+
+    // replies nobody waited for
+    failCalls();
+    int count;
+    int *ids = FAN_getCallIds(calls, &count);
+    for(int i=0; i<count; i++)
+    {
+        FAN_Call *call = FAN_getCall(calls, ids[i]);
+        if(call->reply != NULL)
+            delete call->reply;
+        FAN_removeCall(calls, ids[i]);
+    }
+    free(ids);
+    delete calls;
+
     if(service != NULL)
         free(service);
     if(host != NULL)
@@ -75,10 +147,22 @@ bool FAN_Connection::connect(char *cHost,int cPort)
     
     // returnHash = new FAN_Hash();
     
+    binary = false;
+    tagged = false;
+    pushAcks = 0;
+
     if(connSock > 0)
     {
         rpc("sys::endian", 1, FAN::app->config->getValue("endian"));
 
+        // servers without binary frames simply do not understand sys::binary
+        char *binaryrpc = FAN::app->config->getValue("binaryrpc");
+        if(binaryrpc == NULL || strcasecmp(binaryrpc, "false") != 0)
+        {
+            binary = rpc("sys::binary");
+            tagged = binary && returnHash->checkKey("REQUESTIDS", "TRUE");
+        }
+
         if(service != NULL)
         {
             rpc("use", 1, service);
@@ -94,20 +178,18 @@ bool FAN_Connection::connect(char *cHost,int cPort)
 bool FAN_Connection::isConnected()
 {
         FAN_ENTER;
-	if(connSock != 0)
+	if(connSock > 0)
 	{
-		if(rpc("sys::ping"))
+		// replies may be waiting in the socket, so only peek
+		char c;
+		int len = recv(connSock, &c, 1, MSG_PEEK | MSG_DONTWAIT);
+
+		if(len > 0 || (len < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR)))
 		{
 		   FAN_RETURN true;
-		}else
-		{
-		   FAN_RETURN false;
 		}
 	}
-	else
-	{
-		FAN_RETURN false;
-	}
+	FAN_RETURN false;
 }
 
 bool FAN_Connection::disconnect()
@@ -115,13 +197,11 @@ bool FAN_Connection::disconnect()
         FAN_ENTER;
         if(connSock > 0)
         {
-                if((FAN::app->errorNo = close(connSock)) == 0)
-		{
-                        FAN_RETURN true;
-		}
-
+                FAN::app->errorNo = close(connSock);
                 connSock = 0;
         }
+        // calls in flight will not be answered any more
+        failCalls();
         FAN_RETURN true;
 }
 
@@ -162,8 +242,22 @@ bool FAN_Connection::rpc(FAN_Hash *hash, char *name, int count, ...)
 bool FAN_Connection::vrpc(FAN_Hash *hash, char *name, int count, va_list argument)
 {
     FAN_ENTER;
+    if(connSock > 0 && !readAcks(true))
+    {
+        FAN_RETURN false;
+    }
     if(connSock > 0)
     {
+        // posted calls may still be waiting for their replies
+        if(tagged)
+        {
+            int id = vpost(name, count, argument);
+            FAN_RETURN (id != 0 && wait(id, hash));
+        }
+        if(binary)
+        {
+            FAN_RETURN FAN_vrpcFrame(hash, connSock, name, count, argument);
+        }
         FAN_RETURN FAN_vrpc(hash, connSock, name, count, argument);
     }else
     {
@@ -185,18 +279,48 @@ bool FAN_Connection::vrpc(char *name, int count, va_list argument)
 
 bool FAN_Connection::stopBinaryPush()
 {
+    FAN_ENTER;
+    FAN_RETURN (endBinaryPush() && readAcks(true));
+}
+
+bool FAN_Connection::endBinaryPush()
+{
+    FAN_ENTER;
     if(connSock > 0)
     {
-    	FAN_swrite(connSock, "\n");
-	int len = 0;
-	char buf[2];
-	len = recv(connSock, buf, 1, MSG_WAITALL);
-	if(len < 0)
+	if(FAN_swrite(connSock, "\n") < 0)
 	{
-		return false;
+		failCalls();
+		FAN_RETURN false;
 	}
+	pushAcks++;
     }
-    return true;
+    FAN_RETURN true;
+}
+
+bool FAN_Connection::readAcks(bool block)
+{
+    FAN_ENTER;
+    while(connSock > 0 && pushAcks > 0)
+    {
+	char buf[FAN_RPC_WINDOW];
+	int want = pushAcks < FAN_RPC_WINDOW ? pushAcks : FAN_RPC_WINDOW;
+	int len = recv(connSock, buf, want, block ? MSG_WAITALL : MSG_DONTWAIT);
+
+	if(len < 0 && errno == EINTR)
+		continue;
+	if(len < 0 && !block && (errno == EAGAIN || errno == EWOULDBLOCK))
+		break;
+	if(len <= 0)
+	{
+		FAN_xlog(FAN_ERROR | FAN_SOCKET, "reading a push acknowledgement from %s:%d failed", host, port);
+		failCalls();
+		FAN_RETURN false;
+	}
+	pushAcks -= len;
+    }
+
+    FAN_RETURN connSock > 0;
 }
 
 bool FAN_Connection::startBinaryPush(char *fkt)
@@ -236,6 +360,22 @@ bool FAN_Connection::rpc(FAN_Hash *hash, char *name, char* fmt, ...)
     va_end(argument);
 }
 
+bool FAN_Connection::binaryPushv(char *fmt, struct iovec *iov, int count)
+{
+    FAN_ENTER;
+    if(connSock > 0)
+    {
+        int ret = FAN_binaryPushv(connSock, fmt, iov, count);
+	if(ret < 0)
+	{
+		failCalls();
+		FAN_RETURN false;
+	}
+	FAN_RETURN ret > 0;
+    }
+    FAN_RETURN false;
+}
+
 bool FAN_Connection::vbinaryPush(char *fmt, va_list argument)
 {
     FAN_ENTER;
@@ -263,9 +403,19 @@ bool FAN_Connection::vbinaryPush(char *fmt, va_list argument)
 bool FAN_Connection::vrpc(FAN_Hash *hash, char *name, char *fmt, va_list argument)
 {
     FAN_ENTER;
+    if(connSock > 0 && !readAcks(true))
+    {
+        FAN_RETURN false;
+    }
+    if(connSock > 0 && tagged)
+    {
+        int id = vpost(name, fmt, argument);
+        FAN_RETURN (id != 0 && wait(id, hash));
+    }
     if(connSock > 0)
     {
-        int ret = FAN_vrpc(hash, connSock, name, fmt, argument);
+        int ret = binary ? FAN_vrpcFrame(hash, connSock, name, fmt, argument)
+                         : FAN_vrpc(hash, connSock, name, fmt, argument);
 	if(ret < 0)
 	{
 		connSock = 0;
@@ -293,3 +443,298 @@ bool FAN_Connection::vrpc(char *name, char *fmt, va_list argument)
     }
     FAN_RETURN false;
 }
+
+int FAN_Connection::addCall(FAN_Hash *reply)
+{
+    FAN_Call *call = (FAN_Call*)malloc(sizeof(FAN_Call));
+    char key[16];
+
+    if(++lastId <= 0)
+        lastId = 1;
+
+    call->reply = reply;
+    call->failed = false;
+    call->notified = false;
+    call->handler = NULL;
+    call->data = NULL;
+
+    sprintf(key, "%d", lastId);
+    calls->insertPointer(key, call);
+
+    if(reply == NULL)
+        outstanding++;
+
+    return lastId;
+}
+
+void FAN_Connection::failCalls()
+{
+    FAN_ENTER;
+    if(connSock > 0)
+    {
+        close(connSock);
+        connSock = 0;
+    }
+    outstanding = 0;
+    pushAcks = 0;
+
+    int count;
+    int *ids = FAN_getCallIds(calls, &count);
+    for(int i=0; i<count; i++)
+    {
+        FAN_Call *call = FAN_getCall(calls, ids[i]);
+        if(call->reply != NULL || call->failed)
+            continue;
+
+        call->failed = true;
+        if(call->notified)
+        {
+            if(call->handler != NULL)
+                call->handler(ids[i], NULL, call->data);
+            FAN_removeCall(calls, ids[i]);
+        }
+    }
+    free(ids);
+    FAN_RETURN;
+}
+
+bool FAN_Connection::collect(bool block)
+{
+    FAN_ENTER;
+    if(connSock <= 0)
+    {
+        FAN_RETURN false;
+    }
+
+    // acknowledgements of pushes come before the replies
+    if(!readAcks(block))
+    {
+        FAN_RETURN false;
+    }
+    if(pushAcks > 0)
+    {
+        FAN_RETURN false;
+    }
+
+    if(!block)
+    {
+        unsigned char head[4];
+        if(recv(connSock, head, 4, MSG_PEEK | MSG_DONTWAIT) != 4)
+        {
+            FAN_RETURN false;
+        }
+    }
+
+    FAN_Hash *reply = new FAN_Hash();
+    int id = 0;
+    if(!FAN_readReplyFrame(reply, connSock, &id))
+    {
+        FAN_xlog(FAN_ERROR | FAN_SOCKET, "reading a reply from %s:%d failed", host, port);
+        delete reply;
+        failCalls();
+        FAN_RETURN false;
+    }
+
+    FAN_Call *call = FAN_getCall(calls, id);
+    if(call == NULL || call->reply != NULL || call->failed)
+    {
+        FAN_xlog(FAN_DEBUG | FAN_SOCKET, "reply to unknown call %d", id);
+        delete reply;
+        FAN_RETURN true;
+    }
+    outstanding--;
+
+    if(call->notified)
+    {
+        if(call->handler != NULL)
+            call->handler(id, reply, call->data);
+        FAN_removeCall(calls, id);
+        delete reply;
+    }else
+    {
+        call->reply = reply;
+    }
+    FAN_RETURN true;
+}
+
+/*
+ * reads the replies that have arrived and keeps the number of calls in
+ * flight below FAN_RPC_WINDOW, so that neither side blocks in send
+ * while the other one does as well
+ */
+bool FAN_Connection::makeRoom()
+{
+    FAN_ENTER;
+    while(collect(false))
+        ;
+
+    while(outstanding >= FAN_RPC_WINDOW)
+    {
+        if(!collect(true))
+        {
+            FAN_RETURN false;
+        }
+    }
+    FAN_RETURN connSock > 0;
+}
+
+int FAN_Connection::post(char *name, int count, ...)
+{
+    FAN_ENTER;
+    va_list argument;
+    va_start(argument, count);
+    int id = vpost(name, count, argument);
+    va_end(argument);
+
+    FAN_RETURN id;
+}
+
+int FAN_Connection::post(char *name, char *fmt, ...)
+{
+    FAN_ENTER;
+    va_list argument;
+    va_start(argument, fmt);
+    int id = vpost(name, fmt, argument);
+    va_end(argument);
+
+    FAN_RETURN id;
+}
+
+int FAN_Connection::vpost(char *name, int count, va_list argument)
+{
+    FAN_ENTER;
+    if(!tagged)
+    {
+        // without request ids the call is answered right away
+        FAN_Hash *reply = new FAN_Hash();
+        if(!vrpc(reply, name, count, argument))
+        {
+            delete reply;
+            FAN_RETURN 0;
+        }
+        FAN_RETURN addCall(reply);
+    }
+
+    if(!makeRoom())
+    {
+        FAN_RETURN 0;
+    }
+
+    int id = addCall(NULL);
+    if(FAN_vpostFrame(connSock, id, name, count, argument) < 0)
+    {
+        FAN_removeCall(calls, id);
+        failCalls();
+        FAN_RETURN 0;
+    }
+    FAN_RETURN id;
+}
+
+int FAN_Connection::vpost(char *name, char *fmt, va_list argument)
+{
+    FAN_ENTER;
+    if(!tagged)
+    {
+        FAN_Hash *reply = new FAN_Hash();
+        if(!vrpc(reply, name, fmt, argument))
+        {
+            delete reply;
+            FAN_RETURN 0;
+        }
+        FAN_RETURN addCall(reply);
+    }
+
+    if(!makeRoom())
+    {
+        FAN_RETURN 0;
+    }
+
+    int id = addCall(NULL);
+    if(FAN_vpostFrame(connSock, id, name, fmt, argument) < 0)
+    {
+        FAN_removeCall(calls, id);
+        failCalls();
+        FAN_RETURN 0;
+    }
+    FAN_RETURN id;
+}
+
+bool FAN_Connection::wait(int id, FAN_Hash *hash)
+{
+    FAN_ENTER;
+    FAN_Call *call = FAN_getCall(calls, id);
+
+    if(call == NULL || call->notified)
+    {
+        FAN_RETURN false;
+    }
+
+    while(call->reply == NULL && !call->failed)
+    {
+        if(!collect(true))
+            break;
+    }
+
+    bool ret = false;
+    if(call->reply != NULL)
+    {
+        call->reply->copyValues(hash);
+        delete call->reply;
+        ret = true;
+    }
+    FAN_removeCall(calls, id);
+
+    FAN_RETURN ret;
+}
+
+bool FAN_Connection::wait(int id)
+{
+    FAN_ENTER;
+    returnHash->clear();
+    bool ret = wait(id, returnHash);
+
+    FAN_RETURN (returnHash->checkKey("RETURN","TRUE") && ret);
+}
+
+bool FAN_Connection::notify(int id, FAN_ReplyHandler handler, void *data)
+{
+    FAN_ENTER;
+    FAN_Call *call = FAN_getCall(calls, id);
+
+    if(call == NULL || call->notified)
+    {
+        FAN_RETURN false;
+    }
+
+    if(call->reply != NULL || call->failed)
+    {
+        if(handler != NULL)
+            handler(id, call->reply, data);
+        if(call->reply != NULL)
+            delete call->reply;
+        FAN_removeCall(calls, id);
+        FAN_RETURN true;
+    }
+
+    call->notified = true;
+    call->handler = handler;
+    call->data = data;
+    FAN_RETURN true;
+}
+
+bool FAN_Connection::flush()
+{
+    FAN_ENTER;
+    if(!readAcks(true))
+    {
+        FAN_RETURN false;
+    }
+    while(outstanding > 0)
+    {
+        if(!collect(true))
+        {
+            FAN_RETURN false;
+        }
+    }
+    FAN_RETURN connSock > 0;
+}
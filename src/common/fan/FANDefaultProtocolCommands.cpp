@@ -57,6 +57,7 @@ void FAN_init()
     FAN_loadCmd("sys::LoadCmd", &FAN_cmdSysLoadCmd, true, true);
     FAN_loadCmd("sys::halt", &FAN_cmdSysHalt, true, true);
     FAN_loadCmd("sys::ping", &FAN_cmdSysPing, true, true);
+    FAN_loadCmd("sys::binary", &FAN_cmdSysBinary, true, true);
 
     FAN_loadCmd("exit", &FAN_cmdExit, true, true);
     FAN_loadCmd("use", &FAN_cmdUse, true, true);
@@ -442,6 +443,29 @@ void FAN_cmdClearText(FAN_Hash *ret, char **params)
 	FAN_RETURN;	
 }       
 
+void FAN_cmdSysBinary(FAN_Hash *ret, char **params)
+{
+	FAN_ENTER;
+        FAN *conf = NULL;
+
+        if(FAN::app->threaded==1)
+                conf = (FAN*)pthread_getspecific(FAN::app->threadFAN);
+
+        if(conf != NULL)
+        {
+                conf->binaryFrames = 1;
+                ret->insert("return", "TRUE");
+                ret->insert("returnmsg", "Binary ON");
+                // frames may carry request ids, see FAN_FRAME_TAGGED
+                ret->insert("requestids", "TRUE");
+        }else
+        {
+                ret->insert("return", "FALSE");
+                ret->insert("returnmsg", "Binary FAILED");
+        }
+	FAN_RETURN;
+}
+
 void FAN_cmdNoClearText(FAN_Hash *ret, char **params)
 {
 	FAN_ENTER;
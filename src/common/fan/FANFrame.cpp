@@ -0,0 +1,582 @@
+/*
+ * FAN - Framework for Applications in Networks
+ * Copyright (C) 2004 FreshX [dominik@freshx.de]
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include "FANClasses.h"
+
+static void FAN_putLength(unsigned char *p, int len)
+{
+	uint32_t n = htonl((uint32_t)len);
+	memcpy(p, &n, 4);
+}
+
+static int FAN_getLength(unsigned char *p)
+{
+	uint32_t n;
+	memcpy(&n, p, 4);
+	return (int)ntohl(n);
+}
+
+static unsigned char *FAN_putField(unsigned char *p, void *data, int len)
+{
+	FAN_putLength(p, len);
+	if(len > 0)
+		memcpy(p + 4, data, len);
+	return p + 4 + len;
+}
+
+static bool FAN_recvAll(int sd, unsigned char *data, int size)
+{
+	int off = 0;
+	while(off < size)
+	{
+		int len = recv(sd, data + off, size - off, MSG_WAITALL);
+		if(len < 0 && errno == EINTR)
+			continue;
+		if(len <= 0)
+			return false;
+		off += len;
+	}
+	return true;
+}
+
+/*
+ * builds the frame [kind][id][fields] behind its length and sends it in
+ * one go, the id is left out if it is 0
+ */
+static int FAN_sendFrame(int sd, int kind, int id, int count, unsigned char **fields, int *sizes)
+{
+	int i;
+	int len = id != 0 ? 5 : 1;
+
+	for(i=0; i<count; i++)
+		len += 4 + sizes[i];
+
+	unsigned char *frame = (unsigned char*)malloc(4 + len);
+	if(frame == NULL)
+		return -1;
+
+	FAN_putLength(frame, len);
+	frame[4] = (unsigned char)kind;
+
+	unsigned char *p = frame + 5;
+	if(id != 0)
+	{
+		frame[4] |= FAN_FRAME_TAGGED;
+		FAN_putLength(p, id);
+		p += 4;
+	}
+	for(i=0; i<count; i++)
+		p = FAN_putField(p, fields[i], sizes[i]);
+
+	int err = FAN_swrite(sd, frame, 4 + len);
+	free(frame);
+
+	return err;
+}
+
+int FAN_vpostFrame(int sd, int id, char *fkt, int params, va_list argument)
+{
+	FAN_ENTER;
+	int i;
+	int count = 0;
+	unsigned char **fields = new unsigned char*[params + 1];
+	int *sizes = new int[params + 1];
+
+	fields[count] = (unsigned char*)fkt;
+	sizes[count++] = strlen(fkt) + 1;
+
+	for(i=0; i<params; i++)
+	{
+		char *arg = va_arg(argument, char*);
+
+		if(arg != NULL)
+		{
+			fields[count] = (unsigned char*)arg;
+			sizes[count++] = strlen(arg) + 1;
+		}
+	}
+
+	int err = FAN_sendFrame(sd, FAN_FRAME_STRINGS, id, count, fields, sizes);
+
+	delete[] fields;
+	delete[] sizes;
+
+	FAN_RETURN err;
+}
+
+int FAN_vpostFrame(int sd, int id, char *fkt, char *fmt, va_list argument)
+{
+	FAN_ENTER;
+	int i, type, asize;
+	char *types = fmt;
+	char *txt;
+
+	int params = FAN_getParamCount(fmt);
+	int count = 0;
+	unsigned char **fields = new unsigned char*[params + 2];
+	int *sizes = new int[params + 2];
+	FAN_Scalar *scalars = new FAN_Scalar[params];
+
+	fields[count] = (unsigned char*)fkt;
+	sizes[count++] = strlen(fkt) + 1;
+
+	if(params > 0)
+	{
+		fields[count] = (unsigned char*)fmt;
+		sizes[count++] = strlen(fmt) + 1;
+	}
+
+	for(i=0; i<params; i++)
+	{
+		unsigned char *arg = NULL;
+		int size = 0;
+
+		asize = 1;
+		type = FAN_getNextType(&types, &txt, &asize);
+
+		switch(type)
+		{
+			case FAN_INT:    if(asize > 1)
+						 arg = (unsigned char*)va_arg(argument, int*);
+					 else
+					 {
+						 scalars[i].i = va_arg(argument, int);
+						 arg = (unsigned char*)&scalars[i].i;
+					 }
+					 size = sizeof(int) * asize;
+					 break;
+			case FAN_FLOAT:
+			case FAN_DOUBLE: if(asize > 1)
+						 arg = (unsigned char*)va_arg(argument, double*);
+					 else
+					 {
+						 scalars[i].d = va_arg(argument, double);
+						 arg = (unsigned char*)&scalars[i].d;
+					 }
+					 size = sizeof(double) * asize;
+					 break;
+			case FAN_BYTE:   if(asize > 1)
+						 arg = (unsigned char*)va_arg(argument, unsigned char*);
+					 else
+					 {
+						 scalars[i].b = va_arg(argument, int);
+						 arg = &scalars[i].b;
+					 }
+					 size = sizeof(unsigned char) * asize;
+					 break;
+			case FAN_CHAR:   if(asize > 1)
+						 arg = (unsigned char*)va_arg(argument, char*);
+					 else
+					 {
+						 scalars[i].c = va_arg(argument, int);
+						 arg = (unsigned char*)&scalars[i].c;
+					 }
+					 size = sizeof(char) * asize;
+					 break;
+			case FAN_STRUCT: arg = (unsigned char*)va_arg(argument, unsigned char*);
+					 size = FAN_getParamSize(txt, true) * asize;
+					 break;
+			case FAN_LONG:   if(asize > 1)
+						 arg = (unsigned char*)va_arg(argument, long*);
+					 else
+					 {
+						 scalars[i].l = va_arg(argument, long);
+						 arg = (unsigned char*)&scalars[i].l;
+					 }
+					 size = sizeof(long) * asize;
+					 break;
+			default:	 break;
+		}
+
+		if(arg != NULL)
+		{
+			fields[count] = arg;
+			sizes[count++] = size;
+		}
+	}
+
+	int err = FAN_sendFrame(sd, FAN_FRAME_TYPED, id, count, fields, sizes);
+
+	delete[] fields;
+	delete[] sizes;
+	delete[] scalars;
+
+	FAN_RETURN err;
+}
+
+int FAN_vrpcFrame(FAN_Hash *hash, int sd, char *fkt, int params, va_list argument)
+{
+	FAN_ENTER;
+	int ret = FAN_vpostFrame(sd, 0, fkt, params, argument);
+
+	if(ret >= 0)
+	{
+		ret = FAN_readReplyFrame(hash, sd);
+	}
+	FAN_RETURN ret;
+}
+
+int FAN_vrpcFrame(FAN_Hash *hash, int sd, char *fkt, char *fmt, va_list argument)
+{
+	FAN_ENTER;
+	int ret = FAN_vpostFrame(sd, 0, fkt, fmt, argument);
+
+	if(ret >= 0)
+	{
+		ret = FAN_readReplyFrame(hash, sd);
+	}
+	FAN_RETURN ret;
+}
+
+/*
+ * checks the length read from a frame header
+ */
+static bool FAN_frameLengthOk(int len)
+{
+	if(len < 1 || len > FAN_FRAME_MAXLEN)
+	{
+		FAN_xlog(FAN_ERROR | FAN_SOCKET, "frame of %d bytes refused", len);
+		return false;
+	}
+	return true;
+}
+
+unsigned char *FAN_arecvFrame(int sd, int *size)
+{
+	FAN_ENTER;
+	unsigned char head[4];
+
+	if(!FAN_recvAll(sd, head, 4))
+	{
+		FAN_RETURN NULL;
+	}
+
+	int len = FAN_getLength(head);
+	if(!FAN_frameLengthOk(len))
+	{
+		FAN_RETURN NULL;
+	}
+
+	unsigned char *frame = (unsigned char*)malloc(len);
+	if(frame == NULL)
+	{
+		FAN_RETURN NULL;
+	}
+
+	if(!FAN_recvAll(sd, frame, len))
+	{
+		free(frame);
+		FAN_RETURN NULL;
+	}
+
+	*size = len;
+	FAN_RETURN frame;
+}
+
+unsigned char *FAN_arecvFrame(FAN_LineReader *reader, int *size)
+{
+	FAN_ENTER;
+	unsigned char head[4];
+
+	if(!reader->read(head, 4))
+	{
+		FAN_RETURN NULL;
+	}
+
+	int len = FAN_getLength(head);
+	if(!FAN_frameLengthOk(len))
+	{
+		FAN_RETURN NULL;
+	}
+
+	unsigned char *frame = (unsigned char*)malloc(len);
+	if(frame == NULL)
+	{
+		FAN_RETURN NULL;
+	}
+
+	if(!reader->read(frame, len))
+	{
+		free(frame);
+		FAN_RETURN NULL;
+	}
+
+	*size = len;
+	FAN_RETURN frame;
+}
+
+bool FAN_hasFrame(FAN_LineReader *reader)
+{
+	unsigned char head[4];
+
+	if(!reader->peek(head, 4))
+		return false;
+
+	int len = FAN_getLength(head);
+
+	/* a bad length is left to FAN_arecvFrame to refuse */
+	return len < 1 || len > FAN_FRAME_MAXLEN || reader->pending() >= 4 + len;
+}
+
+/*
+ * splits the kind and the request id off the frame
+ *
+ * @return the offset of the first field, or -1 if the frame is too short
+ */
+static int FAN_frameHead(unsigned char *frame, int size, int *kind, int *id)
+{
+	*kind = frame[0] & ~FAN_FRAME_TAGGED;
+	*id = 0;
+
+	if(!(frame[0] & FAN_FRAME_TAGGED))
+		return 1;
+	if(size < 5)
+		return -1;
+
+	*id = FAN_getLength(frame + 1);
+	return 5;
+}
+
+/*
+ * counts the fields of a frame from [off] on and checks that they fit
+ * into it
+ */
+static int FAN_countFields(unsigned char *frame, int size, int off)
+{
+	int count = 0;
+
+	while(off < size)
+	{
+		if(size - off < 4)
+			return -1;
+
+		int len = FAN_getLength(frame + off);
+		if(len < 0 || len > size - off - 4)
+			return -1;
+
+		off += 4 + len;
+		count++;
+	}
+	return count;
+}
+
+/*
+ * a string field has to end with its '\0'
+ */
+static bool FAN_isString(unsigned char *field, int len)
+{
+	return len > 0 && field[len - 1] == '\0';
+}
+
+bool FAN_parseFrame(unsigned char *frame, int size, char **cmd_pointer, char ***pparams, int *id)
+{
+	FAN_ENTER;
+	int kind;
+
+	*cmd_pointer = NULL;
+	*pparams = NULL;
+
+	int start = FAN_frameHead(frame, size, &kind, id);
+	if(start < 0 || (kind != FAN_FRAME_STRINGS && kind != FAN_FRAME_TYPED))
+	{
+		FAN_RETURN false;
+	}
+
+	int count = FAN_countFields(frame, size, start);
+	if(count < 1)
+	{
+		FAN_RETURN false;
+	}
+
+	char **params = new char *[count + 1];
+	unsigned char *p = frame + start;
+	int i;
+
+	for(i=0; i<count; i++)
+	{
+		int len = FAN_getLength(p);
+
+		p += 4;
+		if(i == 0)
+			*cmd_pointer = (char*)p;
+		else
+			params[i] = (char*)p;
+
+		/* the name, the template and string arguments are strings */
+		if((i == 0 || kind == FAN_FRAME_STRINGS || i == 1) && !FAN_isString(p, len))
+		{
+			delete[] params;
+			FAN_RETURN false;
+		}
+
+		p += len;
+	}
+	params[0] = (char*)(long)(count - 1);
+
+	/* typed arguments must have the size given by the template */
+	if(kind == FAN_FRAME_TYPED && count > 1)
+	{
+		char *templ = params[1];
+		char *types = templ;
+		char *txt;
+		int asize, type;
+
+		if(FAN_getParamCount(templ) != count - 2)
+		{
+			delete[] params;
+			FAN_RETURN false;
+		}
+
+		p = frame + start + 4 + FAN_getLength(frame + start);
+		p += 4 + FAN_getLength(p);
+
+		for(i=2; i<count; i++)
+		{
+			asize = 1;
+			type = FAN_getNextType(&types, &txt, &asize);
+
+			int want = FAN_getParamSize(txt, type == FAN_STRUCT);
+			if(type == FAN_STRUCT)
+				want *= asize;
+
+			int len = FAN_getLength(p);
+			if(len != want)
+			{
+				FAN_xlog(FAN_ERROR | FAN_SOCKET, "argument %d has %d bytes instead of %d", i - 1, len, want);
+				delete[] params;
+				FAN_RETURN false;
+			}
+			p += 4 + len;
+		}
+	}
+
+	*pparams = params;
+	FAN_RETURN true;
+}
+
+int FAN_sendReplyFrame(int sd, FAN_Hash *hash, int id)
+{
+	FAN_ENTER;
+	int size = hash->getLength();
+	char **keys = (char**)malloc(size * sizeof(char*));
+	unsigned char **fields = new unsigned char*[2 * size];
+	int *sizes = new int[2 * size];
+	int i;
+
+	hash->getKeys(keys);
+	for(i=0; i<size; i++)
+	{
+		char *value = hash->getValue(keys[i]);
+		if(value == NULL)
+			value = "";
+
+		fields[2 * i] = (unsigned char*)keys[i];
+		sizes[2 * i] = strlen(keys[i]) + 1;
+		fields[2 * i + 1] = (unsigned char*)value;
+		sizes[2 * i + 1] = strlen(value) + 1;
+	}
+
+	int err = FAN_sendFrame(sd, FAN_FRAME_REPLY, id, 2 * size, fields, sizes);
+
+	free(keys);
+	delete[] fields;
+	delete[] sizes;
+
+	FAN_RETURN err;
+}
+
+int FAN_sendReplyFrame(int sd, char *ret, char *msg, int id)
+{
+	FAN_ENTER;
+	unsigned char *fields[4];
+	int sizes[4];
+	int count = 0;
+
+	fields[count] = (unsigned char*)"RETURN";
+	sizes[count++] = 7;
+	fields[count] = (unsigned char*)ret;
+	sizes[count++] = strlen(ret) + 1;
+
+	if(msg != NULL)
+	{
+		fields[count] = (unsigned char*)"RETURNMSG";
+		sizes[count++] = 10;
+		fields[count] = (unsigned char*)msg;
+		sizes[count++] = strlen(msg) + 1;
+	}
+
+	FAN_RETURN FAN_sendFrame(sd, FAN_FRAME_REPLY, id, count, fields, sizes);
+}
+
+bool FAN_readReplyFrame(FAN_Hash *hash, int sd)
+{
+	FAN_ENTER;
+	int id;
+	FAN_RETURN FAN_readReplyFrame(hash, sd, &id);
+}
+
+bool FAN_readReplyFrame(FAN_Hash *hash, int sd, int *id)
+{
+	FAN_ENTER;
+	int size = 0;
+	int kind;
+	unsigned char *frame = FAN_arecvFrame(sd, &size);
+
+	if(frame == NULL)
+	{
+		FAN_RETURN false;
+	}
+
+	int start = FAN_frameHead(frame, size, &kind, id);
+	int count = start < 0 ? -1 : FAN_countFields(frame, size, start);
+	if(kind != FAN_FRAME_REPLY || count < 0 || count % 2 != 0)
+	{
+		free(frame);
+		FAN_RETURN false;
+	}
+
+	unsigned char *p = frame + start;
+	for(int i=0; i<count; i+=2)
+	{
+		char *key = (char*)p + 4;
+		int klen = FAN_getLength(p);
+		p += 4 + klen;
+
+		char *value = (char*)p + 4;
+		int vlen = FAN_getLength(p);
+		p += 4 + vlen;
+
+		if(!FAN_isString((unsigned char*)key, klen) || !FAN_isString((unsigned char*)value, vlen))
+		{
+			free(frame);
+			FAN_RETURN false;
+		}
+
+		hash->insert(key, value);
+	}
+
+	free(frame);
+	FAN_RETURN true;
+}
@@ -840,58 +840,14 @@ bool FAN_Hash::readFromString (char *line, int decode)
 bool FAN_Hash::readFromFileStream (int FH, int decode, bool file)
 {
         FAN_ENTER;	
-	char 	*pline = m_line;
-
-	char    *append = "%s%s"; 
-	char 	*total  = strdup(append);
-
-	int len;
-	int glen = 0;
-
-	bool end = false;
-
-  	m_line[0] = '\0';
-
-        while(!end)
-        {
-		len=FAN_readall(pline, MAXLINE - 1, FH);
-		
-
-		if(len < 0)
-		{
-			FAN_RETURN false;
-		}
-
-		glen += len;
-
-		
-		if(len > 0)
-		{	
-			char *p = total;
-			asprintf(&total, total, pline, append);
-			free(p);
-		}else // if(file)
-		{
-			end = true;
-		}
-
-		if(glen >= 9)
-		{
-			char *last = (total+glen-9);
-			if(strstr(last, "\nEOF\n") != NULL)
-			{
-				end = true;
-			}
-		}
-
-		m_line[0] = '\0';
+	FAN_LineReader reader(FH, MAXLINE);
 
+	char *total = reader.areadUntil("\nEOF\n");
+	if(total == NULL)
+	{
+		FAN_RETURN false;
 	}
 
-	char *p = total;
-	asprintf(&total, total, pline, "");
-	free(p);
-
 	bool ret = readFromString(total, decode);
 	free(total);
 	FAN_RETURN ret;
@@ -900,58 +856,14 @@ bool FAN_Hash::readFromFileStream (int FH, int decode, bool file)
 bool FAN_Hash::readFromStream (int FH, int decode, bool file)
 {
         FAN_ENTER;	
-	char 	*pline = m_line;
-
-	char    *append = "%s%s"; 
-	char 	*total  = strdup(append);
-
-	int len;
-	int glen = 0;
-
-	bool end = false;
-
-  	m_line[0] = '\0';
-
-        while(!end)
-        {
-		len=FAN_readall(pline, MAXLINE - 1, FH);
-		
-
-		if(len < 0)
-		{
-			FAN_RETURN false;
-		}
-
-		glen += len;
-
-		
-		if(len > 0)
-		{	
-			char *p = total;
-			asprintf(&total, total, pline, append);
-			free(p);
-		}else // if(file)
-		{
-			end = true;
-		}
-
-		if(glen >= 9)
-		{
-			char *last = (total+glen-9);
-			if(strstr(last, "\nEOF\n") != NULL)
-			{
-				end = true;
-			}
-		}
-
-		m_line[0] = '\0';
+	FAN_LineReader reader(FH, MAXLINE);
 
+	char *total = reader.areadUntil("\nEOF\n");
+	if(total == NULL)
+	{
+		FAN_RETURN false;
 	}
 
-	char *p = total;
-	asprintf(&total, total, pline, "");
-	free(p);
-
 	bool ret = readFromString(total, decode);
 	free(total);
 	FAN_RETURN ret;
@@ -0,0 +1,264 @@
+/*
+ * FAN - Framework for Applications in Networks
+ * Copyright (C) 2004 FreshX [dominik@freshx.de]
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+
+
+#include <sys/types.h>
+#include <sys/socket.h>
+#include "FANClasses.h"
+
+FAN_LineReader::FAN_LineReader(int fd, int size)
+{
+	this->fd = fd;
+	this->size = size > 0 ? size : 2048;
+	buf = (char*)malloc(this->size);
+	start = end = scanned = 0;
+}
+
+FAN_LineReader::~FAN_LineReader()
+{
+	free(buf);
+}
+
+int FAN_LineReader::pending()
+{
+	return end - start;
+}
+
+bool FAN_LineReader::makeRoom()
+{
+	if(end < size)
+		return true;
+
+	if(start > 0)
+	{
+		memmove(buf, buf + start, end - start);
+		end -= start;
+		scanned -= start;
+		start = 0;
+		return true;
+	}
+
+	char *p = (char*)realloc(buf, 2 * size);
+	if(p == NULL)
+	{
+		return false;
+	}
+	buf = p;
+	size *= 2;
+	return true;
+}
+
+int FAN_LineReader::fill()
+{
+	if(!makeRoom())
+		return -1;
+
+	int len;
+	while((len = ::read(fd, buf + end, size - end)) < 0 && errno == EINTR)
+		;
+
+	if(len > 0)
+		end += len;
+
+	return len;
+}
+
+bool FAN_LineReader::receive()
+{
+	if(!makeRoom())
+		return false;
+
+	/* stops at a full buffer so that one busy peer cannot starve the rest */
+	while(end < size)
+	{
+
+		int len = recv(fd, buf + end, size - end, MSG_DONTWAIT);
+		if(len > 0)
+		{
+			end += len;
+			continue;
+		}
+		if(len == 0)
+			return false;
+		if(errno == EINTR)
+			continue;
+		return errno == EAGAIN || errno == EWOULDBLOCK;
+	}
+	return true;
+}
+
+bool FAN_LineReader::hasLine()
+{
+	if(scanned < start)
+		scanned = start;
+
+	if(memchr(buf + scanned, '\n', end - scanned) != NULL)
+		return true;
+
+	scanned = end;
+	return false;
+}
+
+int FAN_LineReader::lineLength()
+{
+	if(!hasLine())
+		return 0;
+
+	char *nl = (char*)memchr(buf + start, '\n', end - start);
+	return nl - (buf + start) + 1;
+}
+
+bool FAN_LineReader::peek(unsigned char *data, int len)
+{
+	if(end - start < len)
+		return false;
+
+	memcpy(data, buf + start, len);
+	return true;
+}
+
+/*
+ * memmem is not available everywhere
+ */
+static char *FAN_findMark(char *from, int len, char *mark, int mlen)
+{
+	char *last = from + len - mlen;
+	char *p = from;
+
+	while(p <= last && (p = (char*)memchr(p, mark[0], last - p + 1)) != NULL)
+	{
+		if(memcmp(p, mark, mlen) == 0)
+			return p;
+		p++;
+	}
+	return NULL;
+}
+
+/*
+ * hands out [start, start+len) as a new string
+ */
+static char *FAN_takeString(char *from, int len)
+{
+	char *line = (char*)malloc(len + 1);
+	if(line != NULL)
+	{
+		memcpy(line, from, len);
+		line[len] = '\0';
+	}
+	return line;
+}
+
+char *FAN_LineReader::areadline()
+{
+	FAN_ENTER;
+
+	if(scanned < start)
+		scanned = start;
+
+	for(;;)
+	{
+		char *nl = (char*)memchr(buf + scanned, '\n', end - scanned);
+		if(nl != NULL)
+		{
+			int len = nl - (buf + start) + 1;
+			char *line = FAN_takeString(buf + start, len);
+
+			start += len;
+			scanned = start;
+			FAN_RETURN line;
+		}
+		scanned = end;
+
+		if(fill() <= 0)
+		{
+			FAN_RETURN NULL;
+		}
+	}
+}
+
+char *FAN_LineReader::areadUntil(char *mark)
+{
+	FAN_ENTER;
+	int mlen = strlen(mark);
+
+	if(scanned < start)
+		scanned = start;
+
+	for(;;)
+	{
+		/* the marker may straddle the end of the last search */
+		int from = scanned - (mlen - 1);
+		if(from < start)
+			from = start;
+
+		char *hit = FAN_findMark(buf + from, end - from, mark, mlen);
+		if(hit != NULL)
+		{
+			int len = hit - (buf + start) + mlen;
+			char *data = FAN_takeString(buf + start, len);
+
+			start += len;
+			scanned = start;
+			FAN_RETURN data;
+		}
+		scanned = end;
+
+		int len = fill();
+		if(len == 0)
+		{
+			char *data = FAN_takeString(buf + start, end - start);
+
+			start = scanned = end;
+			FAN_RETURN data;
+		}
+		if(len < 0)
+		{
+			FAN_RETURN NULL;
+		}
+	}
+}
+
+bool FAN_LineReader::read(unsigned char *data, int len)
+{
+	FAN_ENTER;
+	int have = end - start;
+
+	if(have > len)
+		have = len;
+
+	memcpy(data, buf + start, have);
+	start += have;
+
+	/* the rest goes straight into the caller's memory */
+	int off = have;
+	while(off < len)
+	{
+		int n = ::read(fd, data + off, len - off);
+		if(n < 0 && errno == EINTR)
+			continue;
+		if(n <= 0)
+		{
+			FAN_RETURN false;
+		}
+		off += n;
+	}
+
+	FAN_RETURN true;
+}
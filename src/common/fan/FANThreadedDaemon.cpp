@@ -27,6 +27,9 @@
 #include <pthread.h>
 #include <sched.h>
 #include <fcntl.h>
+#ifdef __LINUX__
+#include <sys/epoll.h>
+#endif
 
 /**
  * Threading structure 
@@ -113,28 +116,36 @@ void FAN_registerCleanup(void (*fkt) (int))
     FAN_RETURN;
 }
 
-void *FAN_dispatch(void *x)
+/**
+ * State of one client connection
+ */
+typedef struct {
+    int sock;
+    FAN *conf;			// per connection settings (threadFAN)
+    FAN_Hash *cmd;		// the protocol commands
+    FAN_LineReader *reader;
+    unsigned char *binaryData;	// reused by BINARYPUSH
+    int binaryDataSize;
+    int binaryParamsMaxCount;
+    void **binaryParamsArray;
+    int *binaryParamPositions;
+    FAN_ProtocolCommand *push;	// the command a running BINARYPUSH feeds
+    char *pushCommand;
+    bool closing;		// closed once the queued output is sent
+} FAN_Session;
+
+static FAN_Session *FAN_openSession(int s, FAN_Hash *cmd)
 {
     FAN_ENTER;
+    FAN_Session *ses = new FAN_Session;
 
-    char *buf, *pcmd, **params;
-    int size, s;
-    void **list;
-    FAN_Hash *hash;
-    FAN_Child *child = (FAN_Child *) x;
-    FAN_Hash *cmd;
-    char *value;
-    pthread_t thread = pthread_self();
-    FAN *conf = new FAN(FAN::app);
-
-    s = child->sock;
-    cmd = (FAN_Hash *) child->ptr;
-
-    pthread_setspecific(FAN::app->threadFAN, (void *) conf);
+    ses->sock = s;
+    ses->cmd = cmd;
+    ses->conf = new FAN(FAN::app);
 
     FAN_swrite(s, "#FANSH/> ");
 
-    char *cBufferSize = conf->config->getValue("bufferSize");
+    char *cBufferSize = ses->conf->config->getValue("bufferSize");
 
     int bufferSize = 0;
     if (cBufferSize != NULL) {
@@ -144,26 +155,203 @@ void *FAN_dispatch(void *x)
     if (bufferSize <= 0)
 	bufferSize = 2048;
 
-    int oldBufferSize = 0;
-    // FAN_xlog(FAN_ERROR, "before eeadline");
-    char *buffer = new char[bufferSize];
-    unsigned char *binaryData = NULL;
-    int binaryDataSize = 0;
-    int binaryParamsMaxCount = 0;
-    void **binaryParamsArray = NULL;
-    int *binaryParamPositions = NULL;
+    ses->reader = new FAN_LineReader(s, bufferSize);
+    ses->binaryData = NULL;
+    ses->binaryDataSize = 0;
+    ses->binaryParamsMaxCount = 0;
+    ses->binaryParamsArray = NULL;
+    ses->binaryParamPositions = NULL;
+    ses->push = NULL;
+    ses->pushCommand = NULL;
+    ses->closing = false;
+
+    FAN_RETURN ses;
+}
+
+static void FAN_closeSession(FAN_Session *ses)
+{
+    FAN_ENTER;
+    int s = ses->sock;
+
+    ZAP_ARRAY(ses->binaryData);
+    ZAP_ARRAY(ses->binaryParamsArray);
+    ZAP_ARRAY(ses->binaryParamPositions);
+    if (ses->pushCommand != NULL)
+	free(ses->pushCommand);
+    if (ses->conf->sendBuffer != NULL)
+	FAN_freeSendBuffer(ses->conf->sendBuffer);
+
+    ZAP(ses->conf);
+    ZAP(ses->reader);
+    ZAP(ses);
+
+    FAN_xlog(FAN_DEBUG | FAN_SOCKET, "Closing client socket %d", s);
+    shutdown(s, SHUT_RDWR);
+    close(s);
+    FAN_RETURN;
+}
+
+/*
+ * The size of the binary data following a BINARYPUSH template line.
+ */
+static long FAN_pushSize(char *templ)
+{
+    char *types = templ;
+    char *txt;
+    int asize;
+    long size = 0;
+
+    int count = FAN_getParamCount(templ);
+    for (int i = 0; i < count; i++) {
+	asize = 1;
+	int type = FAN_getNextType(&types, &txt, &asize);
+	size += (long) FAN_getParamSize(txt, type == FAN_STRUCT) * asize;
+    }
+    return size;
+}
+
+/*
+ * Reads one template line of a running BINARYPUSH with its data and hands
+ * them to the command, or the empty line which ends the push.
+ *
+ * @return false if the connection is to be closed
+ */
+static bool FAN_pushData(FAN_Session *ses)
+{
+    FAN_ENTER;
+    FAN_LineReader *reader = ses->reader;
+    char *txt = NULL;
+    int asize = 0;
+    int type;
+
+    char *templ = reader->areadline();
+    if (templ == NULL) {
+	FAN_RETURN false;
+    }
+
+    if (strlen(templ) <= 1) {
+	free(templ);
+	free(ses->pushCommand);
+	ses->pushCommand = NULL;
+	ses->push = NULL;
+	FAN_RETURN FAN_swrite(ses->sock, "\n") >= 0;
+    }
+
+    FAN_clearCR(templ);
+
+    int count = FAN_getParamCount(templ);
+    char *types = templ;
+
+    if (ses->binaryParamsArray == NULL) {
+	ses->binaryParamsArray = new void *[count + 2];
+	ses->binaryParamPositions = new int[count + 1];
+	ses->binaryParamsMaxCount = count;
+    } else if (count > ses->binaryParamsMaxCount) {
+	ZAP_ARRAY(ses->binaryParamsArray);
+	ZAP_ARRAY(ses->binaryParamPositions);
+	ses->binaryParamsArray = new void *[count + 2];
+	ses->binaryParamPositions = new int[count + 1];
+	ses->binaryParamsMaxCount = count;
+    }
+
+    void **binaryParamsArray = ses->binaryParamsArray;
+    int *binaryParamPositions = ses->binaryParamPositions;
+
+    binaryParamsArray[0] = (void *) (long) count;
+
+    int tsize = 0;
+
+    int i = 0;
+    for (; i < count; i++) {
+	type = FAN_getNextType(&types, &txt, &asize);
+	int size = FAN_getParamSize(txt, type == FAN_STRUCT) * asize;
+	binaryParamPositions[i] = tsize;
+	tsize += size;
+    }
+    binaryParamPositions[i] = tsize;
+
+    if (ses->binaryData == NULL) {
+	ses->binaryData = new unsigned char[tsize];
+	ses->binaryDataSize = tsize;
+    } else if (tsize > ses->binaryDataSize) {
+	ZAP_ARRAY(ses->binaryData);
+	ses->binaryData = new unsigned char[tsize];
+	ses->binaryDataSize = tsize;
+    }
+
+    unsigned char *binaryData = ses->binaryData;
+
+    bool ok = FAN_binaryrecv(reader, templ, tsize, (unsigned char *) binaryData);
+    if (ok) {
+	for (i = 0; i < count; i++) {
+	    if (binaryParamPositions[i + 1] - binaryParamPositions[i] > 0 && binaryData != NULL)
+		binaryParamsArray[i + 1] = binaryData + binaryParamPositions[i];
+	    else
+		binaryParamsArray[i + 1] = NULL;
+	}
+
+	FAN_xlog(FAN_DEBUG | FAN_SOCKET, "processing command : %s as thread 0x%x", ses->pushCommand, FAN_getThreadId());
+	FAN_xlog(FAN_DEBUG | FAN_INTERNAL, "Before %s()", ses->pushCommand);
+	ses->push->fkt(NULL, (char **) binaryParamsArray);
+	FAN_xlog(FAN_DEBUG | FAN_INTERNAL, "After %s()", ses->pushCommand);
+    }
+
+    free(templ);
+    FAN_RETURN ok;
+}
+
+/*
+ * Reads and executes one command of the connection. The threadFAN key
+ * must point to the session's conf.
+ *
+ * @return false if the connection is to be closed
+ */
+static bool FAN_dispatchCommand(FAN_Session *ses)
+{
+    FAN_ENTER;
+
+    char *buf, *pcmd, **params;
+    int size;
+    void **list;
+    FAN_Hash *hash;
+    char *value;
+    int s = ses->sock;
+    FAN *conf = ses->conf;
+    FAN_Hash *cmd = ses->cmd;
+    FAN_LineReader *reader = ses->reader;
+
+    if (ses->push != NULL) {
+	FAN_RETURN FAN_pushData(ses);
+    }
 
+    // a command switching the mode is still answered in the old one
+    bool framed = conf->binaryFrames;
+    int id = 0;
 
-    while (FAN::app != NULL && FAN::app->theDaemon->running() && (buf = FAN_areadline(s, false, bufferSize, buffer)) != NULL && FAN::app != NULL) {
+    if (framed) {
+	int frameSize = 0;
+	if ((buf = (char *) FAN_arecvFrame(reader, &frameSize)) == NULL) {
+	    FAN_RETURN false;
+	}
+	if (!FAN_parseFrame((unsigned char *) buf, frameSize, &pcmd, &params, &id)) {
+	    FAN_xlog(FAN_ERROR | FAN_SOCKET, "malformed frame on socket %d", s);
+	    free(buf);
+	    FAN_RETURN false;
+	}
+    } else {
+	if ((buf = reader->areadline()) == NULL) {
+	    FAN_RETURN false;
+	}
 	FAN_parseCmd(buf, &pcmd, &params);
+    }
 
-	if (strcasecmp(pcmd, "BINARYPUSH") == 0) {
-	    char *fkt = NULL;
-	    char *templ = NULL;
-	    char *txt = NULL;
-	    int asize = 0;
-	    FAN_aGetParam(params, &fkt, 0);
+    if (strcasecmp(pcmd, "BINARYPUSH") == 0) {
+	char *fkt = NULL;
+	FAN_aGetParam(params, &fkt, 0);
 
+	if (framed) {
+	    FAN_sendReplyFrame(s, "TRUE", NULL, id);
+	} else {
 	    FAN_swrite(s, "RETURN");
 	    FAN_swrite(s, "=\"");
 	    if (conf->clearText) {
@@ -175,87 +363,36 @@ void *FAN_dispatch(void *x)
 	    }
 	    FAN_swrite(s, "\"\n");
 	    FAN_swrite(s, "EOF\n");
+	}
 
-	    char *command = NULL;
-
-	    if (conf->use != NULL) {
-		asprintf(&command, "%s::%s", conf->use, fkt);
-	    } else {
-		command = strdup(fkt);
-	    }
-
-	    FAN_ProtocolCommand *theCmd = (FAN_ProtocolCommand *) cmd->getPointer(command);
-
-	    ZAP_ARRAY(params);
-	    free(buf);
-
-	    if (theCmd != NULL && theCmd->available) {
-		while ((templ = FAN_arecvlineC(s, false, bufferSize, buffer)) != NULL && strlen(templ) > 1) {
-		    // FAN_swrite(s,"OK\n");
-		    int type;
-
-		    int count = FAN_getParamCount(templ);
-		    char *types = templ;
-
-		    if (binaryParamsArray == NULL) {
-			binaryParamsArray = new void *[count + 2];
-			binaryParamPositions = new int[count + 1];
-			binaryParamsMaxCount = count;
-		    } else if (count > binaryParamsMaxCount) {
-			ZAP_ARRAY(binaryParamsArray);
-			ZAP_ARRAY(binaryParamPositions);
-			binaryParamsArray = new void *[count + 2];
-			binaryParamPositions = new int[count + 1];
-			binaryParamsMaxCount = count;
-		    }
+	char *command = NULL;
 
-		    binaryParamsArray[0] = (void *) count;
+	if (conf->use != NULL) {
+	    asprintf(&command, "%s::%s", conf->use, fkt);
+	} else {
+	    command = strdup(fkt);
+	}
 
-		    int tsize = 0;
+	FAN_ProtocolCommand *theCmd = (FAN_ProtocolCommand *) cmd->getPointer(command);
 
-		    int i = 0;
-		    for (; i < count; i++) {
-			type = FAN_getNextType(&types, &txt, &asize);
-			int size = FAN_getParamSize(txt, type == FAN_STRUCT) * asize;
-			binaryParamPositions[i] = tsize;
-			tsize += size;
-		    }
-		    binaryParamPositions[i] = tsize;
-
-		    if (binaryData == NULL) {
-			binaryData = new unsigned char[tsize];
-			binaryDataSize = tsize;
-		    } else if (tsize > binaryDataSize) {
-			ZAP_ARRAY(binaryData);
-			binaryData = new unsigned char[tsize];
-			binaryDataSize = tsize;
-		    }
+	ZAP_ARRAY(params);
+	free(buf);
 
-		    if (FAN_binaryrecv(s, templ, tsize, (unsigned char *) binaryData)) {
-			for (i = 0; i < count; i++) {
-			    if (binaryParamPositions[i + 1] - binaryParamPositions[i] > 0 && binaryData != NULL)
-				binaryParamsArray[i + 1] = binaryData + binaryParamPositions[i];
-			    else
-				binaryParamsArray[i + 1] = NULL;
-			}
-
-			FAN_xlog(FAN_DEBUG | FAN_SOCKET, "processing command : %s as thread 0x%x", command, FAN_getThreadId());
-			FAN_xlog(FAN_DEBUG | FAN_INTERNAL, "Before %s()", fkt);
-			theCmd->fkt(NULL, (char **) binaryParamsArray);
-			FAN_xlog(FAN_DEBUG | FAN_INTERNAL, "After %s()", fkt);
-		    }
-			
-		    free(templ);
-		}
-		FAN_swrite(s, "\n");
-	    }
+	// the data follows as template lines with their data, see FAN_pushData()
+	if (theCmd != NULL && theCmd->available) {
+	    ses->push = theCmd;
+	    ses->pushCommand = command;
+	} else
 	    free(command);
-	    free(fkt);
+	free(fkt);
 
-	    continue;
-	}
+	FAN_RETURN true;
+    }
 
-	if (strcasecmp(pcmd, "EXIT") == 0 || strcasecmp(pcmd, "QUIT") == 0 || strcasecmp(pcmd, ".") == 0) {
+    if (strcasecmp(pcmd, "EXIT") == 0 || strcasecmp(pcmd, "QUIT") == 0 || strcasecmp(pcmd, ".") == 0) {
+	if (framed) {
+	    FAN_sendReplyFrame(s, "TRUE", NULL, id);
+	} else {
 	    FAN_swrite(s, "RETURN");
 	    FAN_swrite(s, "=\"");
 	    if (conf->clearText) {
@@ -267,52 +404,42 @@ void *FAN_dispatch(void *x)
 	    }
 	    FAN_swrite(s, "\"\n");
 	    FAN_swrite(s, "EOF\n");
-
-	    (*FAN_cleanupFunction) ((int) thread);
-	    FAN *conf = (FAN *) pthread_getspecific(FAN::app->threadFAN);
-	    pthread_setspecific(FAN::app->threadFAN, NULL);
-
-	    ZAP_ARRAY(binaryData);
-	    ZAP_ARRAY(binaryParamsArray);
-	    ZAP_ARRAY(binaryParamPositions);
-
-	    ZAP(conf);
-	    free(buf);
-	    ZAP(child);
-	    ZAP_ARRAY(buffer);
-
-	    FAN_xlog(FAN_DEBUG | FAN_SOCKET, "Closing client socket %d", s);
-	    shutdown(s, SHUT_RDWR);
-	    close(s);
-	    FAN_TRACEBACK;
-	    pthread_exit(NULL);
 	}
 
-	char *command = NULL;
+	if (params != NULL)
+	    ZAP_ARRAY(params);
+	free(buf);
+	FAN_RETURN false;
+    }
 
-	if (conf->use != NULL) {
-	    asprintf(&command, "%s::%s", conf->use, pcmd);
-	} else {
-	    command = strdup(pcmd);
-	}
+    char *command = NULL;
 
-	FAN_ProtocolCommand *theCmd = (FAN_ProtocolCommand *) cmd->getPointer(command);
+    if (conf->use != NULL) {
+	asprintf(&command, "%s::%s", conf->use, pcmd);
+    } else {
+	command = strdup(pcmd);
+    }
 
-	if (theCmd != NULL && theCmd->available) {
-	    hash = new FAN_Hash();
+    FAN_ProtocolCommand *theCmd = (FAN_ProtocolCommand *) cmd->getPointer(command);
 
-	    FAN_xlog(FAN_DEBUG | FAN_SOCKET, "processing command : %s as thread 0x%x", command, FAN_getThreadId());
+    if (theCmd != NULL && theCmd->available) {
+	hash = new FAN_Hash();
 
-	    FAN_xlog(FAN_DEBUG | FAN_SOCKET, "Before %s()", pcmd);
-	    theCmd->fkt(hash, params);
-	    FAN_xlog(FAN_DEBUG | FAN_SOCKET, "After %s()", pcmd);
+	FAN_xlog(FAN_DEBUG | FAN_SOCKET, "processing command : %s as thread 0x%x", command, FAN_getThreadId());
 
-	    size = hash->getLength();
-	    if (size == 0) {
-		hash->insert("RETURN", "false");
-		hash->insert("RETURNMSG", "no msg");
-		size = 2;
-	    }
+	FAN_xlog(FAN_DEBUG | FAN_SOCKET, "Before %s()", pcmd);
+	theCmd->fkt(hash, params);
+	FAN_xlog(FAN_DEBUG | FAN_SOCKET, "After %s()", pcmd);
+
+	size = hash->getLength();
+	if (size == 0) {
+	    hash->insert("RETURN", "false");
+	    hash->insert("RETURNMSG", "no msg");
+	    size = 2;
+	}
+	if (framed) {
+	    FAN_sendReplyFrame(s, hash, id);
+	} else {
 	    list = (void **) malloc(size * sizeof(void *));
 	    hash->getKeys((char **) list);
 	    FAN_swrite(s, "\n");
@@ -344,57 +471,53 @@ void *FAN_dispatch(void *x)
 
 		free(prompt);
 	    }
-	    ZAP(hash);
+	}
+	ZAP(hash);
+    } else {
+	FAN_xlog(FAN_DEBUG | FAN_SOCKET, "command not understood : %s", command);
+	if (framed) {
+	    FAN_sendReplyFrame(s, "FALSE", "Command not understood", id);
 	} else {
-	    FAN_xlog(FAN_DEBUG | FAN_SOCKET, "command not understood : %s", command);
 	    FAN_swrite(s, "\nRETURNMSG=\"Command not understood\"\nRETURN=FALSE\nEOF\n");
-	    if (conf->clearText) {
-		char *prompt = NULL;
-		if (conf->use != NULL)
-		    asprintf(&prompt, "#FANSH:/%s> ", conf->use);
-		else
-		    asprintf(&prompt, "#FANSH:/> ");
-
-		FAN_swrite(s, prompt);
-		free(prompt);
-	    }
 	}
-	if (params != NULL)
-	    ZAP_ARRAY(params);
-
-	free(command);
-	free(buf);
+	if (conf->clearText && !framed) {
+	    char *prompt = NULL;
+	    if (conf->use != NULL)
+		asprintf(&prompt, "#FANSH:/%s> ", conf->use);
+	    else
+		asprintf(&prompt, "#FANSH:/> ");
+
+	    FAN_swrite(s, prompt);
+	    free(prompt);
+	}
+    }
+    if (params != NULL)
+	ZAP_ARRAY(params);
 
-	oldBufferSize = bufferSize;
-	cBufferSize = conf->config->getValue("bufferSize");
+    free(command);
+    free(buf);
+    FAN_RETURN true;
+}
 
-	if (cBufferSize != NULL) {
-	    bufferSize = atoi(cBufferSize);
-	}
+void *FAN_dispatch(void *x)
+{
+    FAN_ENTER;
 
-	if (bufferSize <= 0)
-	    bufferSize = 2048;
+    FAN_Child *child = (FAN_Child *) x;
+    pthread_t thread = pthread_self();
+    FAN_Session *ses = FAN_openSession(child->sock, (FAN_Hash *) child->ptr);
 
-	if (bufferSize != oldBufferSize) {
-	    ZAP_ARRAY(buffer);
-	    buffer = new char[bufferSize];
-	}
-	// FAN_xlog(FAN_ERROR, "before readline");
-    }
+    ZAP(child);
 
-    (*FAN_cleanupFunction) ((int) thread);
+    pthread_setspecific(FAN::app->threadFAN, (void *) ses->conf);
 
-    ZAP_ARRAY(binaryData);
-    ZAP_ARRAY(binaryParamsArray);
-    ZAP_ARRAY(binaryParamPositions);
+    while (FAN::app != NULL && FAN::app->theDaemon->running() && FAN_dispatchCommand(ses))
+	;
 
-    ZAP(conf);
-    FAN_xlog(FAN_DEBUG | FAN_SOCKET, "Closing client socket %d", s);
-    shutdown(s, SHUT_RDWR);
-    close(s);
+    (*FAN_cleanupFunction) ((int) thread);
+    pthread_setspecific(FAN::app->threadFAN, NULL);
 
-    ZAP(child);
-    ZAP_ARRAY(buffer);
+    FAN_closeSession(ses);
 
     FAN_TRACEBACK;
     pthread_exit(NULL);
@@ -403,6 +526,204 @@ void *FAN_dispatch(void *x)
     return NULL;
 }
 
+#ifdef __LINUX__
+/**
+ * The bounded worker pool of the event driven daemon
+ */
+typedef struct {
+    int epfd;
+    FAN_Com *com;		// sessions with a complete request
+} FAN_EventPool;
+
+/*
+ * Is a whole request buffered, so that it can be dispatched without
+ * waiting for the client ?
+ */
+static bool FAN_sessionReady(FAN_Session *ses)
+{
+    if (ses->push != NULL) {
+	// a template line, and all the data it announces
+	int len = ses->reader->lineLength();
+	if (len <= 1)
+	    return len == 1;
+
+	char *templ = (char *) malloc(len + 1);
+	ses->reader->peek((unsigned char *) templ, len);
+	templ[len] = '\0';
+	FAN_clearCR(templ);
+	long size = FAN_pushSize(templ);
+	free(templ);
+
+	return ses->reader->pending() >= len + size;
+    }
+    if (ses->conf->binaryFrames)
+	return FAN_hasFrame(ses->reader);
+    return ses->reader->hasLine();
+}
+
+/*
+ * Arms the socket for exactly one event, so that a session is never
+ * handled by two threads at once. A session with queued output waits
+ * for the socket to take it, before anything else is read.
+ */
+static bool FAN_watchSession(int epfd, FAN_Session *ses, int op)
+{
+    struct epoll_event ev;
+
+    ev.events = (ses->conf->sendBuffer->end > ses->conf->sendBuffer->start ? EPOLLOUT : EPOLLIN) | EPOLLONESHOT;
+    ev.data.ptr = ses;
+    return epoll_ctl(epfd, op, ses->sock, &ev) == 0;
+}
+
+static void FAN_dropSession(int epfd, FAN_Session *ses)
+{
+    epoll_ctl(epfd, EPOLL_CTL_DEL, ses->sock, NULL);
+
+    pthread_setspecific(FAN::app->threadFAN, (void *) ses->conf);
+    (*FAN_cleanupFunction) (ses->sock);
+    pthread_setspecific(FAN::app->threadFAN, NULL);
+
+    FAN_closeSession(ses);
+}
+
+static void *FAN__eventWorker(void *x)
+{
+    FAN_ENTER;
+    FAN_EventPool *pool = (FAN_EventPool *) x;
+
+    while (FAN::app != NULL) {
+	FAN_Msg *msg = FAN_peekMessage(pool->com);
+	FAN_Session *ses = (FAN_Session *) msg->value;
+	FAN_recycleMsg(pool->com, msg);
+
+	// the daemon is going down
+	if (ses == NULL)
+	    break;
+
+	pthread_setspecific(FAN::app->threadFAN, (void *) ses->conf);
+
+	// the next reply waits until the client took the last one
+	bool open = true;
+	int pending = 0;
+	while (open && pending == 0 && FAN_sessionReady(ses)) {
+	    open = FAN_dispatchCommand(ses);
+	    pending = FAN_flushSendBuffer(ses->conf->sendBuffer);
+	}
+
+	pthread_setspecific(FAN::app->threadFAN, NULL);
+
+	ses->closing = !open;
+	if (pending < 0 || (!open && pending == 0) || !FAN_watchSession(pool->epfd, ses, EPOLL_CTL_MOD))
+	    FAN_dropSession(pool->epfd, ses);
+    }
+    FAN_RETURN NULL;
+}
+
+bool FAN_ThreadedDaemon::dispatchEvents(int workers)
+{
+    FAN_ENTER;
+    struct epoll_event events[FAN_EVENTS_MAX];
+    struct sockaddr_in fsin;
+    int ssock, alen;
+
+    FAN_EventPool *pool = new FAN_EventPool;
+    pool->com = FAN_initMessages();
+
+    if ((pool->epfd = epoll_create(FAN_EVENTS_MAX)) < 0) {
+	FAN_xlog(FAN_ERROR, "epoll_create() failed (%s)", strerror(errno));
+	FAN_RETURN false;
+    }
+
+    fcntl(acceptSocket, F_SETFL, fcntl(acceptSocket, F_GETFL) | O_NONBLOCK);
+
+    struct epoll_event ev;
+    ev.events = EPOLLIN;
+    ev.data.ptr = NULL;
+    if (epoll_ctl(pool->epfd, EPOLL_CTL_ADD, acceptSocket, &ev) < 0) {
+	FAN_xlog(FAN_ERROR, "epoll_ctl() failed (%s)", strerror(errno));
+	FAN_RETURN false;
+    }
+
+    pthread_t t;
+    pthread_attr_t p_attr;
+    pthread_attr_init(&p_attr);
+    pthread_attr_setdetachstate(&p_attr, PTHREAD_CREATE_DETACHED);
+
+    for (int i = 0; i < workers; i++) {
+	if (int v = pthread_create(&t, &p_attr, &FAN__eventWorker, pool)) {
+	    FAN_xlog(FAN_ERROR, "pthread_create() failed with %d (%s)", v, strerror(errno));
+	}
+    }
+    FAN_xlog(FAN_DEBUG | FAN_SOCKET, "Dispatching events with %d workers", workers);
+
+    while (running()) {
+	int n = epoll_wait(pool->epfd, events, FAN_EVENTS_MAX, 1000);
+
+	for (int i = 0; i < n; i++) {
+	    FAN_Session *ses = (FAN_Session *) events[i].data.ptr;
+
+	    if (ses != NULL) {
+		FAN_SendBuffer *out = ses->conf->sendBuffer;
+		if (out->end > out->start) {
+		    int pending = FAN_flushSendBuffer(out);
+
+		    if (pending < 0 || (pending == 0 && ses->closing))
+			FAN_dropSession(pool->epfd, ses);
+		    else if (pending == 0 && FAN_sessionReady(ses))
+			FAN_postMessage(pool->com, "dispatch", NULL, ses);
+		    else if (!FAN_watchSession(pool->epfd, ses, EPOLL_CTL_MOD))
+			FAN_dropSession(pool->epfd, ses);
+		    continue;
+		}
+
+		// a closed connection still gets its last requests answered
+		bool open = ses->reader->receive();
+
+		if (FAN_sessionReady(ses))
+		    FAN_postMessage(pool->com, "dispatch", NULL, ses);
+		else if (!open || !FAN_watchSession(pool->epfd, ses, EPOLL_CTL_MOD))
+		    FAN_dropSession(pool->epfd, ses);
+		continue;
+	    }
+
+	    alen = sizeof(fsin);
+	    while ((ssock = accept(acceptSocket, (struct sockaddr *) &fsin, (socklen_t *) & alen)) >= 0
+		   || errno == EINTR || errno == ECONNABORTED) {
+		if (ssock < 0)
+		    continue;
+
+		FAN_xlog(FAN_DEBUG | FAN_SOCKET, "dispatching for %s (sock%d)", inet_ntoa(fsin.sin_addr), ssock);
+		FAN::app->sysStatus.connectionCounter++;
+
+		// a worker must never wait for a client: requests are only
+		// dispatched once buffered, replies the socket does not take
+		// are queued and sent from here
+		fcntl(ssock, F_SETFL, fcntl(ssock, F_GETFL) | O_NONBLOCK);
+
+		ses = FAN_openSession(ssock, (FAN_Hash *) FAN_cmd);
+		ses->conf->sendBuffer = FAN_newSendBuffer(ssock);
+		if (!FAN_watchSession(pool->epfd, ses, EPOLL_CTL_ADD))
+		    FAN_dropSession(pool->epfd, ses);
+		alen = sizeof(fsin);
+	    }
+	}
+    }
+
+    // commands still running keep their session, and the pool with it
+    for (int i = 0; i < workers; i++)
+	FAN_postMessage(pool->com, "exit", NULL, NULL);
+
+    for (int w = 0; w < 5; w++) {
+	FAN_err("Waiting for threads ...");
+	FAN_wait(1, 0);
+    }
+
+    if (FAN::app != NULL)
+	FAN::app->theDaemon = NULL;
+    FAN_RETURN true;
+}
+#endif
+
 int FAN_getBindSocket(char *listenip, int port)
 {
     FAN_ENTER;
@@ -720,6 +1041,12 @@ bool FAN_ThreadedDaemon::bindDaemon(void *(*master) (void *), void *(*worker) (v
 	    if (worker != NULL) {
 		FAN_registerWorkers(worker, count);
 	    }
+#ifdef __LINUX__
+	    int eventWorkers = atoi(FAN::app->config->getValue("eventworkers", "0"));
+	    if (eventWorkers > 0) {
+		FAN_RETURN dispatchEvents(eventWorkers);
+	    }
+#endif
 	}
 
 	FAN_xlog(FAN_DEBUG | FAN_SOCKET, "Waiting for connection");
@@ -30,6 +30,7 @@
 #include <netinet/in.h>
 #include <netdb.h>
 #include <sys/types.h>
+#include <limits.h>
 #include "FANClasses.h"
 
 void *FAN_getApp()
@@ -245,6 +246,94 @@ unsigned char *FAN_aBase642Bin(char *fmt, char *arg, char *re)
 	FAN_RETURN binary;
 }
 
+#ifdef IOV_MAX
+#define FAN_IOV_MAX IOV_MAX
+#else
+#define FAN_IOV_MAX 16
+#endif
+
+/*
+ * sends the whole list, going on after partial writes; the list is
+ * used up on the way
+ */
+static int FAN_sendv(int sd, struct iovec *iov, int count)
+{
+	int total = 0;
+	struct msghdr msg;
+
+	memset(&msg, 0, sizeof(msg));
+
+	while(count > 0)
+	{
+		msg.msg_iov = iov;
+		msg.msg_iovlen = count < FAN_IOV_MAX ? count : FAN_IOV_MAX;
+
+		int len = sendmsg(sd, &msg, 0);
+		if(len < 0 && errno == EINTR)
+			continue;
+		if(len <= 0)
+			return -1;
+		total += len;
+
+		while(count > 0 && len >= (int)iov->iov_len)
+		{
+			len -= iov->iov_len;
+			iov++;
+			count--;
+		}
+		if(count > 0)
+		{
+			iov->iov_base = (char*)iov->iov_base + len;
+			iov->iov_len -= len;
+		}
+	}
+	return total;
+}
+
+int FAN_binaryPushv(int sd, char *fmt, struct iovec *iov, int count)
+{
+	FAN_ENTER;
+	int i, type, asize;
+	char *types = fmt;
+	char *txt;
+	int size = 0;
+
+	int params = FAN_getParamCount(fmt);
+	if(count != params)
+	{
+		FAN_xlog(FAN_ERROR, "binaryPushv: %d buffers for the %d parameters of %s", count, params, fmt);
+		FAN_RETURN 0;
+	}
+
+	/* the server splits the data by the template alone */
+	for(i=0; i<params; i++)
+	{
+		asize = 1;
+		type = FAN_getNextType(&types, &txt, &asize);
+
+		int want = FAN_getParamSize(txt, type == FAN_STRUCT) * asize;
+		if((int)iov[i].iov_len != want)
+		{
+			FAN_xlog(FAN_ERROR, "binaryPushv: parameter %d of %s has %d bytes instead of %d", i, fmt, (int)iov[i].iov_len, want);
+			FAN_RETURN 0;
+		}
+		size += want;
+	}
+
+	struct iovec *all = new struct iovec[count + 2];
+	all[0].iov_base = fmt;
+	all[0].iov_len = strlen(fmt);
+	all[1].iov_base = (void*)"\n";
+	all[1].iov_len = 1;
+	memcpy(all + 2, iov, count * sizeof(struct iovec));
+
+	FAN_xlog(FAN_DEBUG | FAN_INTERNAL, "binaryPushv SIZE: %d", size);
+	int err = FAN_sendv(sd, all, count + 2);
+	delete[] all;
+
+	FAN_RETURN err;
+}
+
 int FAN_vbinaryPush(int sd, char *fmt, va_list argument)
 {
         FAN_ENTER;
@@ -252,25 +341,14 @@ int FAN_vbinaryPush(int sd, char *fmt, va_list argument)
         int i, type, size;
 	char *types;
 	char *txt;
-	int err = 0;
 
 	types = fmt;
 
 	int params = FAN_getParamCount(fmt);
+	int count = 0;
+	struct iovec *iov = new struct iovec[params + 1];
+	FAN_Scalar *scalars = new FAN_Scalar[params + 1];
 
-	FAN_swrite(sd, fmt);
-	FAN_swrite(sd, "\n");
-
-	/*
-	int len = 0;
-	int t_len = 0;
-	char buf[3];
-	while((len = read(sd, buf, 3-len)) > 0) t_len += len;
-	if(len < 0 || t_len < 3)
-	{
-		return 0;
-	}
-	*/
 	int asize;
 	
         for(i=0; i<params; i++)
@@ -284,28 +362,19 @@ int FAN_vbinaryPush(int sd, char *fmt, va_list argument)
                                                 arg = (unsigned char*)va_arg(argument, int*);
                                          else
                                          {
-                                                int t = va_arg(argument, int);
-                                                arg = (unsigned char*)&t;
+                                                scalars[i].i = va_arg(argument, int);
+                                                arg = (unsigned char*)&scalars[i].i;
                                          }
 
                                          size = sizeof(int) * asize;
                                          break;
-                        case FAN_FLOAT:  if(asize > 1)
-                                                 arg = (unsigned char*)va_arg(argument, double*);
-                                         else
-                                         {
-                                                 double t = va_arg(argument, double);
-                                                 arg = (unsigned char*)&t;
-                                         }
-
-                                         size = sizeof(double) * asize;
-                                         break;
+                        case FAN_FLOAT:
                         case FAN_DOUBLE: if(asize > 1)
                                                  arg = (unsigned char*)va_arg(argument, double*);
                                          else
                                          {
-                                                 double t = va_arg(argument, double);
-                                                 arg = (unsigned char*)&t;
+                                                 scalars[i].d = va_arg(argument, double);
+                                                 arg = (unsigned char*)&scalars[i].d;
                                          }
                                          size = sizeof(double) * asize;
                                          break;
@@ -313,8 +382,8 @@ int FAN_vbinaryPush(int sd, char *fmt, va_list argument)
                                                  arg = (unsigned char*)va_arg(argument, unsigned char*);
                                          else
                                          {
-					         unsigned char t = va_arg(argument, int); // --OM: unsigned gets auto-promoted to int
-                                                 arg = (unsigned char*)&t;
+					         scalars[i].b = va_arg(argument, int); // --OM: unsigned gets auto-promoted to int
+                                                 arg = &scalars[i].b;
                                          }
                                          size = sizeof(unsigned char) * asize;
                                          break;
@@ -322,8 +391,8 @@ int FAN_vbinaryPush(int sd, char *fmt, va_list argument)
                                                  arg = (unsigned char*)va_arg(argument, char*);
                                          else
                                          {
-                                                 char t = va_arg(argument, int); // --OM: unsigned gets auto-promoted to int
-                                                 arg = (unsigned char*)&t;
+                                                 scalars[i].c = va_arg(argument, int); // --OM: unsigned gets auto-promoted to int
+                                                 arg = (unsigned char*)&scalars[i].c;
                                          }
                                          size = sizeof(char) * asize;
                                          break;
@@ -334,8 +403,8 @@ int FAN_vbinaryPush(int sd, char *fmt, va_list argument)
                                                  arg = (unsigned char*)va_arg(argument, long*);
                                          else
                                          {
-                                                 long t = va_arg(argument, long);
-                                                 arg = (unsigned char*)&t;
+                                                 scalars[i].l = va_arg(argument, long);
+                                                 arg = (unsigned char*)&scalars[i].l;
                                          }
                                          size = sizeof(long) * asize;
                                          break;
@@ -343,13 +412,16 @@ int FAN_vbinaryPush(int sd, char *fmt, va_list argument)
 					 size = 0;
 					 break;
 		}
-                if(arg != NULL)
-                {
-			FAN_xlog(FAN_DEBUG | FAN_INTERNAL, "vbinaryPush SIZE: %d", size);
-                        err = err < 0 ? err : FAN_swrite(sd, arg, size);
-                }
+		/* a NULL array, e.g. {double}[0], still holds its place */
+		iov[count].iov_base = arg;
+		iov[count++].iov_len = arg != NULL ? size : 0;
         }
 
+	int err = FAN_binaryPushv(sd, fmt, iov, count);
+
+	delete[] iov;
+	delete[] scalars;
+
         FAN_RETURN err;
 }
 
@@ -858,7 +930,10 @@ bool FAN_aGetBinaryParam(char **allParams, void **param, int pos)
 			char *types = NULL;
 			char *txt = NULL;
 			int type = 0;
-			FAN_Base64::adecode64(*(allParams+1), &templ);
+			if(conf->binaryFrames)
+				templ = strdup(*(allParams+1));
+			else
+				FAN_Base64::adecode64(*(allParams+1), &templ);
 			types = templ;
 
 			if(templ == NULL)
@@ -892,7 +967,14 @@ bool FAN_aGetBinaryParam(char **allParams, void **param, int pos)
 			else
 				size = FAN_getParamSize(txt, false);
 
-			*param = FAN_decode(*(allParams+pos+1), size);
+			if(conf->binaryFrames)
+			{
+				/* FAN_parseFrame has checked the size of the argument */
+				*param = malloc(size);
+				if(*param != NULL)
+					memcpy(*param, *(allParams+pos+1), type == FAN_CHAR && asize > 1 ? size - 1 : size);
+			}else
+				*param = FAN_decode(*(allParams+pos+1), size);
 			
 			if(asize > 1 && type == FAN_CHAR)
 			{
@@ -957,7 +1039,7 @@ bool FAN_aGetParam(char **allParams, char **param, int pos)
 
                 if(conf != NULL)
                 {
-                        if(conf->clearText)
+                        if(conf->clearText || conf->binaryFrames)
                         {
                                 *param = strdup((char*)*(allParams+pos+1));
                         }else
@@ -1127,6 +1209,24 @@ int FAN_recvall(char *line, int size, int FH)
 
 
 
+/*
+ * the data was sent in the byte order of the peer
+ */
+static void FAN_reverseRemote(char *templ, unsigned char *buffer)
+{
+	FAN *conf = (FAN*)pthread_getspecific(FAN::app->threadFAN);
+
+	if(conf != NULL)
+	{
+		char *le = conf->config->getValue("endian");
+		char *re = conf->config->getValue("remoteEndian");
+		if(le != NULL && re != NULL && strcmp(le, re) != 0)
+		{
+			FAN_reverseByteOrder(buffer, templ, true);
+		}
+	}
+}
+
 bool FAN_binaryrecv(int FH, char *templ, int size, unsigned char* buffer)
 {
 	FAN_ENTER;
@@ -1141,19 +1241,22 @@ bool FAN_binaryrecv(int FH, char *templ, int size, unsigned char* buffer)
         FAN_RETURN false;
     }
 
-    pthread_t thread = pthread_self();
-    if(thread > 0)
-    {
-      	FAN *conf = (FAN*)pthread_getspecific(FAN::app->threadFAN);
-	
-		char *le = conf->config->getValue("endian");
-		char *re = conf->config->getValue("remoteEndian");
-		if(le != NULL && re != NULL && strcmp(le, re) != 0)
-		{
-			FAN_reverseByteOrder((unsigned char*)buffer, templ, true);
-		}
+	FAN_reverseRemote(templ, buffer);
+
+	FAN_RETURN true;
+}
+
+bool FAN_binaryrecv(FAN_LineReader *reader, char *templ, int size, unsigned char* buffer)
+{
+	FAN_ENTER;
+
+	if(!reader->read(buffer, size))
+	{
+		FAN_RETURN false;
 	}
 
+	FAN_reverseRemote(templ, buffer);
+
 	FAN_RETURN true;
 }
 
@@ -1164,193 +1267,194 @@ char *FAN_arecvlineC(int FH, bool file, int bufferSize, char* buffer)
 	int len = 0;
 	int off = 0;
 
-	while((len = recv(FH, (buffer+off), 1, 0)) == -1
-	    || (buffer[off+len-1] != '\n' && len + off < SIZE - 2)) {
-          if(len > 0)
-	     off += len;
-	}
-
-	if(buffer[off] == '\n')
+	/*
+	 * binary data may follow the line, so look at what has arrived and
+	 * only take the bytes up to the newline off the socket
+	 */
+	while(off < SIZE - 2)
 	{
-		buffer[off+1] = '\0';
-		char *total = NULL;
-		asprintf(&total, "%s", buffer);
-		FAN_RETURN total;
+		len = recv(FH, buffer + off, SIZE - 2 - off, MSG_PEEK);
+		if(len < 0 && errno == EINTR)
+			continue;
+		if(len <= 0)
+			break;
+
+		char *nl = (char*)memchr(buffer + off, '\n', len);
+		int take = nl != NULL ? nl - (buffer + off) + 1 : len;
+
+		while((len = recv(FH, buffer + off, take, MSG_WAITALL)) < 0 && errno == EINTR)
+			;
+		if(len < take)
+			break;
+		off += take;
+
+		if(nl != NULL)
+		{
+			buffer[off] = '\0';
+			FAN_RETURN strdup(buffer);
+		}
 	}
 
 	FAN_RETURN NULL;
 }
 
-char *FAN_arecvline(int FH, bool file, int bufferSize, char* buffer)
+/*
+ * collects chunks until one of them contains a newline, growing the
+ * result instead of reformatting it on every chunk
+ */
+static char *FAN_areadchunks(int FH, int bufferSize, int (*readChunk)(char*, int, int))
 {
-	FAN_ENTER;
-	int 	SIZE = bufferSize;
-	char    *line = buffer;
-    char    *pline = line;
-
-    char    *append = "%s%s";
-    char    *total  = strdup(append);
-	
-	int size = SIZE;
-    int len;
-    int glen = 0;
+	int size = bufferSize > 16 ? bufferSize : 2048;
+	char *total = (char*)malloc(size);
+	int glen = 0;
 
-    bool end = false;
-    bool error = false;
+	while(total != NULL)
+	{
+		if(size - glen < 2)
+		{
+			char *p = (char*)realloc(total, 2 * size);
+			if(p == NULL)
+				break;
+			total = p;
+			size *= 2;
+		}
 
-	line[0] = '\0';
+		int len = readChunk(total + glen, size - 1 - glen, FH);
+		if(len <= 0)
+			break;
 
-    while(!end)
-    {
-//		FAN_xlog(FAN_ERROR, "before readall");
-        len=FAN_recvall(pline, size - 1, FH);
-//		FAN_xlog(FAN_ERROR, "after readall (%d)", len);
+		char *nl = (char*)memchr(total + glen, '\n', len);
+		glen += len;
 
-		if(len == -1)
+		if(nl != NULL)
 		{
-			FAN_RETURN NULL;
+			total[glen] = '\0';
+			return total;
 		}
-		pline += len;
-		size -= len;
-        glen += len;
-
-//		FAN_xlog(FAN_ERROR, "glen: %d", glen);
-        if(pline - line > SIZE-5)
-        {
-            char *p = total;
-            asprintf(&total, total, line, append);
-            free(p);
-			size  = SIZE;
-			pline = line;
-			line[0] = '\0';
-        }
-
-        if(pline - line >= 5)
-        {
-            char *last = (pline-5);
-            if(strstr(last, "\n") != NULL)
-            {
-                end = true;
-				error = false;
-            }
-        }
-    }
-	if(pline != line)
-	{
-        char *p = total;
-        asprintf(&total, total, line, append);
-        free(p);
 	}
 
-    char *p = total;
-	asprintf(&total, total, "", "");
-	free(p);
-//	free(line);
-
-	if(glen > 0 && !error)
-	{
-		FAN_RETURN total;
-	}
-	else
-	{
-		if(total != NULL) free(total);
-		FAN_RETURN NULL;
-	}
+	free(total);
+	return NULL;
 }
 
-
+char *FAN_arecvline(int FH, bool file, int bufferSize, char* buffer)
+{
+	FAN_ENTER;
+	FAN_RETURN FAN_areadchunks(FH, bufferSize, &FAN_recvall);
+}
 
 char *FAN_areadline(int FH, bool file, int bufferSize, char* buffer)
 {
 	FAN_ENTER;
-	int 	SIZE = bufferSize;
-	char    *line = buffer;
-    char    *pline = line;
-
-    char    *append = "%s%s";
-    char    *total  = strdup(append);
-	
-	int size = SIZE;
-    int len;
-    int glen = 0;
+	FAN_RETURN FAN_areadchunks(FH, bufferSize, &FAN_readall);
+}
 
-    bool end = false;
-	bool error = false;
+int FAN_swrite(int s,char *txt) {
+//	FAN_xlog(FAN_DEBUG|FAN_NOCR|FAN_QUIET|FAN_SOCKET,txt);
+        return FAN_swrite(s, (unsigned char *)txt, strlen(txt));
+}
 
-	line[0] = '\0';
+/*
+ * Writes what the socket takes without waiting and queues the rest
+ * behind any output still pending.
+ */
+static int FAN_bufferedWrite(FAN_SendBuffer *out, unsigned char *data, int size)
+{
+	int off = 0;
 
-        while(!end)
-        {
-//		FAN_xlog(FAN_ERROR, "before readall");
-            len=FAN_readall(pline, size - 1, FH);
-//		FAN_xlog(FAN_ERROR, "after readall (%d)", len);
+	if(out->failed || FAN_flushSendBuffer(out) < 0)
+		return -1;
 
-		if(len == -1)
+	while(out->start == out->end && off < size)
+	{
+		int len = send(out->sock, data + off, size - off, 0);
+		if(len < 0 && errno == EINTR)
+			continue;
+		if(len < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+			break;
+		if(len <= 0)
 		{
-			FAN_RETURN NULL;
+			out->failed = true;
+			return -1;
 		}
-		pline += len;
-		size -= len;
-        glen += len;
-
-//		FAN_xlog(FAN_ERROR, "glen: %d", glen);
-        if(pline - line > SIZE-5)
-        {
-            char *p = total;
-            asprintf(&total, total, line, append);
-            free(p);
-			size  = SIZE;
-			pline = line;
-			line[0] = '\0';
-        }else if(len == 0)
-        {
-            end = true;
-			error = true;
-        }
+		off += len;
+	}
+	if(off == size)
+		return size;
 
-        if(pline - line >= 5)
-        {
-            char *last = (pline-5);
-            if(strstr(last, "\n") != NULL)
-            {
-                end = true;
-	            error = false;
-            }
-        }
-    }
-	if(pline != line)
+	int rest = size - off;
+	if(out->end + rest > out->size)
 	{
-        char *p = total;
-        asprintf(&total, total, line, append);
-        free(p);
+		memmove(out->data, out->data + out->start, out->end - out->start);
+		out->end -= out->start;
+		out->start = 0;
 	}
-
-    char *p = total;
-	asprintf(&total, total, "", "");
-	free(p);
-//	free(line);
-
-	if(glen > 0 && !error)
+	if(out->end + rest > out->size)
 	{
-		FAN_RETURN total;
+		out->size = out->end + rest > 2 * out->size ? out->end + rest : 2 * out->size;
+		out->data = (unsigned char*)realloc(out->data, out->size);
 	}
-	else
+	memcpy(out->data + out->end, data + off, rest);
+	out->end += rest;
+	return size;
+}
+
+int FAN_swrite(int s,unsigned char *data, int size) {
+	FAN *conf = FAN::app != NULL ? (FAN*)pthread_getspecific(FAN::app->threadFAN) : NULL;
+
+	if(conf != NULL && conf->sendBuffer != NULL && conf->sendBuffer->sock == s)
+		return FAN_bufferedWrite(conf->sendBuffer, data, size);
+
+	int off = 0;
+	while(off < size)
 	{
-		if(total != NULL) free(total);
-		FAN_RETURN NULL;
+		int len = send(s, data + off, size - off, 0);
+		if(len < 0 && errno == EINTR)
+			continue;
+		if(len <= 0)
+			return -1;
+		off += len;
 	}
+	return off;
 }
 
-int FAN_swrite(int s,char *txt) {
-//	FAN_xlog(FAN_DEBUG|FAN_NOCR|FAN_QUIET|FAN_SOCKET,txt);
-        return FAN_swrite(s, (unsigned char *)txt, strlen(txt));
+FAN_SendBuffer *FAN_newSendBuffer(int sock)
+{
+	FAN_SendBuffer *out = new FAN_SendBuffer;
+
+	out->sock = sock;
+	out->data = NULL;
+	out->start = 0;
+	out->end = 0;
+	out->size = 0;
+	out->failed = false;
+	return out;
 }
 
-int FAN_swrite(int s,unsigned char *data, int size) {
-	int len = 0;
+void FAN_freeSendBuffer(FAN_SendBuffer *out)
+{
+	if(out->data != NULL)
+		free(out->data);
+	delete out;
+}
 
-	len = send(s,data,size, MSG_WAITALL);
-	return len;
+int FAN_flushSendBuffer(FAN_SendBuffer *out)
+{
+	while(!out->failed && out->start < out->end)
+	{
+		int len = send(out->sock, out->data + out->start, out->end - out->start, 0);
+		if(len < 0 && errno == EINTR)
+			continue;
+		if(len < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+			break;
+		if(len <= 0)
+			out->failed = true;
+		else
+			out->start += len;
+	}
+	if(out->start == out->end)
+		out->start = out->end = 0;
+	return out->failed ? -1 : out->end - out->start;
 }
 
 int FAN_clearCR(char *buf)
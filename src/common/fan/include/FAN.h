@@ -309,6 +309,16 @@ class FAN
 	 */
 	int clearText;
 
+	/**
+	 * Requests and replies are sent as binary frames (see FANFrame.h)
+	 */
+	int binaryFrames;
+
+	/**
+	 * Queued output of a non-blocking connection, NULL when writes block
+	 */
+	struct FAN_SendBuffer *sendBuffer;
+
 	/**
 	 * The current namespace 
 	 */
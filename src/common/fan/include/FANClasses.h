@@ -35,7 +35,9 @@ using namespace std;
 #include <stdarg.h>
 #include <unistd.h>
 #include <pthread.h>
+#include <sys/uio.h>
 
+#include "FANLineReader.h"
 #include "FANUtils.h"
 #include "FAN.h"
 #include "FANBase64.h"
@@ -44,6 +46,7 @@ using namespace std;
 #include "FANHash.h"
 #include "FANProtocolCommand.h"
 #include "FANConnection.h"
+#include "FANFrame.h"
 #include "FANTree.h"
 #include "FANQueue.h"
 #include "FANThreadedDaemon.h"
@@ -24,6 +24,20 @@
 
 #include "FANClasses.h"
 
+/**
+ * Number of posted calls that may wait for their replies at once
+ */
+#define FAN_RPC_WINDOW 64
+
+/**
+ * Gets the reply of a posted call.
+ *
+ * @param id Request id returned by #FAN_Connection::post
+ * @param reply Return values of the call, NULL if the connection broke first
+ * @param data Pointer given to #FAN_Connection::notify
+ */
+typedef void (*FAN_ReplyHandler)(int id, FAN_Hash *reply, void *data);
+
 /**
  * Implementation of a socket connection for remote procedure calls. 
  */
@@ -35,6 +49,61 @@ class FAN_Connection{
         char* host;
         char* service;
         char* sessionId;
+        /**
+         * Set by #connect if the server accepted sys::binary
+         */
+        bool binary;
+        /**
+         * Set by #connect if the server answers frames with request ids
+         */
+        bool tagged;
+        /**
+         * The last request id handed out
+         */
+        int lastId;
+        /**
+         * Posted calls by request id
+         */
+        FAN_Hash *calls;
+        /**
+         * Number of posted calls whose reply has not been read yet
+         */
+        int outstanding;
+        /**
+         * Number of binary pushes ended by #endBinaryPush whose
+         * acknowledgement has not been read yet
+         */
+        int pushAcks;
+
+        /**
+         * Registers a call, answered already if [reply] is given.
+         *
+         * @returns the request id
+         */
+        int addCall(FAN_Hash *reply);
+        /**
+         * Reads the next reply and hands it to its call.
+         *
+         * @param block Wait for the reply, otherwise only read one that has started to arrive
+         * @returns True if a reply was read
+         */
+        bool collect(bool block);
+        /**
+         * Reads arrived replies and waits while #FAN_RPC_WINDOW calls are in flight.
+         */
+        bool makeRoom();
+        /**
+         * Closes the socket and fails all calls still waiting for a reply.
+         */
+        void failCalls();
+        /**
+         * Reads the acknowledgements of ended binary pushes, which come
+         * before any reply.
+         *
+         * @param block wait for all of them instead of taking only those that have arrived
+         * @returns False if the connection broke
+         */
+        bool readAcks(bool block);
 
 public:
 	bool isFileSocket;
@@ -65,6 +134,7 @@ public:
 	bool connect();
 	/**
 	 * Checks for successful establishment of the socket connection.
+	 * Only looks at the socket, nothing is sent to the server.
 	 *
 	 * @returns True if a socket connection has been established and False otherwise
 	 */
@@ -152,8 +222,32 @@ public:
 	 */
 	bool rpc(char *name, char *fmt, ...);
 	bool startBinaryPush(char *fkt);
+	/**
+	 * Ends a binary push and waits for the server to acknowledge it.
+	 *
+	 * @returns False if the connection broke
+	 * @see endBinaryPush
+	 */
 	bool stopBinaryPush();
+	/**
+	 * Ends a binary push without waiting for the acknowledgement. It is
+	 * read by the next call on this connection that reads from the server.
+	 *
+	 * @returns False if the connection broke
+	 */
+	bool endBinaryPush();
 	bool binaryPush(char *fmt, ...);
+	/**
+	 * Pushes one set of arguments straight from the caller's buffers, one
+	 * per parameter of the template.
+	 *
+	 * @param fmt Binary data format template
+	 * @param iov The buffers
+	 * @param count Number of buffers
+	 * @returns True if successful and False otherwise
+	 * @see FAN_binaryPushv
+	 */
+	bool binaryPushv(char *fmt, struct iovec *iov, int count);
 	/**
 	 * Calls the remote procedure with the given name, binary data format template, and arguments
 	 * from the vector and inserts the results into the supplied hash.
@@ -178,6 +272,75 @@ public:
 	 */
 	bool rpc(FAN_Hash *hash, char *name, char *fmt, ...);
 
+	/**
+	 * Sends a call without waiting for its reply. Any number of calls can be
+	 * in flight, their replies are matched by request id in whatever order
+	 * they arrive. If the server does not support request ids the call is
+	 * answered before this returns.
+	 *
+	 * @param name Name of remote procedure
+	 * @param count Number of RPC arguments
+	 * @param argument Argument vector
+	 * @returns The request id, 0 if the call could not be sent
+	 * @see wait, notify, flush
+	 */
+	int vpost(char *name, int count, va_list argument);
+	/**
+	 * Sends a call with a variable number of arguments without waiting for its reply.
+	 *
+	 * @see vpost(char *name, int count, va_list argument)
+	 */
+	int post(char *name, int count, ...);
+	/**
+	 * Sends a call with a binary data format template without waiting for its reply.
+	 *
+	 * @param name Name of remote procedure
+	 * @param fmt Binary data format template
+	 * @param argument Argument vector
+	 * @see vpost(char *name, int count, va_list argument)
+	 */
+	int vpost(char *name, char *fmt, va_list argument);
+	/**
+	 * Sends a call with a binary data format template and a variable number of
+	 * arguments without waiting for its reply.
+	 *
+	 * @see vpost(char *name, char *fmt, va_list argument)
+	 */
+	int post(char *name, char *fmt, ...);
+	/**
+	 * Waits for the reply of a posted call and inserts it into the supplied hash.
+	 *
+	 * @param id Request id returned by #post
+	 * @param hash Result hash
+	 * @returns True if the reply was received and False otherwise
+	 */
+	bool wait(int id, FAN_Hash *hash);
+	/**
+	 * Clears the #returnHash, waits for the reply of a posted call and fills the
+	 * #returnHash with it.
+	 *
+	 * @param id Request id returned by #post
+	 * @returns True if successful and False otherwise
+	 */
+	bool wait(int id);
+	/**
+	 * Hands the reply of a posted call to a handler instead of keeping it for #wait.
+	 * The handler runs once the reply has been read, which happens in any later
+	 * call on this connection, or right away if the reply is already there.
+	 *
+	 * @param id Request id returned by #post
+	 * @param handler The handler, NULL to throw the reply away
+	 * @param data Passed on to the handler
+	 * @returns False if there is no such call
+	 */
+	bool notify(int id, FAN_ReplyHandler handler, void *data);
+	/**
+	 * Reads the replies of all posted calls.
+	 *
+	 * @returns False if the connection broke
+	 */
+	bool flush();
+
 	/**
 	 * Destructor.
 	 */
@@ -115,7 +115,8 @@ void FAN_cmdSysPing(FAN_Hash *ret, char **params);
  */
 void FAN_cmdSysEndian(FAN_Hash *ret, char **params);
 /**
- * Sets the readline buffer size (default: 1024)
+ * Sets the readline buffer size (default: 1024). Kept for compatibility,
+ * the line buffer of a connection grows on demand.
  */
 void FAN_cmdSysSetBufferSize(FAN_Hash *ret, char **params);
 /**
@@ -197,6 +198,11 @@ void FAN_cmdClearText(FAN_Hash *ret, char **params);
  * Disables cleartext
  */
 void FAN_cmdNoClearText(FAN_Hash *ret, char **params);
+/**
+ * Switches the connection to binary frames after the reply,
+ * REQUESTIDS tells the client that they may carry request ids
+ */
+void FAN_cmdSysBinary(FAN_Hash *ret, char **params);
 /**
  * Closes the connection
  */
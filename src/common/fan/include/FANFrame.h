@@ -0,0 +1,174 @@
+/*
+ * FAN - Framework for Applications in Networks
+ * Copyright (C) 2004 FreshX [dominik@freshx.de]
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+
+
+#ifndef _FAN_FRAME
+#define _FAN_FRAME
+
+/*
+ * Binary protocol mode, switched on per connection with "sys::binary".
+ *
+ * Every request and reply is one frame:
+ *
+ *   length (4 bytes, network order, counts everything after it)
+ *   kind   (1 byte, FAN_FRAME_*)
+ *   id     (4 bytes, network order, only if FAN_FRAME_TAGGED is set)
+ *   fields (each: 4 byte length in network order, then the bytes)
+ *
+ * A request carries the command name, for typed calls the template, and
+ * then the arguments. String fields include their terminating '\0',
+ * typed arguments are sent in the native byte order of the caller and
+ * reversed on the receiving side just like in the text protocol.
+ * A reply carries key/value pairs. Nothing is base64 encoded.
+ *
+ * A request with an id is answered by a reply with the same id, so a
+ * client may send many requests before it reads the replies.
+ */
+
+/** request with string arguments */
+#define FAN_FRAME_STRINGS 0x1
+/** request with a template and typed arguments */
+#define FAN_FRAME_TYPED   0x2
+/** key/value reply */
+#define FAN_FRAME_REPLY   0x3
+/** set in the kind if a request id follows */
+#define FAN_FRAME_TAGGED  0x80
+
+/** largest frame accepted from the peer */
+#define FAN_FRAME_MAXLEN  (64 * 1024 * 1024)
+
+/**
+ * Calls a remote procedure with string arguments over a connection
+ * in binary mode and reads the reply into the hash.
+ *
+ * @param hash the hash for the return values
+ * @param sd the socket
+ * @param fkt the name of the procedure
+ * @param params the number of arguments
+ * @param argument the arguments (char*)
+ * @return <0 if the socket failed, otherwise whether a reply was read
+ *
+ * @see FAN_vrpc(FAN_Hash *hash, int sd, char *fkt, int params, va_list argument)
+ */
+int FAN_vrpcFrame(FAN_Hash *hash, int sd, char *fkt, int params, va_list argument);
+/**
+ * Calls a remote procedure with typed arguments over a connection
+ * in binary mode and reads the reply into the hash.
+ *
+ * @param hash the hash for the return values
+ * @param sd the socket
+ * @param fkt the name of the procedure
+ * @param fmt the template [see #FAN_vrpc(FAN_Hash *hash,int sd,char *fkt,char *fmt, va_list argument)]
+ * @param argument the arguments
+ * @return <0 if the socket failed, otherwise whether a reply was read
+ */
+int FAN_vrpcFrame(FAN_Hash *hash, int sd, char *fkt, char *fmt, va_list argument);
+/**
+ * Sends a call with string arguments without reading the reply.
+ *
+ * @param sd the socket
+ * @param id the request id for the reply, 0 for none
+ * @param fkt the name of the procedure
+ * @param params the number of arguments
+ * @param argument the arguments (char*)
+ * @return <0 if the socket failed
+ */
+int FAN_vpostFrame(int sd, int id, char *fkt, int params, va_list argument);
+/**
+ * Sends a call with typed arguments without reading the reply.
+ *
+ * @see FAN_vpostFrame(int sd, int id, char *fkt, int params, va_list argument)
+ * @see FAN_vrpcFrame(FAN_Hash *hash, int sd, char *fkt, char *fmt, va_list argument)
+ */
+int FAN_vpostFrame(int sd, int id, char *fkt, char *fmt, va_list argument);
+
+/**
+ * Reads one frame from the socket.
+ *
+ * @param sd the socket
+ * @param size returns the size of the frame (kind and fields)
+ * @return the malloc'ed frame starting with its kind, or NULL if the
+ *         socket failed or the frame was too large
+ */
+unsigned char *FAN_arecvFrame(int sd, int *size);
+/**
+ * Reads one frame through the buffered reader of a connection.
+ *
+ * @see FAN_arecvFrame(int sd, int *size)
+ */
+unsigned char *FAN_arecvFrame(FAN_LineReader *reader, int *size);
+/**
+ * Tells whether the reader holds a complete frame, so that
+ * #FAN_arecvFrame(FAN_LineReader *reader, int *size) will not block.
+ *
+ * @param reader the buffered reader of the connection
+ * @return true if a frame, or a header that will be refused, is buffered
+ */
+bool FAN_hasFrame(FAN_LineReader *reader);
+/**
+ * Splits a request frame into the command and a parameter list laid out
+ * like the one of #FAN_parseCmd: params[0] holds the count, the
+ * following entries point into the frame.
+ *
+ * @param frame the frame read by #FAN_arecvFrame
+ * @param size the size of the frame
+ * @param cmd_pointer returns the command
+ * @param pparams returns the new[]'ed parameter list
+ * @param id returns the request id, 0 if there is none
+ * @return false if the frame is malformed
+ */
+bool FAN_parseFrame(unsigned char *frame, int size, char **cmd_pointer, char ***pparams, int *id);
+
+/**
+ * Sends the contents of the hash as a reply frame.
+ *
+ * @param sd the socket
+ * @param hash the return values
+ * @param id the request id of the call, 0 for none
+ */
+int FAN_sendReplyFrame(int sd, FAN_Hash *hash, int id);
+/**
+ * Sends a reply frame with RETURN and, if given, RETURNMSG.
+ *
+ * @param sd the socket
+ * @param ret the value of RETURN
+ * @param msg the value of RETURNMSG or NULL
+ * @param id the request id of the call, 0 for none
+ */
+int FAN_sendReplyFrame(int sd, char *ret, char *msg, int id);
+/**
+ * Reads a reply frame and inserts its key/value pairs into the hash.
+ *
+ * @param hash the hash for the return values
+ * @param sd the socket
+ * @return true if a well formed reply was read
+ */
+bool FAN_readReplyFrame(FAN_Hash *hash, int sd);
+/**
+ * Reads a reply frame, also returning the request id it answers.
+ *
+ * @param hash the hash for the return values
+ * @param sd the socket
+ * @param id returns the request id, 0 if there is none
+ * @return true if a well formed reply was read
+ */
+bool FAN_readReplyFrame(FAN_Hash *hash, int sd, int *id);
+
+#endif
@@ -0,0 +1,124 @@
+/*
+ * FAN - Framework for Applications in Networks
+ * Copyright (C) 2004 FreshX [dominik@freshx.de]
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+
+
+#ifndef _FAN_LINEREADER
+#define _FAN_LINEREADER
+
+/**
+ * Buffered reader for one socket or file. Data is received in large
+ * chunks and split into lines with memchr. Whatever follows a line stays
+ * in the buffer for the next call, so lines, binary data and frames can
+ * be read from the same connection in any order.
+ */
+class FAN_LineReader
+{
+	/**
+	 * The socket or file
+	 */
+	int fd;
+	/**
+	 * The buffer, valid data is [start, end)
+	 */
+	char *buf;
+	int size;
+	int start;
+	int end;
+	/**
+	 * Offset up to which the buffer has already been searched
+	 */
+	int scanned;
+
+	/**
+	 * Moves the data to the front of the buffer or grows it if it is full.
+	 *
+	 * @return false if no memory was left
+	 */
+	bool makeRoom();
+	/**
+	 * Receives the next chunk, moving or growing the buffer if it is full.
+	 *
+	 * @return the number of bytes received, 0 on end of file, <0 on error
+	 */
+	int fill();
+
+public:
+	/**
+	 * @param fd the socket or file
+	 * @param size the initial size of the buffer, it grows on demand
+	 */
+	FAN_LineReader(int fd, int size);
+	~FAN_LineReader();
+
+	/**
+	 * Reads the next line.
+	 *
+	 * @return the malloc'ed line including its '\n', or NULL if the
+	 *         connection was closed before a line was complete
+	 */
+	char *areadline();
+	/**
+	 * Reads up to and including the next occurrence of a marker.
+	 *
+	 * @param mark the marker, e.g. "\nEOF\n"
+	 * @return the malloc'ed data, everything received so far if the
+	 *         connection was closed first, or NULL on error
+	 */
+	char *areadUntil(char *mark);
+	/**
+	 * Reads exactly [len] bytes, first from the buffer, then directly
+	 * from the descriptor.
+	 *
+	 * @param data pre-allocated memory of [len] bytes
+	 * @param len the number of bytes
+	 * @return true if all bytes were read
+	 */
+	bool read(unsigned char *data, int len);
+	/**
+	 * Receives what the socket has to offer without blocking, at most
+	 * until the buffer is full.
+	 *
+	 * @return false if the connection was closed or failed
+	 */
+	bool receive();
+	/**
+	 * Tells whether a complete line is buffered, without reading.
+	 */
+	bool hasLine();
+	/**
+	 * @return the length of the next buffered line including its '\n',
+	 *         0 if no complete line is buffered
+	 */
+	int lineLength();
+	/**
+	 * Copies the next [len] buffered bytes without consuming them.
+	 *
+	 * @param data pre-allocated memory of [len] bytes
+	 * @param len the number of bytes
+	 * @return false if fewer bytes are buffered
+	 */
+	bool peek(unsigned char *data, int len);
+	/**
+	 * @return the number of buffered bytes not yet read
+	 */
+	int pending();
+};
+
+#endif
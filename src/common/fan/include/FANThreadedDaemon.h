@@ -31,6 +31,7 @@
 #define FAN_QUOTE            0x20
 #define FAN_AFTER_PARAM      0x40
 #define FAN_READLINE_MAXLEN  1024
+#define FAN_EVENTS_MAX       64
 
 /**
  * Implements a threaded daemon with remote procedure call and message routing functionality
@@ -64,6 +65,17 @@ class FAN_ThreadedDaemon
 	 */
 	bool bShutdown;
 
+#ifdef __LINUX__
+	/**
+	 * Serves all connections from one epoll loop. Requests are read
+	 * without blocking and handed to a pool of [workers] threads once
+	 * they are complete.
+	 *
+	 * @param workers Number of threads executing commands
+	 */
+	bool dispatchEvents(int workers);
+#endif
+
 public:
 	/**
 	 * Confighash key of the hostname of the sdd server
@@ -96,6 +108,10 @@ public:
 	~FAN_ThreadedDaemon();
 	/**
 	 * Bind the daemon and wait for incoming calls.
+	 *
+	 * By default every connection gets a thread of its own. If the
+	 * config key "eventworkers" is set, the connections are served by
+	 * one epoll loop and that many worker threads instead (Linux only).
 	 */
 	bool bindDaemon();
 	/**
@@ -217,6 +233,8 @@ bool FAN_registerMaster(void*(*master)(void*));
 /**
  * Register a cleanup function. 
  * This function is called after a socket connection breaks.
+ * It gets the id of the connection's thread, or its socket if
+ * the daemon dispatches events.
  * 
  * @param cleanup Pointer to cleanup function
  */
@@ -66,6 +66,20 @@ typedef struct {
   FAN_Com *reply;
 } FAN_Msg;
 
+/**
+ * Output of a non-blocking socket that it could not take yet
+ *
+ * WARNING: Do not manipulate the fields of this struct.
+ */
+typedef struct FAN_SendBuffer {
+  int            sock;
+  unsigned char *data;
+  int            start;
+  int            end;
+  int            size;
+  bool           failed;
+} FAN_SendBuffer;
+
 /**
  * Reply message structure for automated synchronous messaging  (sendMessage)
  */
@@ -387,7 +401,44 @@ int  FAN_vrpc (FAN_Hash *hash, int sd, char *fkt, int params, va_list argument);
  * @see FAN_vrpc(FAN_Hash *hash, int sd, char *fkt, int params, va_list argument)
  */
 int  FAN_vrpc (FAN_Hash *hash, int sd, char *fkt, char *fmt, va_list argument);
+/**
+ * Scalar arguments are promoted when passed through a va_list, so they
+ * are copied into one of these before their bytes are sent.
+ */
+union FAN_Scalar
+{
+	int i;
+	long l;
+	double d;
+	char c;
+	unsigned char b;
+};
+
+/**
+ * Sends one set of arguments of a binary push. The template and all
+ * arguments go out in a single gathered send.
+ *
+ * @param sd the socket
+ * @param fmt the template [see #FAN_vrpc(FAN_Hash *hash,int sd,char *fkt,char *fmt, va_list argument)]
+ * @param argument the arguments
+ * @return <0 if the socket failed, 0 if nothing was sent
+ */
 int  FAN_vbinaryPush (int sd, char *fmt, va_list argument);
+/**
+ * Sends one set of arguments of a binary push straight from the
+ * caller's buffers, without formatting or copying them.
+ *
+ * Every parameter of the template gets one entry holding its bytes as
+ * #FAN_vbinaryPush would send them, e.g. an int for "int" or n vertices
+ * for "{double;double;double}[n]".
+ *
+ * @param sd the socket
+ * @param fmt the template
+ * @param iov the buffers, one per parameter of the template
+ * @param count the number of buffers
+ * @return <0 if the socket failed, 0 if the buffers do not match the template
+ */
+int  FAN_binaryPushv (int sd, char *fmt, struct iovec *iov, int count);
 
 #ifdef __IRIX__
 /**
@@ -448,19 +499,33 @@ void  FAN_upperCase(char *buffer);
  * Reads the next line from an file handle (socket), allocates a string
  * and stores the data to it. 
  * 
+ * The result holds everything read up to the chunk with the newline;
+ * use a #FAN_LineReader to keep what follows the line.
+ * 
  * @param FH the file descriptor (socket)
  * @param file not used
- * @param bufferSize Size of readline buffer
- * @param buffer Pointer to allocated buffer with the size of bufferSize
+ * @param bufferSize initial size of the line, it grows on demand
+ * @param buffer not used
  * @return the read line
  *
  * @see FAN_readall
  */
 char *FAN_arecvline(int FH, bool file, int bufferSize, char *buffer);
 char *FAN_areadline(int FH, bool file, int bufferSize, char *buffer);
+/**
+ * Reads exactly one line from a socket, leaving the bytes behind it on
+ * the socket.
+ *
+ * @param FH the socket
+ * @param file not used
+ * @param bufferSize the maximum length of the line
+ * @param buffer pre-allocated buffer of bufferSize bytes
+ * @return the read line or NULL if it did not fit
+ */
 char *FAN_arecvlineC(int FH, bool file, int bufferSize, char *buffer);
 
 bool FAN_binaryrecv(int FH, char *templ, int size, unsigned char* buffer);
+bool FAN_binaryrecv(FAN_LineReader *reader, char *templ, int size, unsigned char* buffer);
 /**
  * Tries to read [size] number of chars from a file handle (socket), and
  * stores the data in the pre-allocated string [line].
@@ -481,6 +546,25 @@ int   FAN_recvall(char *line, int size, int FH);
  */
 int   FAN_swrite(int s, char *txt);
 int   FAN_swrite(int s, unsigned char *data, int size);
+/**
+ * Creates the send buffer of the non-blocking socket [sock]. While the
+ * threadFAN of the calling thread points to it, FAN_swrite() queues
+ * whatever the socket does not take instead of waiting for the peer.
+ *
+ * @param sock the file descriptor (socket)
+ *
+ * @see FAN_flushSendBuffer
+ */
+FAN_SendBuffer *FAN_newSendBuffer(int sock);
+void  FAN_freeSendBuffer(FAN_SendBuffer *out);
+/**
+ * Sends as much of the queued output as the socket takes without waiting.
+ *
+ * @param out the send buffer
+ *
+ * @return the number of bytes still queued, -1 if the socket failed
+ */
+int   FAN_flushSendBuffer(FAN_SendBuffer *out);
 /**
  * Removes trailing CRs from the string [buf].
  *
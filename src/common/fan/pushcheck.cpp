@@ -0,0 +1,115 @@
+/*
+ * FAN - Framework for Applications in Networks
+ * Copyright (C) 2004 FreshX [dominik@freshx.de]
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ */
+
+/*
+ * Checks the bytes a binary push puts on the socket, without a server:
+ *
+ *	pushcheck
+ *
+ * Pushes go into one end of a socketpair and are compared with what the
+ * template says the server will read from the other end. Exits with 1 on
+ * the first difference.
+ */
+
+#include "FANClasses.h"
+#include <sys/socket.h>
+#include <string.h>
+
+static int failed = 0;
+
+static int push(int sd, char *fmt, ...)
+{
+    va_list argument;
+    va_start(argument, fmt);
+    int ret = FAN_vbinaryPush(sd, fmt, argument);
+    va_end(argument);
+    return ret;
+}
+
+/*
+ * reads what the last push sent and compares it with the template line
+ * followed by [size] bytes of [data]
+ */
+static void expect(int sd, const char *name, char *fmt, const void *data, int size)
+{
+    int want = strlen(fmt) + 1 + size;
+    char *buf = new char[want + 1];
+    int len = recv(sd, buf, want + 1, MSG_DONTWAIT);
+
+    if(len != want || memcmp(buf, fmt, strlen(fmt)) != 0 || buf[strlen(fmt)] != '\n' ||
+       memcmp(buf + strlen(fmt) + 1, data, size) != 0)
+    {
+        printf("FAILED %s: %d bytes instead of %d\n", name, len, want);
+        failed = 1;
+    }
+    else
+        printf("ok %s\n", name);
+
+    delete[] buf;
+}
+
+int main(int argc, char **argv)
+{
+    int sd[2];
+    if(socketpair(AF_UNIX, SOCK_STREAM, 0, sd) != 0)
+    {
+        perror("socketpair");
+        return 1;
+    }
+
+    int i = 7;
+    double d = 0.5;
+    double v[3] = { 1.0, 2.0, 3.0 };
+    char data[64];
+    char plain[] = "int;double;{double}[3]";
+    char empty[] = "int;{double}[0];double";
+
+    // scalars and an array
+    memcpy(data, &i, sizeof(int));
+    memcpy(data + sizeof(int), &d, sizeof(double));
+    memcpy(data + sizeof(int) + sizeof(double), v, sizeof(v));
+    push(sd[0], plain, i, d, v);
+    expect(sd[1], "scalars and array", plain, data, sizeof(int) + sizeof(double) + sizeof(v));
+
+    // a NULL array of length 0 between two scalars, as sent for a point
+    // sample outside the lattice
+    memcpy(data, &i, sizeof(int));
+    memcpy(data + sizeof(int), &d, sizeof(double));
+    push(sd[0], empty, i, (double *) NULL, d);
+    expect(sd[1], "NULL array", empty, data, sizeof(int) + sizeof(double));
+
+    // the same through the caller's buffers
+    struct iovec iov[3] = { { &i, sizeof(int) }, { NULL, 0 }, { &d, sizeof(double) } };
+    FAN_binaryPushv(sd[0], empty, iov, 3);
+    expect(sd[1], "NULL buffer", empty, data, sizeof(int) + sizeof(double));
+
+    // buffers that do not match the template are not sent at all
+    iov[1].iov_len = sizeof(double);
+    if(FAN_binaryPushv(sd[0], empty, iov, 3) != 0)
+    {
+        printf("FAILED mismatch was sent\n");
+        failed = 1;
+    }
+    else
+        printf("ok mismatch\n");
+
+    close(sd[0]);
+    close(sd[1]);
+    return failed;
+}
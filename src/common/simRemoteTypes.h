@@ -52,7 +52,8 @@ typedef struct
   unsigned int dimensionality;
   double min, max;
 
-  double *value;
+  unsigned int count; // windows of min, max and mean since the last sample
+  double *value; // count * dimensionality
 } point_sample;
 
 
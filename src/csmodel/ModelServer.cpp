@@ -30,12 +30,15 @@
 #include <assert.h>
 
 #include <stdlib.h>
+#include <string.h>
 #include <dirent.h>
 #include <fstream>
 #include <iostream>
 #include <string>
 #include <vector>
 #include "CommonServer.h"
+#include "SampleCodec.h"
+#include "SampleStream.h"
 #include "ModelServer.h"
 //#include "RemoteInterface.h"
 #include "csmodeltriangulation.h"
@@ -56,6 +59,7 @@ using namespace std;
 FAN *g_fan = NULL;
 FAN_Com *simMasterCom = NULL;
 FAN_Com *simStartMasterCom = NULL;
+FAN_Com *sampleSenderCom = NULL;
 
 CSModelController *csmdlCon = NULL;
 SimCommunicator simulation;
@@ -75,6 +79,13 @@ double *lastRot = NULL;
 
 // Simulation Parameters
 int simUpdateRate = 10;
+int simThreads = 1;             // Threads pro Simulationsprozess
+int simDecomposition = DECOMPOSITION_SLAB;
+int simVolumeResolution = 32;   // Punkte pro Kante einer Volumenprobe
+int simVolumeFormat = SAMPLEFORMAT_DOUBLE;
+int simSampleFormat = SAMPLEFORMAT_DOUBLE;  // Schnittebenen und Ribbons
+SampleStream sampleStream;                  // letzte Frames der Schnittebenen und Ribbons
+bool simInterpolation = false;  // Schnittebenen zwischen den Zellmitten interpolieren
 double simScaleX = 1.7;         // Simulationsraumfaktor X
 double simScaleY = 1.7;         // Simulationsraumfaktor Y
 double simScaleZ = 1.7;         // Simulationsraumfaktor Z
@@ -101,8 +112,9 @@ void *initController()
 
 void setServerStatus(FAN_Connection * conn, char *text, char *progress)
 {
+    // nobody waits for the reply, so do not stall on the round trip
     if (visConn != NULL) {
-        visConn->rpc("vis::setServerStatus", 2, text, progress);
+        visConn->notify(visConn->post("vis::setServerStatus", 2, text, progress), NULL, NULL);
     }
 }
 
@@ -269,6 +281,8 @@ void *mSimLogout(FAN_Hash * reg, void *param)
 void *mSimLogin(FAN_Hash * reg, void *param)
 {
     visConn2 = getVisConn2();
+    // der neue Vis kennt keine Frames, geordnet mit den Pushes des sampleSender
+    FAN_postMessage(sampleSenderCom, "forget", NULL, NULL);
 
     if (simStarted) {
         sendSimBound();
@@ -574,6 +588,10 @@ void startSim()
             simulation.setDensity(stdDensity);
             simulation.setRelax(stdRelaxationValue);
             simulation.setUpdateRate(simUpdateRate);
+            simulation.setThreads(simThreads);
+            simulation.setDecomposition(simDecomposition);
+            simulation.setVolumeResolution(simVolumeResolution);
+            simulation.setInterpolation(simInterpolation);
 
             simulation.updateVars();
 
@@ -854,6 +872,8 @@ void *mClearSamples(FAN_Hash * reg, void *param)
 
         sample_save_type *sample = (sample_save_type *) samples->getPointer(key);
         if (sample) {
+            if (sample->ptype == PROBETYPE_POINT)
+                simulation.forgetPoint(sample->id);
             ZAP_ARRAY(sample->points);
             ZAP_ARRAY(sample->orig_points);
             ZAP(sample);
@@ -862,6 +882,7 @@ void *mClearSamples(FAN_Hash * reg, void *param)
     }
 
     MZAP(list);
+    FAN_postMessage(sampleSenderCom, "forget", NULL, NULL);
     return (void *) FAN_OK;
 }
 
@@ -870,12 +891,16 @@ void *mDeleteSample(FAN_Hash * reg, void *param)
     char *id = (char *) param;
     sample_save_type *sample = (sample_save_type *) samples->getPointer(id);
     if (sample) {
+        // the worker recording it keeps doing so until told
+        if (sample->ptype == PROBETYPE_POINT)
+            simulation.forgetPoint(sample->id);
         ZAP_ARRAY(sample->points);
         ZAP_ARRAY(sample->orig_points);
         ZAP(sample);
         samples->insertPointer(id, NULL);
     }
-    MZAP(id);
+    // the sender drops its last frame once the pushes before are out
+    FAN_postMessage(sampleSenderCom, "forget", NULL, id);
 
     return (void *) FAN_OK;
 }
@@ -883,25 +908,42 @@ void *mDeleteSample(FAN_Hash * reg, void *param)
 void sendPointSample(FAN_Connection * conn, point_sample * sample)
 {
     char *templ;
-    asprintf(&templ, "int;int;int;int;double;double;{double}[1]");
-    conn->binaryPush(templ, sample->id, PROBETYPE_POINT, sample->type, sample->dimensionality, sample->min, sample->max, sample->value);
+    asprintf(&templ, "int;int;int;int;double;double;int;{double}[%u]", sample->count * sample->dimensionality);
+    conn->binaryPush(templ, sample->id, PROBETYPE_POINT, sample->type, sample->dimensionality, sample->min, sample->max, sample->count, sample->value);
     MZAP(templ);
 }
 
 void sendPlanarSample(FAN_Connection * conn, planar_sample * sample)
 {
     char *templ;
-    asprintf(&templ, "int;int;int;int;double;double;int;int;{double}[%d]", sample->u_size * sample->v_size);
-    conn->binaryPush(templ, sample->id, PROBETYPE_PLANE, sample->type, sample->dimensionality, sample->min, sample->max, sample->u_size, sample->v_size, sample->values);
+    unsigned long count = sample->u_size * sample->v_size;
+    unsigned long size = count * sampleSize(simSampleFormat);
+    unsigned char *packed = new unsigned char[size];
+
+    vector<unsigned char> frame;
+
+    encodeSamples(sample->values, count, simSampleFormat, sample->min, sample->max, packed);
+    sampleStream.encode(sample->id, packed, size, frame);
+
+    asprintf(&templ, "int;int;int;int;double;double;int;int;int;int;{byte}[%lu]", frame.size());
+    conn->binaryPush(templ, sample->id, PROBETYPE_PLANE, sample->type, sample->dimensionality, sample->min, sample->max, sample->u_size, sample->v_size, simSampleFormat, (int) frame.size(), &frame[0]);
     MZAP(templ);
+    delete[]packed;
 }
 
 void sendVolumeSample(FAN_Connection * conn, volume_sample * sample)
 {
     char *templ;
-    asprintf(&templ, "int;int;int;int;double;double;{double}[%d]", sample->u_size * sample->v_size * sample->w_size);
-    conn->binaryPush(templ, sample->id, PROBETYPE_PLANE, sample->type, sample->dimensionality, sample->min, sample->max, sample->u_size, sample->v_size, sample->w_size, sample->values);
+    unsigned long count = sample->u_size * sample->v_size * sample->w_size;
+    unsigned long size = count * sampleSize(simVolumeFormat);
+    unsigned char *packed = new unsigned char[size];
+
+    encodeSamples(sample->values, count, simVolumeFormat, sample->min, sample->max, packed);
+
+    asprintf(&templ, "int;int;int;int;double;double;int;int;int;int;{byte}[%lu]", size);
+    conn->binaryPush(templ, sample->id, PROBETYPE_VOLUME, sample->type, sample->dimensionality, sample->min, sample->max, sample->u_size, sample->v_size, sample->w_size, simVolumeFormat, packed);
     MZAP(templ);
+    delete[]packed;
 }
 
 void sendGlyphSample(FAN_Connection * conn, glyph_probe_data * sample)
@@ -915,13 +957,23 @@ void sendGlyphSample(FAN_Connection * conn, glyph_probe_data * sample)
 void sendRibbonSample(FAN_Connection * conn, ribbon_probe_data * sample)
 {
     char *templ;
-    asprintf(&templ, "int;int;int;double;double;int;{int}[%d];{double;double;double}[%d];{double}[%d]", sample->num_ribbons, sample->num_total * 2, sample->num_total);
-    conn->binaryPush(templ, sample->id, PROBETYPE_RIBBON, sample->num_ribbons, sample->min_value, sample->max_value, sample->num_total, sample->num_vertices, sample->ribbons, sample->values);
+    unsigned long size = sample->num_total * sampleSize(simSampleFormat);
+    unsigned char *packed = new unsigned char[size];
+
+    vector<unsigned char> frame;
+
+    encodeSamples(sample->values, sample->num_total, simSampleFormat, sample->min_value, sample->max_value, packed);
+    sampleStream.encode(sample->id, packed, size, frame);
+
+    asprintf(&templ, "int;int;int;double;double;int;{int}[%d];{double;double;double}[%d];int;int;{byte}[%lu]", sample->num_ribbons, sample->num_total * 2, frame.size());
+    conn->binaryPush(templ, sample->id, PROBETYPE_RIBBON, sample->num_ribbons, sample->min_value, sample->max_value, sample->num_total, sample->num_vertices, sample->ribbons, simSampleFormat, (int) frame.size(), &frame[0]);
     MZAP(templ);
+    delete[]packed;
 }
 
 void freePointSample(point_sample * sample)
 {
+    ZAP_ARRAY(sample->value);
     ZAP(sample);
 }
 
@@ -939,6 +991,7 @@ void freeVolumeSample(volume_sample * sample)
 
 void freeGlyphSample(glyph_probe_data * sample)
 {
+    ZAP_ARRAY(sample->num_glyphs_per_stream);
     ZAP_ARRAY(sample->positions);
     ZAP_ARRAY(sample->directions);
     ZAP_ARRAY(sample->values);
@@ -947,11 +1000,123 @@ void freeGlyphSample(glyph_probe_data * sample)
 
 void freeRibbonSample(ribbon_probe_data * sample)
 {
+    ZAP_ARRAY(sample->num_vertices);
     ZAP_ARRAY(sample->ribbons);
     ZAP_ARRAY(sample->values);
     ZAP(sample);
 }
 
+// Ein berechnetes Sample auf dem Weg zum Sender-Thread
+typedef struct
+{
+    probe_type ptype;
+    void *sample;
+} sample_job;
+
+/*
+ * The sender thread packs and pushes the samples of a tick while the
+ * overmind already computes the next one. It works through its messages
+ * in order, so once "flush" returns every sample of the tick is out, all
+ * in the one push begun with "begin". The vis server's acknowledgement
+ * of the push is only read by the next call on the connection.
+ */
+void *mSenderBegin(FAN_Hash * reg, void *p)
+{
+    if (visConn2 != NULL)
+        visConn2->startBinaryPush("vis::putSample");
+
+    return (void *) FAN_OK;
+}
+
+void *mSenderPush(FAN_Hash * reg, void *p)
+{
+    sample_job *job = (sample_job *) p;
+
+    switch (job->ptype) {
+    case PROBETYPE_POINT:
+        if (visConn2 != NULL)
+            sendPointSample(visConn2, (point_sample *) job->sample);
+        freePointSample((point_sample *) job->sample);
+        break;
+    case PROBETYPE_PLANE:
+        if (visConn2 != NULL)
+            sendPlanarSample(visConn2, (planar_sample *) job->sample);
+        freePlanarSample((planar_sample *) job->sample);
+        break;
+    case PROBETYPE_VOLUME:
+        if (visConn2 != NULL)
+            sendVolumeSample(visConn2, (volume_sample *) job->sample);
+        freeVolumeSample((volume_sample *) job->sample);
+        break;
+    case PROBETYPE_GLYPH:
+        if (visConn2 != NULL)
+            sendGlyphSample(visConn2, (glyph_probe_data *) job->sample);
+        freeGlyphSample((glyph_probe_data *) job->sample);
+        break;
+    case PROBETYPE_RIBBON:
+        if (visConn2 != NULL)
+            sendRibbonSample(visConn2, (ribbon_probe_data *) job->sample);
+        freeRibbonSample((ribbon_probe_data *) job->sample);
+        break;
+    }
+
+    delete job;
+    return (void *) FAN_OK;
+}
+
+// the last frame of a deleted sample, of all samples if p is NULL
+void *mSenderForget(FAN_Hash * reg, void *p)
+{
+    char *id = (char *) p;
+
+    if (id != NULL) {
+        sampleStream.forget(atoi(id));
+        MZAP(id);
+    } else
+        sampleStream.reset();
+
+    return (void *) FAN_OK;
+}
+
+void *mSenderFlush(FAN_Hash * reg, void *p)
+{
+    if (visConn2 != NULL)
+        visConn2->endBinaryPush();
+
+    return (void *) FAN_OK;
+}
+
+// computes a sample and hands it to the sender thread
+void computeSample(sample_save_type * sample_desc)
+{
+    sample_job *job = new sample_job;
+
+    job->ptype = sample_desc->ptype;
+
+    switch (sample_desc->ptype) {
+    case PROBETYPE_POINT:
+        job->sample = simulation.computePointSample(sample_desc);
+        break;
+    case PROBETYPE_PLANE:
+        job->sample = simulation.computePlanarSample(sample_desc);
+        break;
+    case PROBETYPE_VOLUME:
+        job->sample = simulation.computeVolumeSample(sample_desc);
+        break;
+    case PROBETYPE_GLYPH:
+        job->sample = simulation.computeGlyphSample(sample_desc, g_voxelSize);
+        break;
+    case PROBETYPE_RIBBON:
+        job->sample = simulation.computeRibbonSample(sample_desc, g_voxelSize);
+        break;
+    default:
+        delete job;
+        return;
+    }
+
+    FAN_postMessage(sampleSenderCom, "push", NULL, job);
+}
+
 void *mSimReady(FAN_Hash *reg, void *p)
 {
     return (void *) FAN_OK;
@@ -971,48 +1136,11 @@ void *mSimFilterSample(FAN_Hash * reg, void *p)
     char *cid = (char*)p;
 
     if (visConn2 != NULL) {
-        visConn2->startBinaryPush("vis::putSample");
-
         sample_save_type *sample_desc = (sample_save_type *) samples->getPointer(cid);
 
-        switch (sample_desc->ptype) {
-        case PROBETYPE_POINT:
-           {
-                point_sample *sample = simulation.computePointSample(sample_desc);
-                sendPointSample(visConn2, sample);
-                freePointSample(sample);
-                break;
-           }
-        case PROBETYPE_PLANE:
-           {
-               planar_sample *sample = simulation.computePlanarSample(sample_desc);
-               sendPlanarSample(visConn2, sample);
-               freePlanarSample(sample);
-               break;
-           }
-        case PROBETYPE_VOLUME:
-           {
-               volume_sample *sample = simulation.computeVolumeSample(sample_desc);
-               sendVolumeSample(visConn2, sample);
-               freeVolumeSample(sample);
-               break;
-           }
-        case PROBETYPE_GLYPH:
-           {
-               glyph_probe_data *sample = simulation.computeGlyphSample(sample_desc);
-               sendGlyphSample(visConn2, sample);
-               freeGlyphSample(sample);
-               break;
-           }
-        case PROBETYPE_RIBBON:
-           {
-               ribbon_probe_data *sample = simulation.computeRibbonSample(sample_desc, g_voxelSize);
-               sendRibbonSample(visConn2, sample);
-               freeRibbonSample(sample);
-               break;
-           }
-        }
-        visConn2->stopBinaryPush();
+        FAN_postMessage(sampleSenderCom, "begin", NULL, NULL);
+        computeSample(sample_desc);
+        FAN_sendMessage(sampleSenderCom, "flush", NULL);
     }
 
     return (void *) FAN_OK;
@@ -1040,49 +1168,10 @@ void *mSimFilter(FAN_Hash * reg, void *p)
         void **list = (void **) malloc(size * sizeof(void *));
         samples->getPointerKeys((char **) list);
         if (visConn2 != NULL) {
-            visConn2->startBinaryPush("vis::putSample");
-            for (int i = 0; i < size; i++) {
-                sample_save_type *sample_desc = (sample_save_type *) samples->getPointer((char *) *(list + i));
-
-                switch (sample_desc->ptype) {
-                case PROBETYPE_POINT:
-                    {
-                        point_sample *sample = simulation.computePointSample(sample_desc);
-                        sendPointSample(visConn2, sample);
-                        freePointSample(sample);
-                        break;
-                    }
-                case PROBETYPE_PLANE:
-                    {
-                        planar_sample *sample = simulation.computePlanarSample(sample_desc);
-                        sendPlanarSample(visConn2, sample);
-                        freePlanarSample(sample);
-                        break;
-                    }
-                case PROBETYPE_VOLUME:
-                    {
-                        volume_sample *sample = simulation.computeVolumeSample(sample_desc);
-                        sendVolumeSample(visConn2, sample);
-                        freeVolumeSample(sample);
-                        break;
-                    }
-                case PROBETYPE_GLYPH:
-                    {
-                        glyph_probe_data *sample = simulation.computeGlyphSample(sample_desc);
-                        sendGlyphSample(visConn2, sample);
-                        freeGlyphSample(sample);
-                        break;
-                    }
-                case PROBETYPE_RIBBON:
-                    {
-                        ribbon_probe_data *sample = simulation.computeRibbonSample(sample_desc, g_voxelSize);
-                        sendRibbonSample(visConn2, sample);
-                        freeRibbonSample(sample);
-                        break;
-                    }
-                }
-            }
-            visConn2->stopBinaryPush();
+            FAN_postMessage(sampleSenderCom, "begin", NULL, NULL);
+            for (int i = 0; i < size; i++)
+                computeSample((sample_save_type *) samples->getPointer((char *) *(list + i)));
+            FAN_sendMessage(sampleSenderCom, "flush", NULL);
         }
         MZAP(list);
     }
@@ -1166,7 +1255,20 @@ void sendFace(FAN_Connection * conn, FACE_TRGL current_face, int id)
         char *templ = NULL;
         asprintf(&templ, "int;int;int;{double;double;double}[%d];{int;int;int}[%d];int;int;{double;double;double}[%d]", current_face.iSizeVertices, current_face.iSizeTriangles, current_face.iSizePolesU * current_face.iSizePolesV);
 
-        conn->binaryPush(templ, id, current_face.iSizeVertices, current_face.iSizeTriangles, current_face.vertices, triangles, current_face.iSizePolesU, current_face.iSizePolesV, current_face.poles);
+        int poles = current_face.iSizePolesU * current_face.iSizePolesV;
+        struct iovec data[] = {
+            {&id, sizeof(int)},
+            {&current_face.iSizeVertices, sizeof(int)},
+            {&current_face.iSizeTriangles, sizeof(int)},
+            {current_face.vertices, current_face.iSizeVertices * sizeof(CSVERTEX)},
+            {triangles, current_face.iSizeTriangles * sizeof(triangle_t)},
+            {&current_face.iSizePolesU, sizeof(int)},
+            {&current_face.iSizePolesV, sizeof(int)},
+            {current_face.poles, poles * sizeof(CSPOLE)}
+        };
+
+        // straight from the face's arrays, the triangles are freed below
+        conn->binaryPushv(templ, data, 8);
         MZAP(templ);
     }
 
@@ -1459,8 +1561,12 @@ void *mSimRunner(FAN_Hash * reg, void *p)
 
 int main(int argc, char **argv)
 {
-    //Init MPI
-    MPI::Init_thread(MPI_THREAD_MULTIPLE);
+    //Init MPI, the workers' sampler threads need it thread safe
+    int provided = MPI::Init_thread(MPI_THREAD_MULTIPLE);
+    if (provided != MPI_THREAD_MULTIPLE) {
+        cerr << "ModelServer: MPI only provides thread level " << provided << ", the samplers need MPI_THREAD_MULTIPLE" << endl;
+        MPI::COMM_WORLD.Abort(1);
+    }
 
     g_fan = new FAN("../etc/model.conf", false);
     g_fan->installIntHandler();
@@ -1500,6 +1606,14 @@ int main(int argc, char **argv)
     if (argc >= 3)
         FAN::app->config->insert("VISPORT", argv[3]);
     visPort = atoi(FAN::app->config->getValue("VISPORT", "30001"));
+    simThreads = atoi(FAN::app->config->getValue("MODELTHREADS", "1"));
+    if (!strcmp(FAN::app->config->getValue("MODELDECOMPOSITION", "slab"), "block"))
+        simDecomposition = DECOMPOSITION_BLOCK;
+    simVolumeResolution = atoi(FAN::app->config->getValue("MODELVOLUMERESOLUTION", "32"));
+    simVolumeFormat = sampleFormat(FAN::app->config->getValue("MODELVOLUMEFORMAT", "double"));
+    simSampleFormat = sampleFormat(FAN::app->config->getValue("MODELSAMPLEFORMAT", "double"));
+    sampleStream.setKeyframes(atoi(FAN::app->config->getValue("MODELKEYFRAMES", "16")));
+    simInterpolation = !strcmp(FAN::app->config->getValue("MODELPLANARSAMPLING", "nearest"), "linear");
     if (argc >= 1)
         FAN::app->config->insert("MODELPORT", argv[1]);
 
@@ -1537,6 +1651,13 @@ int main(int argc, char **argv)
     FAN_registerHandler(simStartMaster, "ready", &mSimReady);
     simStartMasterCom = (FAN_Com *) simStartMaster->getPointer("COM");
 
+    FAN_Hash *sampleSender = FAN_initMasterHandler();
+    FAN_registerHandler(sampleSender, "begin", &mSenderBegin);
+    FAN_registerHandler(sampleSender, "push", &mSenderPush);
+    FAN_registerHandler(sampleSender, "flush", &mSenderFlush);
+    FAN_registerHandler(sampleSender, "forget", &mSenderForget);
+    sampleSenderCom = (FAN_Com *) sampleSender->getPointer("COM");
+
 
     initController();
 
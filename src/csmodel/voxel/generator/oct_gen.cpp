@@ -324,7 +324,7 @@ IndexOct* OctGen::genOctree()
             {
 	        char *status = NULL;
 	        asprintf(&status, "%d",  (int)((float)(count) / (float)modelSize * 50.0f));
-                visConn->rpc("vis::setServerStatus", 2, "Voxelizing model", status);
+                visConn->notify(visConn->post("vis::setServerStatus", 2, "Voxelizing model", status), NULL, NULL);
 	        free(status);
 	    }
 	}else
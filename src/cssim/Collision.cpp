@@ -0,0 +1,134 @@
+#include <vector>
+#include <stdlib.h>
+#include <string.h>
+
+using namespace std;
+
+#include "Collision.h"
+
+void collideScalar(const collisionRow * row, minmax_t * minmax)
+{
+    for (long n = 0; n < row->cells; n++) {
+        double values[19];
+
+        for (unsigned int i = 0; i < 19; i++)
+            values[i] = row->src[i][n];
+
+        // if node is solid node do bounceback
+        if (row->solid[n]) {
+            row->dst[0][n] = values[0];
+            for (int i = 1; i < 18; i += 2) {
+                row->dst[i][n] = values[i + 1];
+                row->dst[i + 1][n] = values[i];
+            }
+            continue;
+        }
+
+        double density = 0.;
+
+        for (unsigned int i = 0; i < 19; i++)
+            density += values[i];
+        row->density[n] = density;
+
+        // macroskopic Velocities mv_x, mv_y, mv_z
+        double mv_x = ((values[V1] + values[V7] + values[V9] + values[V11] + values[V13]) - (values[V2] + values[V8] + values[V10] + values[V12] + values[V14])) / density;
+
+        double mv_y = ((values[V3] + values[V10] + values[V7] + values[V15] + values[V17]) - (values[V4] + values[V9] + values[V8] + values[V16] + values[V18])) / density;
+
+        double mv_z = ((values[V5] + values[V14] + values[V11] + values[V15] + values[V18]) - (values[V6] + values[V13] + values[V12] + values[V16] + values[V17])) / density;
+
+        row->mv_x[n] = mv_x;
+        row->mv_y[n] = mv_y;
+        row->mv_z[n] = mv_z;
+
+        //compute equilibrium distribution
+        double square = mv_x * mv_x + mv_y * mv_y + mv_z * mv_z;
+        double f_eq[19];
+
+        if (density < minmax->min_density)
+            minmax->min_density = density;
+        if (density > minmax->max_density)
+            minmax->max_density = density;
+        if (square < minmax->min_v)
+            minmax->min_v = square;
+        if (square > minmax->max_v)
+            minmax->max_v = square;
+
+#define SQR(x) ((x) * (x))
+#define f0_i(cu) fix + (t_rho * (((cu) * 3.0) + (SQR((cu)) * 4.5)))
+
+        // center
+        // cu0 and cu0^2 is "0", thus just take the "fix" part
+        f_eq[V0] = (density / 3.0) * (1.0 - (square * 1.5));
+
+        // axis
+        double t_rho = density / 18.0;
+        // "fix" is constant within each of the following two blocks
+        double fix = t_rho * (1.0 - (square * 1.5));
+        // 1|2, 3|4, .. .just differ in the "(cu) * 3.0" term
+        // (it is added in 1,3,5, ... but subtraced in 2,4,6,...)
+        // -> just subtract it twice from the first result
+        double t_rho_6 = 6.0 * t_rho;
+        f_eq[V1] = f0_i(mv_x);
+        f_eq[V2] = f_eq[V1] - (t_rho_6 * mv_x);
+        f_eq[V3] = f0_i(mv_y);
+        f_eq[V4] = f_eq[V3] - (t_rho_6 * mv_y);
+        f_eq[V5] = f0_i(mv_z);
+        f_eq[V6] = f_eq[V5] - (t_rho_6 * mv_z);
+
+        // diagonal
+        t_rho = density / 36.0;
+        fix = t_rho * (1.0 - (square * 1.5));
+        t_rho_6 = 6.0 * t_rho;
+        f_eq[V7] = f0_i(mv_x + mv_y);
+        f_eq[V8] = f_eq[V7] - (t_rho_6 * (mv_x + mv_y));
+        f_eq[V9] = f0_i(mv_x - mv_y);
+        f_eq[V10] = f_eq[V9] - (t_rho_6 * (mv_x - mv_y));
+        f_eq[V11] = f0_i(mv_x + mv_z);
+        f_eq[V12] = f_eq[V11] - (t_rho_6 * (mv_x + mv_z));
+        f_eq[V13] = f0_i(mv_x - mv_z);
+        f_eq[V14] = f_eq[V13] - (t_rho_6 * (mv_x - mv_z));
+        f_eq[V15] = f0_i(mv_y + mv_z);
+        f_eq[V16] = f_eq[V15] - (t_rho_6 * (mv_y + mv_z));
+        f_eq[V17] = f0_i(mv_y - mv_z);
+        f_eq[V18] = f_eq[V17] - (t_rho_6 * (mv_y - mv_z));
+
+#undef f0_i
+#undef SQR
+
+        // relaxation
+        for (int i = 0; i < 19; i++)
+            row->dst[i][n] = values[i] + row->tau_inv * (f_eq[i] - values[i]);
+    }
+}
+
+collisionKernel selectCollisionKernel(const char **name)
+{
+    const char *wanted = getenv("CSSIM_KERNEL");
+
+#if defined(__i386__) || defined(__x86_64__)
+    __builtin_cpu_init();
+
+    if (!wanted || !strcmp(wanted, "avx512")) {
+        if (__builtin_cpu_supports("avx512f")) {
+            *name = "avx512";
+            return collideAVX512;
+        }
+    }
+    if (!wanted || !strcmp(wanted, "avx512") || !strcmp(wanted, "avx2")) {
+        if (__builtin_cpu_supports("avx2")) {
+            *name = "avx2";
+            return collideAVX2;
+        }
+    }
+    if (!wanted || strcmp(wanted, "scalar")) {
+        if (__builtin_cpu_supports("sse2")) {
+            *name = "sse2";
+            return collideSSE2;
+        }
+    }
+#endif
+
+    *name = "scalar";
+    return collideScalar;
+}
@@ -0,0 +1,41 @@
+#ifndef COLLISION_H
+#define COLLISION_H
+
+#include "types.h"
+#include "Lattice.h"
+
+/*
+ * BGK collision of one row of cells.
+ *
+ * src[i] points to f_i of the first cell, dst[i] to where the collided
+ * f_i of that cell goes; both advance by one double per cell and may be
+ * the same planes. Solid cells bounce back, fluid cells get their
+ * density and velocity stored and are relaxed towards the equilibrium.
+ * minmax is widened by the fluid cells of the row.
+ */
+struct collisionRow
+{
+	double *src[LATTICE_Q];
+	double *dst[LATTICE_Q];
+	unsigned char *solid;
+	double *density;
+	double *mv_x;
+	double *mv_y;
+	double *mv_z;
+	long cells;
+	double tau_inv;
+};
+
+typedef void (*collisionKernel)(const collisionRow *row, minmax_t *minmax);
+
+// scalar reference path, used for the tails of the vector kernels as well
+void collideScalar(const collisionRow *row, minmax_t *minmax);
+
+void collideSSE2(const collisionRow *row, minmax_t *minmax);
+void collideAVX2(const collisionRow *row, minmax_t *minmax);
+void collideAVX512(const collisionRow *row, minmax_t *minmax);
+
+// widest kernel the cpu supports, CSSIM_KERNEL=scalar|sse2|avx2|avx512 overrides
+collisionKernel selectCollisionKernel(const char **name);
+
+#endif
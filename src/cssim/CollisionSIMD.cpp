@@ -0,0 +1,238 @@
+/*
+ * Vector versions of collideScalar(). This file is compiled once per
+ * instruction set (see Makefile) and defines the kernel for the widest
+ * one enabled on the command line: -mavx512f, -mavx2 or -msse2.
+ *
+ * The arithmetic is done in the same order as in the scalar kernel, so
+ * (without fp contraction) the results are bitwise identical.
+ */
+#include <vector>
+#include <string.h>
+#include <immintrin.h>
+
+using namespace std;
+
+#include "Collision.h"
+#include "values.h"
+
+namespace {
+
+#if defined(__AVX512F__)
+
+#define COLLIDE collideAVX512
+
+struct isa
+{
+    typedef __m512d V;
+    typedef __mmask8 M;
+    enum { W = 8 };
+
+    static V load(const double *p) { return _mm512_loadu_pd(p); }
+    static void store(double *p, V v) { _mm512_storeu_pd(p, v); }
+    static V set(double d) { return _mm512_set1_pd(d); }
+    static V add(V a, V b) { return _mm512_add_pd(a, b); }
+    static V sub(V a, V b) { return _mm512_sub_pd(a, b); }
+    static V mul(V a, V b) { return _mm512_mul_pd(a, b); }
+    static V div(V a, V b) { return _mm512_div_pd(a, b); }
+    // the masked forms with an explicit source keep GCC 12 from taking
+    // the undefined passthrough of the plain ones as uninitialized
+    static V min(V a, V b) { return _mm512_mask_min_pd(a, 0xff, a, b); }
+    static V max(V a, V b) { return _mm512_mask_max_pd(a, 0xff, a, b); }
+
+    static M solid(const unsigned char *s) {
+        __m512i b = _mm512_maskz_cvtepu8_epi64(0xff, _mm_loadl_epi64((const __m128i *) s));
+        return _mm512_test_epi64_mask(b, b);
+    }
+    // m ? a : b
+    static V select(M m, V a, V b) { return _mm512_mask_blend_pd(m, b, a); }
+};
+
+#elif defined(__AVX2__)
+
+#define COLLIDE collideAVX2
+
+struct isa
+{
+    typedef __m256d V;
+    typedef __m256d M;
+    enum { W = 4 };
+
+    static V load(const double *p) { return _mm256_loadu_pd(p); }
+    static void store(double *p, V v) { _mm256_storeu_pd(p, v); }
+    static V set(double d) { return _mm256_set1_pd(d); }
+    static V add(V a, V b) { return _mm256_add_pd(a, b); }
+    static V sub(V a, V b) { return _mm256_sub_pd(a, b); }
+    static V mul(V a, V b) { return _mm256_mul_pd(a, b); }
+    static V div(V a, V b) { return _mm256_div_pd(a, b); }
+    static V min(V a, V b) { return _mm256_min_pd(a, b); }
+    static V max(V a, V b) { return _mm256_max_pd(a, b); }
+
+    static M solid(const unsigned char *s) {
+        int bytes;
+        memcpy(&bytes, s, sizeof(int));
+        __m256i b = _mm256_cvtepu8_epi64(_mm_cvtsi32_si128(bytes));
+        return _mm256_castsi256_pd(_mm256_cmpgt_epi64(b, _mm256_setzero_si256()));
+    }
+    static V select(M m, V a, V b) { return _mm256_blendv_pd(b, a, m); }
+};
+
+#elif defined(__SSE2__)
+
+#define COLLIDE collideSSE2
+
+struct isa
+{
+    typedef __m128d V;
+    typedef __m128d M;
+    enum { W = 2 };
+
+    static V load(const double *p) { return _mm_loadu_pd(p); }
+    static void store(double *p, V v) { _mm_storeu_pd(p, v); }
+    static V set(double d) { return _mm_set1_pd(d); }
+    static V add(V a, V b) { return _mm_add_pd(a, b); }
+    static V sub(V a, V b) { return _mm_sub_pd(a, b); }
+    static V mul(V a, V b) { return _mm_mul_pd(a, b); }
+    static V div(V a, V b) { return _mm_div_pd(a, b); }
+    static V min(V a, V b) { return _mm_min_pd(a, b); }
+    static V max(V a, V b) { return _mm_max_pd(a, b); }
+
+    static M solid(const unsigned char *s) {
+        return _mm_castsi128_pd(_mm_set_epi64x(s[1] ? -1 : 0, s[0] ? -1 : 0));
+    }
+    static V select(M m, V a, V b) {
+        return _mm_or_pd(_mm_and_pd(m, a), _mm_andnot_pd(m, b));
+    }
+};
+
+#endif
+
+// f_eq of the pair i|i+1, see collideScalar()
+#define PAIR(i, cu) \
+    do { \
+        isa::V c = (cu); \
+        f_eq[i] = isa::add(fix, isa::mul(t_rho, isa::add(isa::mul(c, three), isa::mul(isa::mul(c, c), fourhalf)))); \
+        f_eq[i + 1] = isa::sub(f_eq[i], isa::mul(t_rho_6, c)); \
+    } while (0)
+
+}
+
+#if defined(COLLIDE)
+
+void COLLIDE(const collisionRow * row, minmax_t * minmax)
+{
+    typedef isa::V V;
+
+    const V three = isa::set(3.0);
+    const V fourhalf = isa::set(4.5);
+    const V onehalf = isa::set(1.5);
+    const V one = isa::set(1.0);
+    const V tau_inv = isa::set(row->tau_inv);
+
+    V min_density = isa::set(MAXFLOAT);
+    V max_density = isa::set(MINFLOAT);
+    V min_v = isa::set(MAXFLOAT);
+    V max_v = isa::set(MINFLOAT);
+
+    long n = 0;
+
+    for (; n + isa::W <= row->cells; n += isa::W) {
+        V values[19];
+        V f_eq[19];
+
+        for (unsigned int i = 0; i < 19; i++)
+            values[i] = isa::load(row->src[i] + n);
+
+        isa::M solid = isa::solid(row->solid + n);
+
+        V density = isa::set(0.);
+        for (unsigned int i = 0; i < 19; i++)
+            density = isa::add(density, values[i]);
+
+        V mv_x = isa::div(isa::sub(isa::add(isa::add(isa::add(isa::add(values[V1], values[V7]), values[V9]), values[V11]), values[V13]),
+                                   isa::add(isa::add(isa::add(isa::add(values[V2], values[V8]), values[V10]), values[V12]), values[V14])), density);
+        V mv_y = isa::div(isa::sub(isa::add(isa::add(isa::add(isa::add(values[V3], values[V10]), values[V7]), values[V15]), values[V17]),
+                                   isa::add(isa::add(isa::add(isa::add(values[V4], values[V9]), values[V8]), values[V16]), values[V18])), density);
+        V mv_z = isa::div(isa::sub(isa::add(isa::add(isa::add(isa::add(values[V5], values[V14]), values[V11]), values[V15]), values[V18]),
+                                   isa::add(isa::add(isa::add(isa::add(values[V6], values[V13]), values[V12]), values[V16]), values[V17])), density);
+
+        // solid cells keep their last macroscopic values
+        isa::store(row->density + n, isa::select(solid, isa::load(row->density + n), density));
+        isa::store(row->mv_x + n, isa::select(solid, isa::load(row->mv_x + n), mv_x));
+        isa::store(row->mv_y + n, isa::select(solid, isa::load(row->mv_y + n), mv_y));
+        isa::store(row->mv_z + n, isa::select(solid, isa::load(row->mv_z + n), mv_z));
+
+        V square = isa::add(isa::add(isa::mul(mv_x, mv_x), isa::mul(mv_y, mv_y)), isa::mul(mv_z, mv_z));
+
+        min_density = isa::min(min_density, isa::select(solid, isa::set(MAXFLOAT), density));
+        max_density = isa::max(max_density, isa::select(solid, isa::set(MINFLOAT), density));
+        min_v = isa::min(min_v, isa::select(solid, isa::set(MAXFLOAT), square));
+        max_v = isa::max(max_v, isa::select(solid, isa::set(MINFLOAT), square));
+
+        V lower = isa::sub(one, isa::mul(square, onehalf));
+
+        f_eq[V0] = isa::mul(isa::div(density, three), lower);
+
+        V t_rho = isa::div(density, isa::set(18.0));
+        V fix = isa::mul(t_rho, lower);
+        V t_rho_6 = isa::mul(isa::set(6.0), t_rho);
+        PAIR(V1, mv_x);
+        PAIR(V3, mv_y);
+        PAIR(V5, mv_z);
+
+        t_rho = isa::div(density, isa::set(36.0));
+        fix = isa::mul(t_rho, lower);
+        t_rho_6 = isa::mul(isa::set(6.0), t_rho);
+        PAIR(V7, isa::add(mv_x, mv_y));
+        PAIR(V9, isa::sub(mv_x, mv_y));
+        PAIR(V11, isa::add(mv_x, mv_z));
+        PAIR(V13, isa::sub(mv_x, mv_z));
+        PAIR(V15, isa::add(mv_y, mv_z));
+        PAIR(V17, isa::sub(mv_y, mv_z));
+
+        // relaxation for fluid, bounceback for solid cells
+        isa::store(row->dst[0] + n, isa::select(solid, values[0], isa::add(values[0], isa::mul(tau_inv, isa::sub(f_eq[0], values[0])))));
+        for (int i = 1; i < 18; i += 2) {
+            V a = isa::add(values[i], isa::mul(tau_inv, isa::sub(f_eq[i], values[i])));
+            V b = isa::add(values[i + 1], isa::mul(tau_inv, isa::sub(f_eq[i + 1], values[i + 1])));
+
+            isa::store(row->dst[i] + n, isa::select(solid, values[i + 1], a));
+            isa::store(row->dst[i + 1] + n, isa::select(solid, values[i], b));
+        }
+    }
+
+    double lanes[4][isa::W];
+    isa::store(lanes[0], min_density);
+    isa::store(lanes[1], max_density);
+    isa::store(lanes[2], min_v);
+    isa::store(lanes[3], max_v);
+
+    for (int k = 0; k < isa::W; k++) {
+        if (lanes[0][k] < minmax->min_density)
+            minmax->min_density = lanes[0][k];
+        if (lanes[1][k] > minmax->max_density)
+            minmax->max_density = lanes[1][k];
+        if (lanes[2][k] < minmax->min_v)
+            minmax->min_v = lanes[2][k];
+        if (lanes[3][k] > minmax->max_v)
+            minmax->max_v = lanes[3][k];
+    }
+
+    if (n < row->cells) {
+        collisionRow tail = *row;
+
+        for (unsigned int i = 0; i < LATTICE_Q; i++) {
+            tail.src[i] += n;
+            tail.dst[i] += n;
+        }
+        tail.solid += n;
+        tail.density += n;
+        tail.mv_x += n;
+        tail.mv_y += n;
+        tail.mv_z += n;
+        tail.cells -= n;
+
+        collideScalar(&tail, minmax);
+    }
+}
+
+#endif
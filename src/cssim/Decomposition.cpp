@@ -0,0 +1,111 @@
+#include "Decomposition.h"
+
+Decomposition::Decomposition()
+{
+    for (int a = 0; a < 3; a++) {
+        size[a] = 0;
+        procs[a] = 1;
+    }
+}
+
+void Decomposition::setup(int x, int y, int z, int px, int py, int pz)
+{
+    size[0] = x;
+    size[1] = y;
+    size[2] = z;
+    procs[0] = px;
+    procs[1] = py;
+    procs[2] = pz;
+}
+
+void Decomposition::setup(int x, int y, int z, int workers, int mode)
+{
+    setup(x, y, z, workers, 1, 1);
+
+    if (mode != DECOMPOSITION_BLOCK)
+        return;
+
+    // the grid with the smallest total area of block faces; the x faces
+    // count px times since the ring closes over the periodic boundary.
+    // Blocks thinner than two cells are not worth it.
+    long best = -1;
+
+    for (int px = 1; px <= workers; px++) {
+        if (workers % px)
+            continue;
+        for (int py = 1; py <= workers / px; py++) {
+            if ((workers / px) % py)
+                continue;
+
+            int pz = workers / px / py;
+
+            if (x < 2 * px || y < 2 * py || z < 2 * pz)
+                continue;
+
+            long area = (long) px * y * z + (long) (py - 1) * x * z + (long) (pz - 1) * x * y;
+
+            if (best < 0 || area < best || (area == best && px > procs[0])) {
+                best = area;
+                setup(x, y, z, px, py, pz);
+            }
+        }
+    }
+}
+
+int Decomposition::rank(const int *c) const
+{
+    return 1 + (c[0] * procs[1] + c[1]) * procs[2] + c[2];
+}
+
+void Decomposition::coords(int rank, int *c) const
+{
+    rank--;
+    c[2] = rank % procs[2];
+    c[1] = rank / procs[2] % procs[1];
+    c[0] = rank / procs[2] / procs[1];
+}
+
+void Decomposition::box(int rank, int *origin, int *dim) const
+{
+    int c[3];
+
+    coords(rank, c);
+    for (int a = 0; a < 3; a++) {
+        origin[a] = start(a, c[a]);
+        dim[a] = extent(a, c[a]);
+    }
+}
+
+int Decomposition::owner(int x, int y, int z, int *local) const
+{
+    int p[3] = { x, y, z };
+    int c[3];
+
+    for (int a = 0; a < 3; a++) {
+        // inverse of start(): the last block starting at or before p
+        c[a] = ((long) (p[a] + 1) * procs[a] - 1) / size[a];
+        local[a] = p[a] - start(a, c[a]);
+    }
+
+    return rank(c);
+}
+
+int Decomposition::neighbour(const int *c, const int *d, int *shift) const
+{
+    int n[3];
+
+    *shift = 0;
+    for (int a = 0; a < 3; a++) {
+        n[a] = c[a] + d[a];
+
+        if (n[a] >= 0 && n[a] < procs[a])
+            continue;
+        if (a)
+            return -1;
+
+        *shift = n[a] < 0 ? -1 : 1;
+        n[a] -= *shift * procs[a];
+    }
+
+    return rank(n);
+}
@@ -0,0 +1,58 @@
+#ifndef DECOMPOSITION_H
+#define DECOMPOSITION_H
+
+// how the lattice is split over the workers, "decomposition" in model.conf
+#define DECOMPOSITION_SLAB	0	// slices along x
+#define DECOMPOSITION_BLOCK	1	// 3-D blocks
+
+/*
+ * Cartesian split of the global lattice over the workers.
+ *
+ * The workers form a process grid of procs[0] x procs[1] x procs[2]
+ * blocks, numbered row major like MPI_Cart_create() without reordering
+ * does; block 0 is world rank 1, since rank 0 is the overmind. The grid
+ * is periodic in x (the channel wraps around, see MD3Q19b::accelerate*)
+ * and closed in y and z. Every axis is split as evenly as possible.
+ *
+ * Overmind and workers build the same object from the global size and
+ * the grid, so both agree on who owns which cell without further
+ * messages.
+ */
+class Decomposition
+{
+public:
+	Decomposition();
+
+	// picks the process grid for the given number of workers
+	void setup(int x, int y, int z, int workers, int mode);
+	void setup(int x, int y, int z, int px, int py, int pz);
+
+	int blocks() const { return procs[0] * procs[1] * procs[2]; };
+
+	// world rank of the block at grid coordinates c and back
+	int rank(const int *c) const;
+	void coords(int rank, int *c) const;
+
+	// first cell and number of cells of block c along axis
+	int start(int axis, int c) const { return (long) size[axis] * c / procs[axis]; };
+	int extent(int axis, int c) const { return start(axis, c + 1) - start(axis, c); };
+
+	// position and size of the block of a worker
+	void box(int rank, int *origin, int *dim) const;
+
+	// worker owning the global cell x,y,z and the cell's local position
+	int owner(int x, int y, int z, int *local) const;
+
+	/*
+	 * Rank of the block next to the one at c in direction d (each of
+	 * -1, 0, 1), or -1 if there is none. A neighbour across the periodic
+	 * x boundary is reported with *shift set to -1 or 1: it lies that
+	 * many lattice lengths away from the block at c.
+	 */
+	int neighbour(const int *c, const int *d, int *shift) const;
+
+	int size[3];	// global lattice
+	int procs[3];	// process grid
+};
+
+#endif
@@ -0,0 +1,138 @@
+#include <vector>
+
+using namespace std;
+
+#include "Halo.h"
+#include "mpitags.h"
+
+// box given by origin and dim, grown by margin on every side
+static bool inBox(const int *p, const int *origin, const int *dim, int margin)
+{
+    for (int a = 0; a < 3; a++)
+        if (p[a] < origin[a] - margin || p[a] >= origin[a] + dim[a] + margin)
+            return false;
+    return true;
+}
+
+/*
+ * Slots (cell c, plane j) with c in box 'to' and c - e_j in box 'from',
+ * i.e. the populations which cross from 'from' into 'to' in an odd step.
+ * All coordinates are global, the slots are offsets into the lattice of
+ * the block at 'local'.
+ */
+static void slots(const Lattice * lattice, const int *local, const int *to, const int *toDim,
+                  const int *from, const int *fromDim, vector<long> &out)
+{
+    int lo[3], hi[3];
+
+    for (int a = 0; a < 3; a++) {
+        lo[a] = to[a] > from[a] - 1 ? to[a] : from[a] - 1;
+        hi[a] = to[a] + toDim[a] < from[a] + fromDim[a] + 1 ? to[a] + toDim[a] : from[a] + fromDim[a] + 1;
+    }
+
+    int c[3];
+    for (c[2] = lo[2]; c[2] < hi[2]; c[2]++) {
+        for (c[1] = lo[1]; c[1] < hi[1]; c[1]++) {
+            for (c[0] = lo[0]; c[0] < hi[0]; c[0]++) {
+                long n = lattice->index(c[0] - local[0], c[1] - local[1], c[2] - local[2]);
+
+                for (int j = 1; j < LATTICE_Q; j++) {
+                    int src[3] = { c[0] - lattice_e[j][0], c[1] - lattice_e[j][1], c[2] - lattice_e[j][2] };
+
+                    if (inBox(src, from, fromDim, 0))
+                        out.push_back(lattice->f[j] - lattice->f[0] + n);
+                }
+            }
+        }
+    }
+}
+
+void Halo::setup(const Lattice * lattice, const Decomposition * decomp, int rank)
+{
+    int c[3], origin[3], dim[3];
+
+    decomp->coords(rank, c);
+    decomp->box(rank, origin, dim);
+
+    links.clear();
+    pending = 0;
+
+    int d[3];
+    for (d[0] = -1; d[0] <= 1; d[0]++) {
+        for (d[1] = -1; d[1] <= 1; d[1]++) {
+            for (d[2] = -1; d[2] <= 1; d[2]++) {
+                int nonzero = (d[0] != 0) + (d[1] != 0) + (d[2] != 0);
+                if (!nonzero || nonzero == 3)
+                    continue;
+
+                int shift;
+                int nb = decomp->neighbour(c, d, &shift);
+                if (nb < 0)
+                    continue;
+
+                // the neighbour's block as seen from ours
+                int nbOrigin[3], nbDim[3];
+                decomp->box(nb, nbOrigin, nbDim);
+                nbOrigin[0] += shift * decomp->size[0];
+
+                link l;
+                l.rank = nb;
+                // tags name the direction from sender to receiver
+                l.sendTag = MPI_Data_Halo + (d[0] + 1) * 9 + (d[1] + 1) * 3 + (d[2] + 1);
+                l.recvTag = MPI_Data_Halo + (1 - d[0]) * 9 + (1 - d[1]) * 3 + (1 - d[2]);
+
+                slots(lattice, origin, nbOrigin, nbDim, origin, dim, l.ghost);
+                slots(lattice, origin, origin, dim, nbOrigin, nbDim, l.cells);
+
+                if (l.ghost.empty() && l.cells.empty())
+                    continue;
+
+                l.sendBuffer.resize(l.cells.size() > l.ghost.size() ? l.cells.size() : l.ghost.size());
+                l.recvBuffer.resize(l.sendBuffer.size());
+                links.push_back(l);
+            }
+        }
+    }
+
+    requests.resize(2 * links.size());
+}
+
+void Halo::start(Lattice * lattice, int parity)
+{
+    double *f = lattice->f[0];
+
+    pending = parity;
+
+    for (unsigned int k = 0; k < links.size(); k++) {
+        link &l = links[k];
+        const vector<long> &in = parity ? l.ghost : l.cells;
+
+        requests[2 * k] = MPI::COMM_WORLD.Irecv(&l.recvBuffer[0], in.size() * sizeof(double), MPI::BYTE, l.rank, l.recvTag);
+    }
+
+    for (unsigned int k = 0; k < links.size(); k++) {
+        link &l = links[k];
+        const vector<long> &out = parity ? l.cells : l.ghost;
+
+        for (unsigned int s = 0; s < out.size(); s++)
+            l.sendBuffer[s] = f[out[s]];
+
+        requests[2 * k + 1] = MPI::COMM_WORLD.Isend(&l.sendBuffer[0], out.size() * sizeof(double), MPI::BYTE, l.rank, l.sendTag);
+    }
+}
+
+void Halo::finish(Lattice * lattice)
+{
+    double *f = lattice->f[0];
+
+    if (!requests.empty())
+        MPI::Request::Waitall(requests.size(), &requests[0]);
+
+    for (unsigned int k = 0; k < links.size(); k++) {
+        link &l = links[k];
+        const vector<long> &in = pending ? l.ghost : l.cells;
+
+        for (unsigned int s = 0; s < in.size(); s++)
+            f[in[s]] = l.recvBuffer[s];
+    }
+}
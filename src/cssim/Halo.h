@@ -0,0 +1,59 @@
+#ifndef HALO_H
+#define HALO_H
+
+#include <vector>
+#include <mpi.h>
+
+#include "Lattice.h"
+#include "Decomposition.h"
+
+/*
+ * Exchange of the populations crossing the faces and edges of a block
+ * with up to 18 neighbours (D3Q19 has no corner directions).
+ *
+ * For every neighbour two lists of slots (cell and plane) are built once:
+ *
+ *	ghost: ghost cells of ours inside the neighbour's block, in the
+ *		planes our cells pull from and push to in an odd step
+ *	cells: our cells next to the neighbour, in the planes the
+ *		neighbour's cells pull from and push to
+ *
+ * Both sides enumerate their slots in the same global order, so our
+ * cells list matches the neighbour's ghost list one to one. After an
+ * even step (parity 1) every cell holds the populations it sends out,
+ * so cells go to the neighbour's ghosts; after an odd step (parity 0)
+ * the populations which left the block sit in our ghosts and go back
+ * into the neighbour's cells.
+ *
+ * start() only needs the cells on the faces of the block to be done
+ * with the step, finish() has to wait for all of them: the slots it
+ * fills are not touched by the step which produces them.
+ */
+class Halo
+{
+public:
+	void setup(const Lattice *lattice, const Decomposition *decomp, int rank);
+
+	// post the transfers for the step which leaves the lattice at parity
+	void start(Lattice *lattice, int parity);
+	// wait for them and unpack what came in
+	void finish(Lattice *lattice);
+
+private:
+	struct link
+	{
+		int rank;
+		int sendTag;
+		int recvTag;
+		std::vector<long> ghost;	// slots as offsets from lattice->f[0]
+		std::vector<long> cells;
+		std::vector<double> sendBuffer;
+		std::vector<double> recvBuffer;
+	};
+
+	std::vector<link> links;
+	std::vector<MPI::Request> requests;
+	int pending;	// parity of the transfers in flight
+};
+
+#endif
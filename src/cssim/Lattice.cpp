@@ -0,0 +1,131 @@
+#include <stdlib.h>
+#include <string.h>
+#include <iostream>
+
+using namespace std;
+
+#include "Lattice.h"
+
+// planes which are a multiple of a page apart map onto the same cache sets
+#define PAGE_DOUBLES	(4096 / sizeof(double))
+
+// same order as V0 .. V18 in types.h
+const int lattice_e[LATTICE_Q][3] = { {0, 0, 0}, {1, 0, 0}, {-1, 0, 0}, {0, 1, 0}, {0, -1, 0},
+                                      {0, 0, 1}, {0, 0, -1}, {1, 1, 0}, {-1, -1, 0}, {1, -1, 0},
+                                      {-1, 1, 0}, {1, 0, 1}, {-1, 0, -1}, {1, 0, -1}, {-1, 0, 1},
+                                      {0, 1, 1}, {0, -1, -1}, {0, 1, -1}, {0, -1, 1} };
+
+const int lattice_inv[LATTICE_Q] = { 0, 2, 1, 4, 3, 6, 5, 8, 7, 10, 9, 12, 11, 14, 13, 16, 15, 18, 17 };
+
+Lattice::Lattice()
+{
+    dim_x = dim_y = dim_z = 0;
+    rowPitch = planePitch = 0;
+    origin = planeSize = planeStride = 0;
+    parity = 0;
+
+    fBlock = NULL;
+    mBlock = NULL;
+    solid = NULL;
+
+    for (unsigned int i = 0; i < LATTICE_Q; i++)
+        f[i] = NULL;
+    density = mv_x = mv_y = mv_z = NULL;
+}
+
+Lattice::~Lattice()
+{
+    release();
+}
+
+void *Lattice::allocAligned(size_t size)
+{
+    void *p = NULL;
+
+    if (posix_memalign(&p, LATTICE_ALIGN, size)) {
+        cerr << "Lattice: unable to allocate " << size << " bytes" << endl;
+        abort();
+    }
+    return p;
+}
+
+void Lattice::release()
+{
+    free(fBlock);
+    free(mBlock);
+    free(solid);
+
+    fBlock = NULL;
+    mBlock = NULL;
+    solid = NULL;
+
+    for (unsigned int i = 0; i < LATTICE_Q; i++)
+        f[i] = NULL;
+    density = mv_x = mv_y = mv_z = NULL;
+}
+
+void Lattice::allocate(unsigned int x, unsigned int y, unsigned int z)
+{
+    allocateFields(x, y, z);
+
+    fBlock = (double *) allocAligned(LATTICE_Q * planeStride * sizeof(double));
+    for (unsigned int i = 0; i < LATTICE_Q; i++)
+        f[i] = fBlock + i * planeStride;
+}
+
+void Lattice::allocateFields(unsigned int x, unsigned int y, unsigned int z)
+{
+    release();
+
+    dim_x = x;
+    dim_y = y;
+    dim_z = z;
+    parity = 0;
+
+    // x = 0 starts on an aligned boundary, the ghost column x = -1 sits
+    // in the padding in front of it
+    rowPitch = LATTICE_ROWALIGN + dim_x + 1;
+    rowPitch = (rowPitch + LATTICE_ROWALIGN - 1) / LATTICE_ROWALIGN * LATTICE_ROWALIGN;
+    planePitch = rowPitch * (dim_y + 2);
+    planeSize = planePitch * (dim_z + 2);
+    origin = planePitch + rowPitch + LATTICE_ROWALIGN;
+
+    planeStride = planeSize;
+    if (!(planeStride % PAGE_DOUBLES))
+        planeStride += LATTICE_ROWALIGN;
+
+    mBlock = (double *) allocAligned(4 * planeStride * sizeof(double));
+    density = mBlock;
+    mv_x = mBlock + planeStride;
+    mv_y = mBlock + 2 * planeStride;
+    mv_z = mBlock + 3 * planeStride;
+
+    solid = (unsigned char *) allocAligned(planeSize);
+}
+
+void Lattice::touch(unsigned long first, unsigned long last)
+{
+    long begin = first ? rowStart(first) : 0;
+    long end = last < rows() ? rowStart(last) : planeStride;
+
+    if (fBlock) {
+        for (unsigned int i = 0; i < LATTICE_Q; i++)
+            memset(f[i] + begin, 0, (end - begin) * sizeof(double));
+    }
+
+    memset(density + begin, 0, (end - begin) * sizeof(double));
+    memset(mv_x + begin, 0, (end - begin) * sizeof(double));
+    memset(mv_y + begin, 0, (end - begin) * sizeof(double));
+    memset(mv_z + begin, 0, (end - begin) * sizeof(double));
+
+    if (last >= rows())
+        end = planeSize;
+    memset(solid + begin, 0, end - begin);
+}
+
+void Lattice::copyFields(const Lattice * from)
+{
+    memcpy(mBlock, from->mBlock, 4 * planeStride * sizeof(double));
+    memcpy(solid, from->solid, planeSize);
+    parity = from->parity;
+}
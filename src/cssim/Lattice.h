@@ -0,0 +1,117 @@
+#ifndef LATTICE_H
+#define LATTICE_H
+
+#include <stddef.h>
+
+// number of discrete velocities of the D3Q19 model
+#define LATTICE_Q	19
+
+// every row starts on (and is padded to) a cache line
+#define LATTICE_ALIGN	64
+#define LATTICE_ROWALIGN	(LATTICE_ALIGN / sizeof(double))
+
+// discrete velocities and the opposite of each direction
+extern const int lattice_e[LATTICE_Q][3];
+extern const int lattice_inv[LATTICE_Q];
+
+/*
+ * Structure-of-arrays storage for the lattice of one worker.
+ *
+ * Each of the 19 distribution values, the macroscopic values and the
+ * solid flags live in planes of their own, so the inner x loop of the
+ * kernels walks contiguous, aligned memory. All planes share the same
+ * index space: rows are padded to LATTICE_ROWALIGN doubles and a shell
+ * of one ghost cell surrounds the domain, which takes everything that
+ * streams out of it (x = -1 / dim_x, y = -1 / dim_y, z = -1 / dim_z).
+ *
+ * The planes are updated in place following the AA pattern, so their
+ * meaning alternates from step to step (see StreamCollide.cpp): with
+ * parity 0 every cell holds its own f_i in plane i, with parity 1 it
+ * holds its collided f_i in the plane of the opposite direction.
+ */
+class Lattice
+{
+public:
+	Lattice();
+	virtual ~Lattice();
+
+	// (re)allocates all planes for the given dimension; the memory is
+	// left untouched, so the pages end up on the NUMA node of whichever
+	// thread runs touch() on them first
+	void allocate(unsigned int x, unsigned int y, unsigned int z);
+	void release();
+
+	// the macroscopic values and solid flags only, f[] stays NULL; for
+	// copies of a lattice that is stepped elsewhere (see copyFields())
+	void allocateFields(unsigned int x, unsigned int y, unsigned int z);
+
+	// takes over density, mv and solid of a lattice of the same
+	// dimension, ghost shell included
+	void copyFields(const Lattice *from);
+
+	// zero fills everything between row first and row last of all planes,
+	// the ghost shell in front of first (first == 0) and behind the last
+	// row (last == rows()) included
+	void touch(unsigned long first, unsigned long last);
+
+	// the rows of all planes are numbered y + dim_y * z
+	unsigned long rows() const {
+		return (unsigned long) dim_y * dim_z;
+	};
+
+	// index of cell x,y,z in any of the planes, ghost shell included
+	long index(int x, int y, int z) const {
+		return origin + planePitch * z + rowPitch * y + x;
+	};
+
+	// offset between a cell and its neighbour in direction ex,ey,ez
+	long offset(int ex, int ey, int ez) const {
+		return planePitch * ez + rowPitch * ey + ex;
+	};
+
+	// offset between a cell and its neighbour in direction i
+	long offset(int i) const {
+		return offset(lattice_e[i][0], lattice_e[i][1], lattice_e[i][2]);
+	};
+
+	bool inside(int x, int y, int z) const {
+		return x >= 0 && y >= 0 && z >= 0 && x < (int)dim_x && y < (int)dim_y && z < (int)dim_z;
+	};
+
+	unsigned int dim_x;
+	unsigned int dim_y;
+	unsigned int dim_z;
+
+	long rowPitch;		// doubles per row, padding included
+	long planePitch;	// doubles per xy plane, ghost rows included
+
+	// distribution values, one plane per direction
+	double *f[LATTICE_Q];
+
+	// macroscopic values, written by the collision
+	double *density;
+	double *mv_x;
+	double *mv_y;
+	double *mv_z;
+
+	unsigned char *solid;
+
+	int parity;
+
+private:
+	long origin;		// index of cell 0,0,0
+	long planeSize;		// doubles per plane
+	long planeStride;	// distance between two distribution planes
+
+	double *fBlock;
+	double *mBlock;
+
+	void *allocAligned(size_t size);
+
+	// first double of row r, the padding in front of x = -1 included
+	long rowStart(unsigned long r) const {
+		return planePitch * (r / dim_y + 1) + rowPitch * (r % dim_y + 1);
+	};
+};
+
+#endif
@@ -1,23 +1,24 @@
 #include <vector>
 #include <iostream>
+#include <string.h>
+#include <stdlib.h>
 
 using namespace std;
 
 #include "MD3Q19b.h"
+#include "StreamCollide.h"
+#include "Resample.h"
+#include "VoxelCodec.h"
 #include "types.h"
 #include "mpitags.h"
 #include "values.h"
 
-#define LEFT 	0
-#define RIGHT	1
-
 #define INITSIZE 10000
 
 MD3Q19b::MD3Q19b()
 {
-    bufferLeft = NULL;
-    bufferRight = NULL;
-    buffer = NULL;
+    max_x = max_y = max_z = 0;
+    origin[0] = origin[1] = origin[2] = 0;
 
     sendBuffer.bufferSize = INITSIZE;
     sendBuffer.size = 0;
@@ -26,67 +27,257 @@ MD3Q19b::MD3Q19b()
     receiveBuffer.size = 0;
     receiveBuffer.cells = new bufferdata[INITSIZE];
 
-    // init Vector Model 
-    //            0  1  2  3  4  5  6  7  8  9 10 11 12 13 14 15 16 17 18
-    int x[19] = { 0, 1, -1, 0, 0, 0, 0, 1, -1, 1, -1, 1, -1, 1, -1, 0, 0, 0, 0 };
-    int y[19] = { 0, 0, 0, 1, -1, 0, 0, 1, -1, -1, 1, 0, 0, 0, 0, 1, -1, 1, -1 };
-    int z[19] = { 0, 0, 0, 0, 0, 1, -1, 0, 0, 0, 0, 1, -1, -1, 1, 1, -1, -1, 1 };
-
     myrank = MPI::COMM_WORLD.Get_rank();
     nprocs = MPI::COMM_WORLD.Get_size();
 
+    memberMinmax.resize(1);
 
-    outOfBounds = new cellData();
-    initCell(outOfBounds);
-
-    outOfBounds->density = 0.0f;
+    collide = selectCollisionKernel(&collideName);
+    if (myrank == 1)
+        cout << "\t\t\t Collision kernel: " << collideName << endl;
 
-    if (myrank == 1) {
-        leftNB = nprocs - 1;
-    } else {
-        leftNB = myrank - 1;
-    }
+    front = 0;
+    generation = 0;
+    served = true;
+    serving = false;
+    pthread_mutex_init(&snapshotLock, NULL);
+    pthread_cond_init(&snapshotChanged, NULL);
 
-    if (myrank == (nprocs - 1)) {
-        rightNB = 1;
-    } else {
-        rightNB = myrank + 1;
-    }
+    // collective, the overmind follows in SimCommunicator::updateVars()
+    sampling = MPI::COMM_WORLD.Dup();
 
-    for (unsigned int i = 0; i < 19; i++) {
-        e_x[i] = x[i];
-        e_y[i] = y[i];
-        e_z[i] = z[i];
+    int rc = pthread_create(&sampler, NULL, startSampler, this);
+    if (rc) {
+        cerr << "\t\t\t Sim " << myrank << ": could not start the sampler, " << rc << " returned by pthread_create" << endl;
+        abort();
     }
 
-/*	if (cellDataModel)
-        	delete cellDataModel;  */
-
-    cellDataModel = NULL;
     //cout << "slave spawned on Sim " << myrank << endl;
 
     listenForCommand();
+
+    pthread_join(sampler, NULL);
+    sampling.Free();
 }
 
 
 MD3Q19b::~MD3Q19b()
 {
-    // if there is an older cellDataModel it must be deleted first
-    if (cellDataModel) {
-        delete[]cellDataModel;
-        cellDataModel = NULL;
+    pthread_cond_destroy(&snapshotChanged);
+    pthread_mutex_destroy(&snapshotLock);
+}
+
+/*
+ * Called by the solver after every run: the fields go into the back
+ * snapshot while the sampler may still be reading the front one, the
+ * two change places once the overmind has filtered the front one. So a
+ * sampler which is slower than a run holds the solver up here, and
+ * nothing else does.
+ */
+void MD3Q19b::publish()
+{
+    // only this thread ever changes front
+    int back = 1 - front;
+
+    snapshot[back].copyFields(&lattice);
+    snapshotMinmax[back] = minmax;
+
+    pthread_mutex_lock(&snapshotLock);
+    while (serving || !served)
+        pthread_cond_wait(&snapshotChanged, &snapshotLock);
+
+    front = back;
+    generation++;
+    served = false;
+
+    pthread_cond_broadcast(&snapshotChanged);
+    pthread_mutex_unlock(&snapshotLock);
+}
+
+// an update of the area shows up in the samples before the next run does
+void MD3Q19b::refreshSnapshot()
+{
+    pthread_mutex_lock(&snapshotLock);
+    while (serving)
+        pthread_cond_wait(&snapshotChanged, &snapshotLock);
+
+    snapshot[front].copyFields(&lattice);
+    snapshotMinmax[front] = minmax;
+
+    pthread_mutex_unlock(&snapshotLock);
+}
+
+void *MD3Q19b::startSampler(void *model)
+{
+    ((MD3Q19b *) model)->serve();
+    return NULL;
+}
+
+/*
+ * The sampler thread. MPI_Filter carries the number of the run the
+ * overmind wants to see, which is at most one ahead of the front
+ * snapshot: it sends the next run before it filters the last one.
+ */
+void MD3Q19b::serve()
+{
+    MPI::Status status;
+
+    for (;;) {
+        int wanted = 0;
+
+        sampling.Recv(&wanted, sizeof(int), MPI::BYTE, OVERMIND, MPI_ANY_TAG, status);
+        if (status.Get_tag() == MPI_Disconnect)
+            return;
+        if (status.Get_tag() != MPI_Filter)
+            continue;
+
+        pthread_mutex_lock(&snapshotLock);
+        while (generation < wanted)
+            pthread_cond_wait(&snapshotChanged, &snapshotLock);
+        serving = true;
+        pthread_mutex_unlock(&snapshotLock);
+
+        filter();
+
+        pthread_mutex_lock(&snapshotLock);
+        serving = false;
+        served = true;
+        pthread_cond_broadcast(&snapshotChanged);
+        pthread_mutex_unlock(&snapshotLock);
     }
 }
 
+void MD3Q19b::getProbe(int x, int y, int z, simProbe * probe)
+{
+    const Lattice & fields = snapshot[front];
+
+    if (!fields.inside(x, y, z)) {
+        probe->solid = true;
+        probe->density = 0.0;
+        probe->mv_x = probe->mv_y = probe->mv_z = 0.0;
+        return;
+    }
+
+    long n = fields.index(x, y, z);
+    probe->solid = fields.solid[n];
+    probe->density = fields.density[n];
+    probe->mv_x = fields.mv_x[n];
+    probe->mv_y = fields.mv_y[n];
+    probe->mv_z = fields.mv_z[n];
+}
+
+/*
+ * Our share of a volume sample: the grid points whose cell lies in our
+ * block, in grid order, as computePlanarSample() would rate them. Every
+ * worker gets the request, so they can all share their fields first if
+ * the points are to be interpolated.
+ */
+void MD3Q19b::sampleVolume(const volumeRequest * request, vector<double> &values)
+{
+    Lattice & fields = snapshot[front];
+
+    values.clear();
+
+    if (request->interpolate)
+        tracer.shareFields(&fields);
+
+    for (int k = 0; k < request->size[2]; k++) {
+        for (int j = 0; j < request->size[1]; j++) {
+            for (int i = 0; i < request->size[0]; i++) {
+                double p[3];
+                int cell[3];
+
+                volumePoint(request, i, j, k, p);
+                volumeCell(request, i, j, k, cell);
+
+                int x = cell[0] - origin[0], y = cell[1] - origin[1], z = cell[2] - origin[2];
+                if (!fields.inside(x, y, z))
+                    continue;
+
+                long n = fields.index(x, y, z);
+
+                if (fields.solid[n]) {
+                    values.push_back(MINFLOAT);
+                    continue;
+                }
+
+                double density = fields.density[n];
+                double m[3] = { fields.mv_x[n], fields.mv_y[n], fields.mv_z[n] };
+
+                if (request->interpolate)
+                    interpolate(p, &density, m);
+
+                switch (request->type) {
+                case SAMPLETYPE_VELOCITY:
+                    values.push_back(sqrt(m[0] * m[0] + m[1] * m[1] + m[2] * m[2]));
+                    break;
+                case SAMPLETYPE_PRESSURE:
+                    values.push_back(density / 3.0);
+                    break;
+                default:
+                    values.push_back(density);
+                }
+            }
+        }
+    }
+}
+
+/*
+ * Trilinear interpolation between the centres of the cells around p
+ * (global lattice coordinates, in a fluid cell of our block). Solid
+ * cells, which have no density in the ghost shell either, are left out
+ * and the weights of the others scaled up to make up for them.
+ */
+void MD3Q19b::interpolate(const double *p, double *density, double *m)
+{
+    const Lattice & fields = snapshot[front];
+    int c[3];
+    double w[3];
+
+    for (int a = 0; a < 3; a++) {
+        double q = p[a] - origin[a] - 0.5;
+
+        c[a] = (int) floor(q);
+        w[a] = q - c[a];
+    }
+
+    double weights = 0.0;
+
+    *density = m[0] = m[1] = m[2] = 0.0;
+
+    for (int k = 0; k < 8; k++) {
+        int x = c[0] + (k & 1), y = c[1] + ((k >> 1) & 1), z = c[2] + (k >> 2);
+        long n = fields.index(x, y, z);
+
+        if (fields.inside(x, y, z) ? fields.solid[n] : fields.density[n] <= 0.0)
+            continue;
+
+        double weight = (k & 1 ? w[0] : 1.0 - w[0]) * ((k >> 1) & 1 ? w[1] : 1.0 - w[1]) * (k >> 2 ? w[2] : 1.0 - w[2]);
+
+        weights += weight;
+        *density += weight * fields.density[n];
+        m[0] += weight * fields.mv_x[n];
+        m[1] += weight * fields.mv_y[n];
+        m[2] += weight * fields.mv_z[n];
+    }
+
+    // the cell of p itself always counts, with at least 1/8
+    *density /= weights;
+    m[0] /= weights;
+    m[1] /= weights;
+    m[2] /= weights;
+}
+
 void MD3Q19b::filter()
 {
     bool receiving = true;
     int size = 0;
+    MPI::Status status;
 
     while (receiving) {
         //cout << "\t\t\t Sim " << myrank << " is Listening" << endl;
         //receive commands or data
-        MPI::COMM_WORLD.Probe(OVERMIND, MPI_ANY_TAG, status);
+        sampling.Probe(OVERMIND, MPI_ANY_TAG, status);
 
         //cout << "\t\t\t MSG Received..." << status.Get_tag() << endl;
         //decide what to do by analysing the status tag
@@ -94,24 +285,18 @@ void MD3Q19b::filter()
         case MPI_Get_Cell:
             {
                 simCoord cell;
-                MPI::COMM_WORLD.Recv(&cell, sizeof(simCoord), MPI::BYTE, OVERMIND, MPI_Get_Cell, status);
+                sampling.Recv(&cell, sizeof(simCoord), MPI::BYTE, OVERMIND, MPI_Get_Cell, status);
 
-                cellData *data;
-                data = getCell(cell.x, cell.y, cell.z);
                 simProbe probe;
-                probe.solid = data->solid;
-                probe.density = data->density;
-                probe.mv_x = data->mv_x;
-                probe.mv_y = data->mv_y;
-                probe.mv_z = data->mv_z;
+                getProbe(cell.x, cell.y, cell.z, &probe);
 
-                MPI::COMM_WORLD.Send(&probe, sizeof(simProbe), MPI::BYTE, OVERMIND, MPI_Get_Cell);
+                sampling.Send(&probe, sizeof(simProbe), MPI::BYTE, OVERMIND, MPI_Get_Cell);
 
             }
             break;
         case MPI_Set_Req_Size:
             {
-                MPI::COMM_WORLD.Recv(&size, sizeof(int), MPI::BYTE, OVERMIND, MPI_ANY_TAG, status);
+                sampling.Recv(&size, sizeof(int), MPI::BYTE, OVERMIND, MPI_ANY_TAG, status);
 
                 if (size > receiveBuffer.bufferSize) {
                     delete[]receiveBuffer.cells;
@@ -120,9 +305,9 @@ void MD3Q19b::filter()
                     receiveBuffer.size = 0;
                 }
 
-                MPI::COMM_WORLD.Recv(receiveBuffer.cells, sizeof(bufferdata) * size, MPI::BYTE, OVERMIND, MPI_ANY_TAG, status);
+                sampling.Recv(receiveBuffer.cells, sizeof(bufferdata) * size, MPI::BYTE, OVERMIND, MPI_ANY_TAG, status);
 
-                MPI::COMM_WORLD.Send(&minmax, sizeof(minmax_t), MPI::BYTE, OVERMIND, MPI_Send_MinMax);
+                sampling.Send(&snapshotMinmax[front], sizeof(minmax_t), MPI::BYTE, OVERMIND, MPI_Send_MinMax);
 
                 receiveBuffer.size = size;
 
@@ -135,25 +320,53 @@ void MD3Q19b::filter()
 
                 for (; sendBuffer.size < receiveBuffer.size; sendBuffer.size++) {
                     bufferdata *data = &receiveBuffer.cells[sendBuffer.size];
-                    cellData *cell;
-                    cell = getCell(data->x, data->y, data->z);
-
-                    simProbe *sendProbe = &sendBuffer.probes[sendBuffer.size];
-                    sendProbe->density = cell->density;
-                    sendProbe->solid = cell->solid;
-                    sendProbe->mv_x = cell->mv_x;
-                    sendProbe->mv_y = cell->mv_y;
-                    sendProbe->mv_z = cell->mv_z;
+                    getProbe(data->x, data->y, data->z, &sendBuffer.probes[sendBuffer.size]);
                 }
 
-                MPI::COMM_WORLD.Send(&sendBuffer.size, sizeof(int), MPI::BYTE, OVERMIND, MPI_Set_Resp_Size);
+                sampling.Send(&sendBuffer.size, sizeof(int), MPI::BYTE, OVERMIND, MPI_Set_Resp_Size);
 
-                MPI::COMM_WORLD.Send(sendBuffer.probes, sizeof(simProbe) * sendBuffer.size, MPI::BYTE, OVERMIND, MPI_Get_Cells);
+                sampling.Send(sendBuffer.probes, sizeof(simProbe) * sendBuffer.size, MPI::BYTE, OVERMIND, MPI_Get_Cells);
+                break;
+            }
+        case MPI_Trace_Ribbons:
+            {
+                vector<unsigned char> request(status.Get_count(MPI::BYTE));
+                vector<traceVertex> vertices;
+
+                sampling.Recv(&request[0], request.size(), MPI::BYTE, OVERMIND, MPI_Trace_Ribbons, status);
+                tracer.trace(&snapshot[front], (traceRequest *) &request[0], (traceSeed *) (&request[0] + sizeof(traceRequest)), vertices);
+
+                sampling.Send(vertices.empty() ? NULL : &vertices[0], vertices.size() * sizeof(traceVertex), MPI::BYTE, OVERMIND, MPI_Trace_Ribbons);
+                break;
+            }
+        case MPI_Sample_Volume:
+            {
+                volumeRequest request;
+                vector<double> values;
+
+                sampling.Recv(&request, sizeof(volumeRequest), MPI::BYTE, OVERMIND, MPI_Sample_Volume, status);
+                sampleVolume(&request, values);
+
+                sampling.Gatherv(values.empty() ? NULL : &values[0], values.size(), MPI::DOUBLE, NULL, NULL, NULL, MPI::DOUBLE, OVERMIND);
+                break;
+            }
+        case MPI_Record_Point:
+            {
+                // every worker hears of every point, the owner answers
+                pointRequest request;
+                vector<pointWindow> windows;
+
+                sampling.Recv(&request, sizeof(pointRequest), MPI::BYTE, OVERMIND, MPI_Record_Point, status);
+
+                if (request.drop)
+                    recorder.forget(request.id);
+                else if (recorder.fetch(&snapshot[front], &request, windows))
+                    sampling.Send(windows.empty() ? NULL : &windows[0], windows.size() * sizeof(pointWindow), MPI::BYTE, OVERMIND, MPI_Record_Point);
                 break;
             }
         case MPI_Filter_Done:
             {
-                MPI::COMM_WORLD.Recv(NULL, 0, MPI::BYTE, OVERMIND, MPI_ANY_TAG, status);
+                sampling.Recv(NULL, 0, MPI::BYTE, OVERMIND, MPI_ANY_TAG, status);
                 receiving = false;
                 break;
             }
@@ -161,392 +374,255 @@ void MD3Q19b::filter()
     }
 
     // cout << "\t\t\t Filter..done! Waiting for synch..." << endl;
-    MPI::COMM_WORLD.Barrier();
+    sampling.Barrier();
 
 }
 
-void MD3Q19b::collision()
+/*
+ * One part of the step for the rows first <= r < last: with faces set
+ * the cells on the faces of the block, which is all of the rows at the
+ * y and z borders and the first and last cell of every other row,
+ * otherwise the cells inside of them.
+ */
+void MD3Q19b::collideRows(unsigned long first, unsigned long last, bool faces, minmax_t * minmax)
 {
-    minmax.min_density = MAXFLOAT;
-    minmax.max_density = MINFLOAT;
-    minmax.min_v = MAXFLOAT;
-    minmax.max_v = MINFLOAT;
-
-    // loop for collision with dimension-1 to avoid trying to write values to nirvana
-    for (unsigned int z = 0; z < max_z; z++) {
-        for (unsigned int y = 0; y < max_y; y++) {
-            for (unsigned int x = 0; x < max_x; x++) {
-                cellData *currentCell = getCell(x, y, z);
-
-                // if node is solid node do bounceback
-                if (currentCell->solid) {
-                    // Bounceback 
-
-                    for (int i = 1; i < 18; i += 2) {
-                        double t = currentCell->distributionValue[i];
-                        currentCell->distributionValue[i] = currentCell->distributionValue[i + 1];
-                        currentCell->distributionValue[i + 1] = t;
-                    }
-                } else {
-                    double *values = currentCell->distributionValue;
-                    double density = 0.;
-
-                    for (unsigned int i = 0; i < 19; i++) {
-                        density += values[i];
-                    }
-                    currentCell->density = (double) density;
-
-                    // macroskopic Velocities mv_x, mv_y, mv_z
-                    double mv_x = ((values[V1] + values[V7] + values[V9] + values[V11] + values[V13]) - (values[V2] + values[V8] + values[V10] + values[V12] + values[V14])) / density;
+    unsigned long r = first;
 
-                    double mv_y = ((values[V3] + values[V10] + values[V7] + values[V15] + values[V17]) - (values[V4] + values[V9] + values[V8] + values[V16] + values[V18])) / density;
+    while (r < last) {
+        unsigned int y = r % lattice.dim_y;
+        unsigned int z = r / lattice.dim_y;
 
-                    double mv_z = ((values[V5] + values[V14] + values[V11] + values[V15] + values[V18]) - (values[V6] + values[V13] + values[V12] + values[V16] + values[V17])) / density;
+        if (z == 0 || z == lattice.dim_z - 1) {
+            // a whole plane of border rows in one go
+            unsigned long end = min(last, (unsigned long) (z + 1) * lattice.dim_y);
 
+            if (faces)
+                streamCollide(&lattice, collide, tau_inv, r, end, minmax);
+            r = end;
+            continue;
+        }
 
-                    currentCell->mv_x = mv_x;
-                    currentCell->mv_y = mv_y;
-                    currentCell->mv_z = mv_z;
-
-                    //compute equilibrium distribution
-                    double square = mv_x * mv_x + mv_y * mv_y + mv_z * mv_z;
-                    double f_eq[19];
-
-                    if (!currentCell->solid) {
-                        if (density < minmax.min_density)
-                            minmax.min_density = density;
-                        if (density > minmax.max_density)
-                            minmax.max_density = density;
-                        if (square < minmax.min_v)
-                            minmax.min_v = square;
-                        if (square > minmax.max_v)
-                            minmax.max_v = square;
-                    }
-#define SQR(x) ((x) * (x))
-#define f0_i(cu) fix + (t_rho * (((cu) * 3.0) + (SQR((cu)) * 4.5)))
-
-                    // center
-                    // cu0 and cu0^2 is "0", thus just take the "fix" part
-                    f_eq[V0] = (density / 3.0) * (1.0 - (square * 1.5));
-
-                    // axis
-                    double t_rho = density / 18.0;
-                    // "fix" is constant within each of the following two blocks
-                    double fix = t_rho * (1.0 - (square * 1.5));
-                    // 1|2, 3|4, .. .just differ in the "(cu) * 3.0" term 
-                    // (it is added in 1,3,5, ... but subtraced in 2,4,6,...)
-                    // -> just subtract it twice from the first result
-                    double t_rho_6 = 6.0 * t_rho;
-                    f_eq[V1] = f0_i(mv_x);
-                    f_eq[V2] = f_eq[V1] - (t_rho_6 * mv_x);
-                    f_eq[V3] = f0_i(mv_y);
-                    f_eq[V4] = f_eq[V3] - (t_rho_6 * mv_y);
-                    f_eq[V5] = f0_i(mv_z);
-                    f_eq[V6] = f_eq[V5] - (t_rho_6 * mv_z);
-
-                    // diagonal
-                    t_rho = density / 36.0;
-                    fix = t_rho * (1.0 - (square * 1.5));
-                    t_rho_6 = 6.0 * t_rho;
-                    f_eq[V7] = f0_i(mv_x + mv_y);
-                    f_eq[V8] = f_eq[V7] - (t_rho_6 * (mv_x + mv_y));
-                    f_eq[V9] = f0_i(mv_x - mv_y);
-                    f_eq[V10] = f_eq[V9] - (t_rho_6 * (mv_x - mv_y));
-                    f_eq[V11] = f0_i(mv_x + mv_z);
-                    f_eq[V12] = f_eq[V11] - (t_rho_6 * (mv_x + mv_z));
-                    f_eq[V13] = f0_i(mv_x - mv_z);
-                    f_eq[V14] = f_eq[V13] - (t_rho_6 * (mv_x - mv_z));
-                    f_eq[V15] = f0_i(mv_y + mv_z);
-                    f_eq[V16] = f_eq[V15] - (t_rho_6 * (mv_y + mv_z));
-                    f_eq[V17] = f0_i(mv_y - mv_z);
-                    f_eq[V18] = f_eq[V17] - (t_rho_6 * (mv_y - mv_z));
-
-#undef f0_i
-#undef SQR
-
-                    // relaxation
-                    for (int i = 0; i < 19; i++) {
-                        currentCell->distributionValue[i] = (double)
-                            (currentCell->distributionValue[i] + tau_inv * (f_eq[i] - currentCell->distributionValue[i]));
-                    }
-                }
-            }
-            //cout << "====================================" << endl;
+        if (y == 0 || y == lattice.dim_y - 1) {
+            if (faces)
+                streamCollide(&lattice, collide, tau_inv, r, r + 1, minmax);
+        } else if (faces) {
+            streamCollide(&lattice, collide, tau_inv, r, r + 1, 0, 1, minmax);
+            if (lattice.dim_x > 1)
+                streamCollide(&lattice, collide, tau_inv, r, r + 1, lattice.dim_x - 1, lattice.dim_x, minmax);
+        } else if (lattice.dim_x > 2) {
+            streamCollide(&lattice, collide, tau_inv, r, r + 1, 1, lattice.dim_x - 1, minmax);
         }
+        r++;
     }
-    // cout << "\x1b[2J";
-    // cout << "\t\t\t Collision..done! Waiting for synch..." << endl;
-    MPI::COMM_WORLD.Barrier();
 }
 
-void MD3Q19b::propagate()
+void MD3Q19b::facesMember(void *model, int member, int members)
 {
-    // cout << "\t\t\tpropagation...synch" << endl;
-    MPI::COMM_WORLD.Barrier();
+    MD3Q19b *m = (MD3Q19b *) model;
+    minmax_t *minmax = &m->memberMinmax[member];
+    unsigned long first, last;
 
+    minmax->min_density = MAXFLOAT;
+    minmax->max_density = MINFLOAT;
+    minmax->min_v = MAXFLOAT;
+    minmax->max_v = MINFLOAT;
 
-    //new propagtion for testin purposes.
-    //Propagate without copyfield
-    // TtB:
+    ThreadTeam::split(m->lattice.rows(), member, members, &first, &last);
+    m->collideRows(first, last, true, minmax);
+}
 
-    cellData *next;
-    bufferData *bnext;
-    cellData *current;
+void MD3Q19b::interiorMember(void *model, int member, int members)
+{
+    MD3Q19b *m = (MD3Q19b *) model;
+    unsigned long first, last;
 
-    // backward
-    for (unsigned int z = 1; z < max_z; z++) {
-        for (unsigned int y = 1; y < max_y; y++) {
-            for (unsigned int x = 0; x < max_x; x++) {
-                current = getCell(x, y, z);
-
-//                              cout << x << ":" << y << ":" << z << "|";
-//                              cout << current->solid << "|";                  
-                if (x == 0) {
-                    //fields going into left buffer
-                    // 2
-                    bnext = getBCell(LEFT, y, z);
-                    bnext->distributionValue[B2] = current->distributionValue[V2];
-
-                    // 8
-                    bnext = getBCell(LEFT, y - 1, z);
-                    bnext->distributionValue[B8] = current->distributionValue[V8];
-                    // 12
-                    bnext = getBCell(LEFT, y, z - 1);
-                    bnext->distributionValue[B12] = current->distributionValue[V12];
-
-                } else {
-                    // 2
-                    next = getCell(x - 1, y, z);
-                    next->distributionValue[V2] = current->distributionValue[V2];
-                    // 8
-                    next = getCell(x - 1, y - 1, z);
-                    next->distributionValue[V8] = current->distributionValue[V8];
-                    // 12
-                    next = getCell(x - 1, y, z - 1);
-                    next->distributionValue[V12] = current->distributionValue[V12];
-                }
+    ThreadTeam::split(m->lattice.rows(), member, members, &first, &last);
+    m->collideRows(first, last, false, &m->memberMinmax[member]);
+}
 
+void MD3Q19b::touchMember(void *model, int member, int members)
+{
+    MD3Q19b *m = (MD3Q19b *) model;
+    unsigned long first, last;
 
-                if (x == max_x - 1) {
-                    // 9
-                    bnext = getBCell(RIGHT, y - 1, z);
-                    bnext->distributionValue[B9] = current->distributionValue[V9];
-                    // 13
-                    bnext = getBCell(RIGHT, y, z - 1);
-                    bnext->distributionValue[B13] = current->distributionValue[V13];
+    // same split as in facesMember(), so every member finds its rows in
+    // memory local to it
+    ThreadTeam::split(m->lattice.rows(), member, members, &first, &last);
+    m->lattice.touch(first, last);
+}
 
-                } else {
-                    // 9
-                    next = getCell(x + 1, y - 1, z);
-                    next->distributionValue[V9] = current->distributionValue[V9];
+void MD3Q19b::setThreads(int threads)
+{
+    if (threads < 1 || threads == team.size())
+        return;
 
-                    // 13
-                    next = getCell(x + 1, y, z - 1);
-                    next->distributionValue[V13] = current->distributionValue[V13];
-                }
+    team.resize(threads);
+    memberMinmax.resize(team.size());
 
-                // 4
-                next = getCell(x, y - 1, z);
-                next->distributionValue[V4] = current->distributionValue[V4];
-                // 6
-                next = getCell(x, y, z - 1);
-                next->distributionValue[V6] = current->distributionValue[V6];
-                // 16
-                next = getCell(x, y - 1, z - 1);
-                next->distributionValue[V16] = current->distributionValue[V16];
-                // 17
-                next = getCell(x, y + 1, z - 1);
-                next->distributionValue[V17] = current->distributionValue[V17];
-            }
-        }
-    }
+    if (myrank == 1)
+        cout << "\t\t\t Threads per Sim: " << team.size() << endl;
+}
 
-    // forward
-    for (int z = (int)max_z - 2; z >= 0; z--) {
-        for (int y = (int)max_y - 2; y >= 0; y--) {
-            for (int x = (int)max_x - 1; x >= 0; x--) {
-                current = getCell(x, y, z);
-
-//                              cout << x << ":" << y << ":" << z << "|";
-//                              cout << current->solid << "|";                  
-
-                if ((unsigned int) x == max_x - 1) {
-                    //fields going into right buffer
-                    // 1
-                    bnext = getBCell(RIGHT, y, z);
-                    bnext->distributionValue[B1] = current->distributionValue[V1];
-                    // 7
-                    bnext = getBCell(RIGHT, y + 1, z);
-                    bnext->distributionValue[B7] = current->distributionValue[V7];
-                    // 11
-                    bnext = getBCell(RIGHT, y, z + 1);
-                    bnext->distributionValue[B11] = current->distributionValue[V11];
-
-                } else {
-                    // 1
-                    next = getCell(x + 1, y, z);
-                    next->distributionValue[V1] = current->distributionValue[V1];
-                    // 7
-                    next = getCell(x + 1, y + 1, z);
-                    next->distributionValue[V7] = current->distributionValue[V7];
-                    // 11
-                    next = getCell(x + 1, y, z + 1);
-                    next->distributionValue[V11] = current->distributionValue[V11];
-                }
-                if (x == 0) {
-                    //fields going into LEFT buffer
-                    // 10
-                    bnext = getBCell(LEFT, y + 1, z);
-                    bnext->distributionValue[B10] = current->distributionValue[V10];
-                    // 14
-                    bnext = getBCell(LEFT, y, z + 1);
-                    bnext->distributionValue[B14] = current->distributionValue[V14];
-                } else {
-                    // 10
-                    next = getCell(x - 1, y + 1, z);
-                    next->distributionValue[V10] = current->distributionValue[V10];
-                    // 14
-                    next = getCell(x - 1, y, z + 1);
-                    next->distributionValue[V14] = current->distributionValue[V14];
-                }
-                // 15
-                next = getCell(x, y + 1, z + 1);
-                next->distributionValue[V15] = current->distributionValue[V15];
-                // 18
-                next = getCell(x, y - 1, z + 1);
-                next->distributionValue[V18] = current->distributionValue[V18];
-                // 3
-                next = getCell(x, y + 1, z);
-                next->distributionValue[V3] = current->distributionValue[V3];
-                // 5
-                next = getCell(x, y, z + 1);
-                next->distributionValue[V5] = current->distributionValue[V5];
-            }
-        }
+/*
+ * The cells on the faces of the block go first, so the halo can be on
+ * its way while the interior collides. The workers only meet through
+ * the halo, the overmind needs no barrier to keep them in step.
+ */
+void MD3Q19b::step()
+{
+    team.run(facesMember, this);
+    halo.start(&lattice, !lattice.parity);
+    team.run(interiorMember, this);
+    lattice.parity = !lattice.parity;
+
+    minmax = memberMinmax[0];
+    for (unsigned int k = 1; k < memberMinmax.size(); k++) {
+        if (memberMinmax[k].min_density < minmax.min_density)
+            minmax.min_density = memberMinmax[k].min_density;
+        if (memberMinmax[k].max_density > minmax.max_density)
+            minmax.max_density = memberMinmax[k].max_density;
+        if (memberMinmax[k].min_v < minmax.min_v)
+            minmax.min_v = memberMinmax[k].min_v;
+        if (memberMinmax[k].max_v > minmax.max_v)
+            minmax.max_v = memberMinmax[k].max_v;
     }
 
+    // the channel is closed into a ring over x: the fields leaving it at
+    // the outlet are accelerated on their way into the inlet and v.v.
+    bool inlet = origin[0] == 0;
+    bool outlet = origin[0] + (int) max_x == decomp.size[0];
 
+    if (outlet)
+        decideFW();
 
-    //call the redistribution/acceleration in the first slice
-    if (myrank == 1) {
-        accelerateBW();
-    }
+    halo.finish(&lattice);
 
-    if (myrank == nprocs - 1) {
+    if (outlet)
+        accelerateBW();
+    if (inlet)
         accelerateFW();
-    }
-    // cout << "\t\t\t Propagation..done! Waiting for synch..." << endl;
-    MPI::COMM_WORLD.Barrier();
-    int size = max_y * max_z * sizeof(bufferData);
+    if (outlet)
+        accelRequest.Wait();
 
+    recorder.record(&lattice);
+}
 
-    for (unsigned int n = 0; n < 2; n++) {
-        if (n) {
-            // cout << "\t\t\t EVEN Propagation..done! Waiting for synch..." << endl;
-            MPI::COMM_WORLD.Barrier();
-        }
-        //let even ranks send Buffer first and odd receive
-        if ((!n && !(myrank & 1)) || (n && (myrank & 1))) {
-            MPI::COMM_WORLD.Send(bufferLeft, size, MPI::BYTE, leftNB, MPI_Data_IncRight);
-            MPI::COMM_WORLD.Send(bufferRight, size, MPI::BYTE, rightNB, MPI_Data_IncLeft);
-        } else {
-            int receiving = 2;
-            while (receiving) {
-
-                // cout << "\t\t\t Sim " << myrank << " is Listening" << endl;
-                //receive commands or data
-                MPI::COMM_WORLD.Probe(MPI_ANY_SOURCE, MPI_ANY_TAG, status);
-                if (status.Get_tag() == MPI_Data_IncRight || status.Get_tag() == MPI_Data_IncLeft) {
-                    MPI::COMM_WORLD.Recv(buffer, size, MPI::BYTE, MPI_ANY_SOURCE, MPI_ANY_TAG, status);
-                    // cout << "\t\t\t MSG Received..." << status.Get_tag() << endl;
-                    //decide what to do by analysing the status tag
-                    switch (status.Get_tag()) {
-                    case MPI_Data_IncLeft:
-                        for (unsigned int y = 0; y < max_y; y++) {
-                            for (unsigned int z = 0; z < max_z; z++) {
-                                //fields going to right domain
-                                // 1
-                                getCell(0, y, z)->distributionValue[V1] = getCell(buffer, y, z)->distributionValue[B1];
-                                // 7
-                                getCell(0, y, z)->distributionValue[V7] = getCell(buffer, y, z)->distributionValue[B7];
-                                // 9
-                                getCell(0, y, z)->distributionValue[V9] = getCell(buffer, y, z)->distributionValue[B9];
-                                // 11
-                                getCell(0, y, z)->distributionValue[V11] = getCell(buffer, y, z)->distributionValue[B11];
-                                // 13
-                                getCell(0, y, z)->distributionValue[V13] = getCell(buffer, y, z)->distributionValue[B13];
-
-                            }
-                        }
+/*
+ * Where the collided f_i which crosses into the cell x,y,z with this
+ * step waits for it. Once the halo is exchanged the cell reads it from
+ * there, even if it comes from a neighbour's block.
+ */
+double *MD3Q19b::incoming(int i, int x, int y, int z)
+{
+    return collided(&lattice, i, lattice.index(x - lattice_e[i][0], y - lattice_e[i][1], z - lattice_e[i][2]));
+}
 
-                        receiving--;
-                        break;
-
-                    case MPI_Data_IncRight:
-                        for (unsigned int y = 0; y < max_y; y++) {
-                            for (unsigned int z = 0; z < max_z; z++) {
-                                //fields going to left domain
-                                // 2
-                                getCell(max_x - 1, y, z)->distributionValue[V2] = getCell(buffer, y, z)->distributionValue[B2];
-                                // 8
-                                getCell(max_x - 1, y, z)->distributionValue[V8] = getCell(buffer, y, z)->distributionValue[B8];
-                                // 10
-                                getCell(max_x - 1, y, z)->distributionValue[V10] = getCell(buffer, y, z)->distributionValue[B10];
-                                // 12
-                                getCell(max_x - 1, y, z)->distributionValue[V12] = getCell(buffer, y, z)->distributionValue[B12];
-                                // 14
-                                getCell(max_x - 1, y, z)->distributionValue[V14] = getCell(buffer, y, z)->distributionValue[B14];
-                            }
-                        }
+/*
+ * Local rows of our block which get accelerated: all of the channel
+ * but the walls at the y and z borders.
+ */
+bool MD3Q19b::accelRange(unsigned int *y0, unsigned int *y1, unsigned int *z0, unsigned int *z1)
+{
+    int lo_y = max(1 - origin[1], 0);
+    int hi_y = min(decomp.size[1] - 1 - origin[1], (int) max_y);
+    int lo_z = max(1 - origin[2], 0);
+    int hi_z = min(decomp.size[2] - 1 - origin[2], (int) max_z);
+
+    if (lo_y >= hi_y || lo_z >= hi_z)
+        return false;
+
+    *y0 = lo_y;
+    *y1 = hi_y;
+    *z0 = lo_z;
+    *z1 = hi_z;
+    return true;
+}
 
-                        receiving--;
-                        break;
-                    }
-                }
+void MD3Q19b::accelerateBW()
+{
+    //process acceleration on the fields leaving the inlet to the left,
+    //i.e. arriving at the outlet
+    unsigned int y0, y1, z0, z1;
+
+    if (!accelRange(&y0, &y1, &z0, &z1))
+        return;
+
+    for (unsigned int y = y0; y < y1; y++) {
+        for (unsigned int z = z0; z < z1; z++) {
+            double *c2 = incoming(V2, max_x - 1, y, z);
+            double *c8 = incoming(V8, max_x - 1, y, z);
+            double *c10 = incoming(V10, max_x - 1, y, z);
+            double *c12 = incoming(V12, max_x - 1, y, z);
+            double *c14 = incoming(V14, max_x - 1, y, z);
+
+            if (*c2 - t1_accel > 0 && *c8 - t2_accel > 0 && *c10 - t2_accel > 0 && *c12 - t2_accel > 0 && *c14 - t2_accel > 0) {
+
+                *c2 += (double) -t1_accel;
+                *c8 += (double) -t2_accel;
+                *c10 += (double) -t2_accel;
+                *c12 += (double) -t2_accel;
+                *c14 += (double) -t2_accel;
             }
         }
     }
-
-    // cout << "\t\t\t ODD Propagation..done! Waiting for synch..." << endl;
-    MPI::COMM_WORLD.Barrier();
 }
 
-void MD3Q19b::accelerateBW()
+/*
+ * The FW acceleration depends on the outlet cells but changes what
+ * arrives at the inlet; the outlet decides before the halo exchange
+ * (while the values are still its own) and tells the inlet block of
+ * its row.
+ */
+void MD3Q19b::decideFW()
 {
-    //process acceleration on sim 1 left buffer
+    unsigned int y0, y1, z0, z1;
 
-    for (unsigned int y = 1; y < max_y - 1; y++) {
-        for (unsigned int z = 1; z < max_z - 1; z++) {
-            bufferData *c = getBCell(0, y, z);
+    if (!accelRange(&y0, &y1, &z0, &z1))
+        return;
 
-            if (c->distributionValue[B2] - t1_accel > 0 && c->distributionValue[B8] - t2_accel > 0 && c->distributionValue[B10] - t2_accel > 0 && c->distributionValue[B12] - t2_accel > 0 && c->distributionValue[B14] - t2_accel > 0) {
+    accelOut.resize((y1 - y0) * (z1 - z0));
 
-                c->distributionValue[B2] += (double) -t1_accel;
-                c->distributionValue[B8] += (double) -t2_accel;
-                c->distributionValue[B10] += (double) -t2_accel;
-                c->distributionValue[B12] += (double) -t2_accel;
-                c->distributionValue[B14] += (double) -t2_accel;
-            }
+    unsigned char *flag = &accelOut[0];
+    for (unsigned int y = y0; y < y1; y++) {
+        for (unsigned int z = z0; z < z1; z++) {
+            long n = lattice.index(max_x - 1, y, z);
+
+            *flag++ = *collided(&lattice, V2, n) - t1_accel > 0 && *collided(&lattice, V8, n) - t2_accel > 0 && *collided(&lattice, V10, n) - t2_accel > 0 && *collided(&lattice, V12, n) - t2_accel > 0 && *collided(&lattice, V14, n) - t2_accel > 0;
         }
     }
-}
-void MD3Q19b::accelerateFW()
-{
-    //process acceleration on sim 1 left buffer
-
-    for (unsigned int y = 1; y < max_y - 1; y++) {
-        for (unsigned int z = 1; z < max_z - 1; z++) {
-            bufferData *c = getBCell(1, y, z);
-            cellData *c2 = getCell(max_x - 1, y, z);
 
-            if (c2->distributionValue[V2] - t1_accel > 0 && c2->distributionValue[V8] - t2_accel > 0 && c2->distributionValue[V10] - t2_accel > 0 && c2->distributionValue[V12] - t2_accel > 0 && c2->distributionValue[V14] - t2_accel > 0) {
+    int c[3], shift;
+    static const int right[3] = { 1, 0, 0 };
 
+    decomp.coords(myrank, c);
+    accelRequest = MPI::COMM_WORLD.Isend(&accelOut[0], accelOut.size(), MPI::BYTE, decomp.neighbour(c, right, &shift), MPI_Data_Accel);
+}
 
-                c->distributionValue[B1] += (double) t1_accel;
-                c->distributionValue[B7] += (double) t2_accel;
-                c->distributionValue[B9] += (double) t2_accel;
-                c->distributionValue[B11] += (double) t2_accel;
-                c->distributionValue[B13] += (double) t2_accel;
+void MD3Q19b::accelerateFW()
+{
+    //process acceleration on the fields leaving the outlet to the right,
+    //i.e. arriving at the inlet
+    unsigned int y0, y1, z0, z1;
+
+    if (!accelRange(&y0, &y1, &z0, &z1))
+        return;
+
+    int c[3], shift;
+    static const int left[3] = { -1, 0, 0 };
+
+    decomp.coords(myrank, c);
+    accelIn.resize((y1 - y0) * (z1 - z0));
+    MPI::COMM_WORLD.Recv(&accelIn[0], accelIn.size(), MPI::BYTE, decomp.neighbour(c, left, &shift), MPI_Data_Accel, status);
+
+    unsigned char *flag = &accelIn[0];
+    for (unsigned int y = y0; y < y1; y++) {
+        for (unsigned int z = z0; z < z1; z++) {
+            if (*flag++) {
+                *incoming(V1, 0, y, z) += (double) t1_accel;
+                *incoming(V7, 0, y, z) += (double) t2_accel;
+                *incoming(V9, 0, y, z) += (double) t2_accel;
+                *incoming(V11, 0, y, z) += (double) t2_accel;
+                *incoming(V13, 0, y, z) += (double) t2_accel;
             }
         }
     }
@@ -574,6 +650,7 @@ void MD3Q19b::listenForCommand()
             {
                 MPI::COMM_WORLD.Send(NULL, 0, MPI::BYTE, OVERMIND, MPI_Ack);
                 waitForUpdatedArea();
+                refreshSnapshot();
                 // cout << "\t\t\t Sim " << myrank << " waiting for synch..." << endl;
                 MPI::COMM_WORLD.Barrier();
                 // cout << "\t Sim " << myrank << " synched!";
@@ -595,6 +672,7 @@ void MD3Q19b::listenForCommand()
                 envi.accel = 0.;
                 envi.dense = 0.;
                 envi.relax = 0.;
+                envi.threads = 0;
 
                 MPI::COMM_WORLD.Recv(&envi, sizeof(enviroment), MPI::BYTE, OVERMIND, MPI_Update_Enviroment, status);
                 if ((status.Get_tag() == MPI_Update_Enviroment)
@@ -613,30 +691,30 @@ void MD3Q19b::listenForCommand()
                 t1_accel = stdAcceleration * stdDensity / 18.;
                 t2_accel = stdAcceleration * stdDensity / 36.;
 
+                setThreads(envi.threads);
+
                 // cout << "\t\t\t Sim " << myrank << " waiting for synch..." << endl;
                 MPI::COMM_WORLD.Barrier();
                 // cout << "\t Sim " << myrank << " synched!";
                 break;
             }
-        case MPI_Model_Propagate:
-            {
-                // sleep(10);
-                // MPI::COMM_WORLD.Send(NULL, 0, MPI::BYTE, OVERMIND, MPI_Ack);
-                propagate();
-                break;
-            }
-        case MPI_Model_Collision:
+        case MPI_Model_Step:
             {
-                // MPI::COMM_WORLD.Send(NULL, 0, MPI::BYTE, OVERMIND, MPI_Ack);
-                collision();
+                // no snapshot, the samples show the end of the last run
+                step();
                 break;
             }
-        case MPI_Filter:
+        case MPI_Model_Run:
             {
-                // MPI::COMM_WORLD.Send(NULL, 0, MPI::BYTE, OVERMIND, MPI_Ack);
-                filter();
+                // a whole update interval at once, the neighbours are all
+                // that paces us until the overmind calls again
+                int count = 0;
+                MPI::COMM_WORLD.Recv(&count, sizeof(int), MPI::BYTE, OVERMIND, MPI_Model_Run, status);
+
+                for (int k = 0; k < count; k++)
+                    step();
+                publish();
                 break;
-
             }
         default:
             {
@@ -655,7 +733,6 @@ void MD3Q19b::waitForUpdatedArea()
     bool receiving = true;
 
     while (receiving) {
-        cellData *currentCell;
         bufferdata data;
         //cout << "\t\t\t Sim " << myrank << " is Listening" << endl;
         //receive commands or data
@@ -667,23 +744,39 @@ void MD3Q19b::waitForUpdatedArea()
         case MPI_Update_Field:
             {
                 MPI::COMM_WORLD.Recv(&data, sizeof(bufferdata), MPI::BYTE, OVERMIND, MPI_Update_Field, status);
-                currentCell = getCell(data.x, data.y, data.z);
-                if (!currentCell->solid) {
-                    currentCell->solid = 1;
-                } else {
-                    currentCell->solid = 0;
-                }
+                if (!lattice.inside(data.x, data.y, data.z))
+                    break;
 
-                currentCell->density = stdDensity;
-                double *values = currentCell->distributionValue;
+                long n = lattice.index(data.x, data.y, data.z);
+                lattice.solid[n] = !lattice.solid[n];
+                initCell(n);
+                break;
+            }
+        case MPI_Update_Bulk:
+            {
+                vector<unsigned char> packed(status.Get_count(MPI::BYTE));
+                vector<unsigned char> changed(lattice.rows() * max_x);
 
-                values[0] = t0;
-                unsigned int i;
-                for (i = 1; i <= 6; i++)
-                    values[i] = t1;
-                for (i = 7; i <= 18; i++)
-                    values[i] = t2;
+                MPI::COMM_WORLD.Recv(&packed[0], packed.size(), MPI::BYTE, OVERMIND, MPI_Update_Bulk, status);
+                if (!decodeVoxels(&packed[0], packed.size(), &changed[0], changed.size())) {
+                    cerr << "\t\t\t Sim " << myrank << ": malformed voxel update" << endl;
+                    break;
+                }
 
+                unsigned char *c = &changed[0];
+                for (unsigned long r = 0; r < lattice.rows(); r++, c += max_x) {
+                    // rows without a change are the common case
+                    if (!memchr(c, 1, max_x))
+                        continue;
+
+                    long n = lattice.index(0, r % max_y, r / max_y);
+                    for (unsigned int x = 0; x < max_x; x++) {
+                        if (c[x]) {
+                            lattice.solid[n + x] = !lattice.solid[n + x];
+                            initCell(n + x);
+                        }
+                    }
+                }
                 break;
             }
         case MPI_Update_Field_Done:
@@ -703,15 +796,15 @@ void MD3Q19b::waitForArea()
 
     // cout << "\t\t\t MSG Received...(" << myrank << ") " << status.Get_tag() << endl;
 
-    max_x = field.dim_x;
-    max_y = field.dim_y;
-    max_z = field.dim_z;
-    if (cellDataModel)
-        delete[]cellDataModel;
-    cellDataModel = new cellData[max_x * max_y * max_z];
-    for (unsigned int i = 0; i < max_x * max_y * max_z; i++) {
-        initCell(&cellDataModel[i]);
-    }
+    int dim[3];
+    decomp.setup(field.dim_x, field.dim_y, field.dim_z, field.procs_x, field.procs_y, field.procs_z);
+    decomp.box(myrank, origin, dim);
+
+    max_x = dim[0];
+    max_y = dim[1];
+    max_z = dim[2];
+    lattice.allocate(max_x, max_y, max_z);
+    team.run(touchMember, this);
 
     while (receiving) {
         bufferdata data;
@@ -724,9 +817,26 @@ void MD3Q19b::waitForArea()
         switch (status.Get_tag()) {
         case MPI_Field:
             MPI::COMM_WORLD.Recv(&data, sizeof(bufferdata), MPI::BYTE, OVERMIND, MPI_ANY_TAG, status);
-            getCell(data.x, data.y, data.z)->solid = 1;
+            if (lattice.inside(data.x, data.y, data.z))
+                lattice.solid[lattice.index(data.x, data.y, data.z)] = 1;
             break;
 
+        case MPI_Field_Bulk:
+            {
+                vector<unsigned char> packed(status.Get_count(MPI::BYTE));
+                vector<unsigned char> mask(lattice.rows() * max_x);
+
+                MPI::COMM_WORLD.Recv(&packed[0], packed.size(), MPI::BYTE, OVERMIND, MPI_Field_Bulk, status);
+                if (!decodeVoxels(&packed[0], packed.size(), &mask[0], mask.size())) {
+                    cerr << "\t\t\t Sim " << myrank << ": malformed voxel slice" << endl;
+                    break;
+                }
+
+                for (unsigned long r = 0; r < lattice.rows(); r++)
+                    memcpy(lattice.solid + lattice.index(0, r % max_y, r / max_y), &mask[r * max_x], max_x);
+                break;
+            }
+
         case MPI_Field_Done:
             MPI::COMM_WORLD.Recv(NULL, 0, MPI::BYTE, OVERMIND, MPI_ANY_TAG, status);
             receiving = false;
@@ -734,66 +844,53 @@ void MD3Q19b::waitForArea()
         }
     }
 
-    cellData *currentCell;
-    for (unsigned int x = 0; x < max_x; x++) {
+    for (unsigned int z = 0; z < max_z; z++) {
         for (unsigned int y = 0; y < max_y; y++) {
-            for (unsigned int z = 0; z < max_z; z++) {
-                currentCell = getCell(x, y, z);
-                if ((z < 1 || z > max_z - 2 || y < 1 || y > max_y - 2))
-                    currentCell->solid = true;
-
-                currentCell->density = stdDensity;
-                double *values = currentCell->distributionValue;
-
-                values[0] = t0;
-                unsigned int i;
-                for (i = 1; i <= 6; i++)
-                    values[i] = t1;
-                for (i = 7; i <= 18; i++)
-                    values[i] = t2;
+            for (unsigned int x = 0; x < max_x; x++) {
+                long n = lattice.index(x, y, z);
+                int global_y = origin[1] + y;
+                int global_z = origin[2] + z;
+
+                if (global_z < 1 || global_z > decomp.size[2] - 2 || global_y < 1 || global_y > decomp.size[1] - 2)
+                    lattice.solid[n] = 1;
+
+                initCell(n);
             }
         }
     }
 
-    allocateBuffers();
+    halo.setup(&lattice, &decomp, myrank);
 
-//      MPI::COMM_WORLD.Send(NULL, 0, MPI::BYTE, 0, MPI_Ack);
-    cout << "\t\t\t Area Set: Dimension, " << max_x << ":" << max_y << ":" << max_z << endl;
-}
+    pthread_mutex_lock(&snapshotLock);
+    while (serving)
+        pthread_cond_wait(&snapshotChanged, &snapshotLock);
 
-void MD3Q19b::allocateBuffers()
-{
-    if (bufferLeft)
-        delete[]bufferLeft;
-    if (bufferRight)
-        delete[]bufferRight;
-    if (buffer)
-        delete[]buffer;
-    bufferLeft = new bufferData[max_y * max_z];
-    bufferRight = new bufferData[max_y * max_z];
-    buffer = new bufferData[max_y * max_z];
-
-    for (unsigned int i = 0; i < max_y * max_z; i++) {
-        initBCell(&bufferLeft[i]);
-        initBCell(&bufferRight[i]);
-        initBCell(&buffer[i]);
-    }
-}
+    snapshot[0].allocateFields(max_x, max_y, max_z);
+    snapshot[1].allocateFields(max_x, max_y, max_z);
+    front = 0;
+    generation = 0;
+    served = true;
+    snapshot[front].copyFields(&lattice);
+    snapshotMinmax[front] = minmax;
 
-void MD3Q19b::initBCell(bufferData * cell)
-{
-    double *values = cell->distributionValue;
+    tracer.setup(&decomp, myrank, sampling);
+    recorder.setup(origin);
+    pthread_mutex_unlock(&snapshotLock);
 
-    for (unsigned int i = 0; i < 5; i++)
-        values[i] = 0.0;
+//      MPI::COMM_WORLD.Send(NULL, 0, MPI::BYTE, 0, MPI_Ack);
+    cout << "\t\t\t Area Set: Dimension, " << max_x << ":" << max_y << ":" << max_z << " at " << origin[0] << ":" << origin[1] << ":" << origin[2] << endl;
 }
 
-void MD3Q19b::initCell(cellData * cell)
+void MD3Q19b::initCell(long n)
 {
-    cell->solid = false;
-    cell->density = 0.0;
-    double *values = cell->distributionValue;
-
-    for (unsigned int i = 0; i <= 18; i++)
-        values[i] = 0.0;
+    lattice.density[n] = stdDensity;
+
+    // where the cell reads its f_i from in the next step (see incoming()),
+    // after an even step that may be a ghost copy of a neighbour's cell
+    *collided(&lattice, 0, n) = t0;
+    unsigned int i;
+    for (i = 1; i <= 6; i++)
+        *collided(&lattice, i, n - lattice.offset(i)) = t1;
+    for (i = 7; i <= 18; i++)
+        *collided(&lattice, i, n - lattice.offset(i)) = t2;
 }
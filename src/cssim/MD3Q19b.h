@@ -1,6 +1,14 @@
 #include <vector>
 #include <mpi.h>
+#include <pthread.h>
 #include "types.h"
+#include "Lattice.h"
+#include "Collision.h"
+#include "ThreadTeam.h"
+#include "Decomposition.h"
+#include "Halo.h"
+#include "Tracer.h"
+#include "PointRecorder.h"
 
 class MD3Q19b
 {
@@ -10,8 +18,7 @@ public:
 	
 	virtual ~MD3Q19b();
 	
-	void collision();
-	void propagate();
+	void step();
 	void filter();
 
 	double getPressure(int x, int y, int z);
@@ -23,10 +30,39 @@ private:
 	unsigned int max_y;
 	unsigned int max_z;
 
-	cellData *cellDataModel;
-	bufferData *bufferLeft;
-	bufferData *bufferRight;
-	bufferData *buffer;
+	Lattice lattice;
+	collisionKernel collide;
+	const char *collideName;
+
+	// splits the rows of the slice, every member widens its own minmax
+	ThreadTeam team;
+	vector<minmax_t> memberMinmax;
+
+	// which block of the lattice is ours and how to reach the neighbours
+	Decomposition decomp;
+	int origin[3];
+	Halo halo;
+	Tracer tracer;
+	PointRecorder recorder;
+
+	// the samples are taken from a copy of the fields made after every
+	// run, on a communicator of their own, while the solver steps on
+	// (see publish() and serve())
+	MPI::Intracomm sampling;
+	pthread_t sampler;
+	Lattice snapshot[2];
+	minmax_t snapshotMinmax[2];
+	int front;			// the one the sampler reads
+	int generation;		// runs since the area was set, front included
+	bool served;		// the overmind has filtered the front one
+	bool serving;
+	pthread_mutex_t snapshotLock;
+	pthread_cond_t snapshotChanged;
+
+	// FW acceleration, decided at the outlet, applied at the inlet
+	vector<unsigned char> accelOut;
+	vector<unsigned char> accelIn;
+	MPI::Request accelRequest;
 
 	sendBufferInfo receiveBuffer;
 	receiveBufferInfo sendBuffer;
@@ -51,45 +87,30 @@ private:
 	MPI::Status status;
 	bufferdata data;
 
-	cellData *outOfBounds;
-	
-	int leftNB, rightNB;
+	void publish();
+	void refreshSnapshot();
+	static void *startSampler(void *model);
+	void serve();
+
+	void getProbe(int x, int y, int z, simProbe *probe);
+	void sampleVolume(const volumeRequest *request, vector<double> &values);
+	void interpolate(const double *p, double *density, double *m);
+	void initCell(long n);
+
+	void collideRows(unsigned long first, unsigned long last, bool faces, minmax_t *minmax);
+	static void facesMember(void *model, int member, int members);
+	static void interiorMember(void *model, int member, int members);
+	static void touchMember(void *model, int member, int members);
+	void setThreads(int threads);
 
-	cellData* getCell(int x, int y, int z) { 
-		if(x < 0 || y < 0 || z < 0 || x >= (int)max_x || y >= (int)max_y || z >= (int)max_z)
-		    	return outOfBounds;
-			
-		return &cellDataModel[(max_x * max_y * z) + (max_x * y) + x]; 
-	};
-
-	bufferData* getCell(bufferData *buffer, int y, int z) { 
-		return &buffer[max_y * z + y]; 
-	};
-		
-	void sendToLeftBuff (int y, int z, int field, double value);
-	void sendToRightBuff (int y, int z, int field, double value);
 	void waitForArea();
 	void waitForUpdatedArea();
 	
+	double *incoming(int i, int x, int y, int z);
+	bool accelRange(unsigned int *y0, unsigned int *y1, unsigned int *z0, unsigned int *z1);
+	void decideFW();
 	void accelerateFW();
 	void accelerateBW();
-	void allocateBuffers();
-
-	void MD3Q19b::initCell(cellData *cell);
-	void MD3Q19b::initBCell(bufferData *cell);
 			
-	bufferData* getBCell(int buffer, int y, int z) { 
-		if (buffer == 0) 
-			return &bufferLeft[max_y * z + y];
-		if (buffer == 1)
-			return &bufferRight[max_y * z + y];
-
-		return NULL;
-		 };
 	
-		
-	// discrete velocity matrix
-	int e_x[19];
-    int e_y[19];
-	int e_z[19];
 };
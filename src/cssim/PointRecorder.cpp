@@ -0,0 +1,151 @@
+#include <vector>
+#include <math.h>
+
+using namespace std;
+
+#include "PointRecorder.h"
+
+PointRecorder::PointRecorder()
+{
+    pthread_mutex_init(&lock, NULL);
+}
+
+PointRecorder::~PointRecorder()
+{
+    pthread_mutex_destroy(&lock);
+}
+
+void PointRecorder::setup(const int *origin)
+{
+    pthread_mutex_lock(&lock);
+
+    for (int a = 0; a < 3; a++)
+        this->origin[a] = origin[a];
+
+    points.clear();
+    pthread_mutex_unlock(&lock);
+}
+
+void PointRecorder::record(const Lattice * lattice)
+{
+    pthread_mutex_lock(&lock);
+
+    for (unsigned int k = 0; k < points.size(); k++) {
+        point &p = points[k];
+        long n = p.n;
+        double value;
+
+        // the cell may have turned solid with an update of the area
+        if (lattice->solid[n])
+            continue;
+
+        switch (p.type) {
+        case SAMPLETYPE_VELOCITY:
+            value = sqrt(lattice->mv_x[n] * lattice->mv_x[n] + lattice->mv_y[n] * lattice->mv_y[n] + lattice->mv_z[n] * lattice->mv_z[n]);
+            break;
+        case SAMPLETYPE_PRESSURE:
+            value = lattice->density[n] / 3.0;
+            break;
+        default:
+            value = lattice->density[n];
+        }
+
+        p.ring[p.head] = value;
+        p.head = (p.head + 1) % POINT_HISTORY;
+        if (p.fill < POINT_HISTORY)
+            p.fill++;
+    }
+
+    pthread_mutex_unlock(&lock);
+}
+
+/*
+ * Hands out the values recorded since the last fetch in at most
+ * request->windows windows of about the same length, oldest first.
+ * Solid cells are not recorded at all.
+ */
+bool PointRecorder::fetch(const Lattice * lattice, const pointRequest * request, vector<pointWindow> &out)
+{
+    int x = request->x - origin[0], y = request->y - origin[1], z = request->z - origin[2];
+
+    out.clear();
+
+    if (!lattice->inside(x, y, z)) {
+        forget(request->id);
+        return false;
+    }
+
+    long n = lattice->index(x, y, z);
+    unsigned int k;
+
+    pthread_mutex_lock(&lock);
+
+    for (k = 0; k < points.size(); k++)
+        if (points[k].id == request->id)
+            break;
+
+    if (k == points.size() || points[k].n != n || points[k].type != request->type) {
+        remove(request->id);
+
+        if (!lattice->solid[n]) {
+            point p;
+
+            p.id = request->id;
+            p.type = request->type;
+            p.n = n;
+            p.ring.resize(POINT_HISTORY);
+            p.head = 0;
+            p.fill = 0;
+            points.push_back(p);
+        }
+        pthread_mutex_unlock(&lock);
+        return true;
+    }
+
+    point &p = points[k];
+    unsigned int windows = request->windows < (int) p.fill ? request->windows : p.fill;
+    unsigned int oldest = (p.head + POINT_HISTORY - p.fill) % POINT_HISTORY;
+
+    for (unsigned int w = 0; w < windows; w++) {
+        unsigned int first = w * p.fill / windows;
+        unsigned int last = (w + 1) * p.fill / windows;
+        pointWindow window;
+
+        window.min = window.max = p.ring[(oldest + first) % POINT_HISTORY];
+        window.mean = 0.0;
+
+        for (unsigned int s = first; s < last; s++) {
+            double value = p.ring[(oldest + s) % POINT_HISTORY];
+
+            if (value < window.min)
+                window.min = value;
+            if (value > window.max)
+                window.max = value;
+            window.mean += value;
+        }
+
+        window.mean /= last - first;
+        out.push_back(window);
+    }
+
+    p.fill = 0;
+    pthread_mutex_unlock(&lock);
+    return true;
+}
+
+void PointRecorder::forget(int id)
+{
+    pthread_mutex_lock(&lock);
+    remove(id);
+    pthread_mutex_unlock(&lock);
+}
+
+void PointRecorder::remove(int id)
+{
+    for (unsigned int k = 0; k < points.size(); k++) {
+        if (points[k].id == id) {
+            points.erase(points.begin() + k);
+            return;
+        }
+    }
+}
@@ -0,0 +1,59 @@
+#ifndef POINTRECORDER_H
+#define POINTRECORDER_H
+
+#include <vector>
+#include <pthread.h>
+
+#include "types.h"
+#include "Lattice.h"
+
+// steps a point keeps between two fetches, older ones are overwritten
+#define POINT_HISTORY	1024
+
+/*
+ * Time series of point probes, recorded by the worker owning the cell.
+ *
+ * Every step the value of each registered point goes into a ring buffer
+ * of its own, which does not cost more than a few loads. On every filter
+ * tick the overmind fetches what came in since the last one, boiled down
+ * to a few windows of min, max and mean (see fetch()), so the update
+ * rate of the samples does not limit how closely a point is watched.
+ *
+ * A point is registered the first time the overmind asks for it and is
+ * dropped when it moves into another block or the probe is deleted.
+ * record() is called by the solver, fetch() and forget() by the sampler
+ * thread of MD3Q19b, hence the lock.
+ */
+class PointRecorder
+{
+public:
+	PointRecorder();
+	virtual ~PointRecorder();
+
+	void setup(const int *origin);
+	void record(const Lattice *lattice);
+
+	// false if the point is not in our block, see pointRequest
+	bool fetch(const Lattice *lattice, const pointRequest *request,
+	           std::vector<pointWindow> &out);
+	void forget(int id);
+
+private:
+	struct point
+	{
+		int id;
+		int type;				// sample_type
+		long n;					// cell in the lattice
+		std::vector<double> ring;
+		unsigned int head;		// where the next value goes
+		unsigned int fill;		// values since the last fetch
+	};
+
+	int origin[3];
+	std::vector<point> points;
+	pthread_mutex_t lock;
+
+	void remove(int id);
+};
+
+#endif
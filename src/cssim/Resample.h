@@ -0,0 +1,32 @@
+#ifndef RESAMPLE_H
+#define RESAMPLE_H
+
+#include <math.h>
+
+#include "types.h"
+
+/*
+ * Grid point i,j,k of a volume request in global lattice coordinates,
+ * and the cell it lies in. Overmind and workers both go through here,
+ * so they agree on who owns which point.
+ */
+inline void volumePoint(const volumeRequest *r, int i, int j, int k, double *p)
+{
+	double fu = (double) i / r->size[0];
+	double fv = (double) j / r->size[1];
+	double fw = (double) k / r->size[2];
+
+	for (int a = 0; a < 3; a++)
+		p[a] = r->origin[a] + fu * r->u[a] + fv * r->v[a] + fw * r->w[a];
+}
+
+inline void volumeCell(const volumeRequest *r, int i, int j, int k, int *cell)
+{
+	double p[3];
+
+	volumePoint(r, i, j, k, p);
+	for (int a = 0; a < 3; a++)
+		cell[a] = (int) floor(p[a]);
+}
+
+#endif
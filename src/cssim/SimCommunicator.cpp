@@ -1,6 +1,7 @@
 #include <vector>
 #include <mpi.h>
 #include <iostream>
+#include <string.h>
 
 using namespace std;
 
@@ -9,6 +10,8 @@ using namespace std;
 #include "values.h"
 
 #include "SimCommunicator.h"
+#include "VoxelCodec.h"
+#include "Resample.h"
 #include "FANClasses.h"
 
 #define INITSIZE 10000
@@ -16,6 +19,12 @@ using namespace std;
 #define EPS  0.00001
 #define EPS2 0.00001
 
+// cells between two glyphs of a stream
+#define GLYPH_SPACING 4
+
+// windows of a point sample
+#define POINT_WINDOWS 16
+
 extern FAN_Com *simMasterCom;
 
 SimCommunicator::SimCommunicator()
@@ -28,6 +37,13 @@ SimCommunicator::SimCommunicator()
     factor_z = 1.7;
 
     stdUpdateRate = 10;
+    stdVolumeResolution = 32;
+    stdInterpolation = false;
+    stdThreads = 1;
+    queuedCells = 0;
+    runs = 0;
+    pthread_mutex_init(&forgottenLock, NULL);
+    decompositionMode = DECOMPOSITION_SLAB;
 
     simulating = false;
 
@@ -37,141 +53,360 @@ SimCommunicator::SimCommunicator()
 void SimCommunicator::filterDone()
 {
     for (int sim = 1; sim < nprocs; sim++) {
-        MPI::COMM_WORLD.Send(NULL, 0, MPI::BYTE, sim, MPI_Filter_Done);
+        sampling.Send(NULL, 0, MPI::BYTE, sim, MPI_Filter_Done);
     }
 
-    MPI::COMM_WORLD.Barrier();
+    sampling.Barrier();
 }
 
+/*
+ * The workers answer from their snapshot of the last run we sent them,
+ * waiting for it if they are not through with the run yet. Point probes
+ * deleted since the last time are dropped first, on every worker since
+ * any of them may have recorded it.
+ */
 void SimCommunicator::filterInit()
 {
+    vector<int> forgotten;
+
+    pthread_mutex_lock(&forgottenLock);
+    forgotten.swap(forgottenPoints);
+    pthread_mutex_unlock(&forgottenLock);
+
     for (int sim = 1; sim < nprocs; sim++) {
-        MPI::COMM_WORLD.Send(NULL, 0, MPI::BYTE, sim, MPI_Filter);  
+        sampling.Send(&runs, sizeof(int), MPI::BYTE, sim, MPI_Filter);
+
+        for (unsigned int i = 0; i < forgotten.size(); i++) {
+            pointRequest request;
+
+            memset(&request, 0, sizeof(pointRequest));
+            request.id = forgotten[i];
+            request.drop = 1;
+            sampling.Send(&request, sizeof(pointRequest), MPI::BYTE, sim, MPI_Record_Point);
+        }
     }
 }
 
+void SimCommunicator::forgetPoint(int id)
+{
+    pthread_mutex_lock(&forgottenLock);
+    forgottenPoints.push_back(id);
+    pthread_mutex_unlock(&forgottenLock);
+}
+
 
 SimCommunicator::~SimCommunicator()
 {
+    pthread_mutex_destroy(&forgottenLock);
 }
 
+/*
+ * Resamples the box spanned by points 0, 1, 3 and 4 of the sample (the
+ * plane of computePlanarSample() and its height) on a grid of up to
+ * stdVolumeResolution points per edge, see sampleGrid().
+ */
 volume_sample *SimCommunicator::computeVolumeSample(sample_save_type * sample_desc)
 {
-    return NULL;
+    volume_sample *probe = new volume_sample;
+    volumeRequest request;
+    vertex_t *points = sample_desc->points;
+    int sub[3] = { x_sub, y_sub, z_sub };
+    double corner[4][3] = { {points[0].x, points[0].y, points[0].z}, {points[1].x, points[1].y, points[1].z},
+                            {points[3].x, points[3].y, points[3].z}, {points[4].x, points[4].y, points[4].z} };
+    double *edges[3] = { request.u, request.v, request.w };
+
+    for (int a = 0; a < 3; a++)
+        request.origin[a] = corner[0][a] + sub[a];
+
+    for (int e = 0; e < 3; e++) {
+        for (int a = 0; a < 3; a++)
+            edges[e][a] = corner[e + 1][a] - corner[0][a];
+        request.size[e] = gridSize(edges[e], stdVolumeResolution);
+    }
+    request.type = sample_desc->type;
+    request.interpolate = 0;
+
+    probe->id = sample_desc->id;
+    probe->type = DATATYPE_SCALAR;
+    probe->dimensionality = 1;
+    probe->u_size = request.size[0];
+    probe->v_size = request.size[1];
+    probe->w_size = request.size[2];
+    probe->values = new double[request.size[0] * request.size[1] * request.size[2]];
+
+    sampleGrid(&request, probe->values, probe->min, probe->max);
+
+    return probe;
+}
+
+// no more points than cells along the edge, and no more than limit
+int SimCommunicator::gridSize(const double *edge, int limit)
+{
+    int size = (int) sqrt(edge[0] * edge[0] + edge[1] * edge[1] + edge[2] * edge[2]) + 1;
+
+    return size > limit ? limit : size;
 }
 
+/*
+ * The workers rate their share of the points of the grid in parallel
+ * (see MD3Q19b::sampleVolume()) and the overmind collects them with a
+ * single Gatherv. Points outside of the lattice are 0, solid ones
+ * MINFLOAT; min and max are those of the fluid points.
+ */
+void SimCommunicator::sampleGrid(const volumeRequest * request, double *values, double &min, double &max)
+{
+    int count = request->size[0] * request->size[1] * request->size[2];
+
+    // which worker rates which point, in the order they send them
+    vector<int> owner(count);
+    vector<int> counts(nprocs, 0);
+    vector<int> displs(nprocs, 0);
+    int n = 0;
+
+    for (int k = 0; k < request->size[2]; k++) {
+        for (int j = 0; j < request->size[1]; j++) {
+            for (int i = 0; i < request->size[0]; i++, n++) {
+                int cell[3], local[3];
+
+                volumeCell(request, i, j, k, cell);
+                if (cell[0] < 0 || cell[1] < 0 || cell[2] < 0 || cell[0] >= dim_x || cell[1] >= dim_y || cell[2] >= dim_z) {
+                    owner[n] = -1;
+                    continue;
+                }
+
+                owner[n] = decomp.owner(cell[0], cell[1], cell[2], local);
+                counts[owner[n]]++;
+            }
+        }
+    }
+
+    for (int sim = 1; sim < nprocs; sim++)
+        displs[sim] = displs[sim - 1] + counts[sim - 1];
+
+    vector<double> gathered(displs[nprocs - 1] + counts[nprocs - 1] + 1);
+
+    for (int sim = 1; sim < nprocs; sim++)
+        sampling.Send(request, sizeof(volumeRequest), MPI::BYTE, sim, MPI_Sample_Volume);
+
+    sampling.Gatherv(NULL, 0, MPI::DOUBLE, &gathered[0], &counts[0], &displs[0], MPI::DOUBLE, OVERMIND);
+
+    min = MAXFLOAT;
+    max = -MAXFLOAT;
+
+    for (n = 0; n < count; n++) {
+        if (owner[n] < 0) {
+            values[n] = 0.0;
+            continue;
+        }
+
+        double value = gathered[displs[owner[n]]++];
+
+        values[n] = value;
+        if (value == MINFLOAT)
+            continue;
+        if (value < min)
+            min = value;
+        if (value > max)
+            max = value;
+    }
+
+    if (min > max)
+        min = max = 0.0;
+}
+
+/*
+ * The worker owning the point records it every step (see
+ * PointRecorder.h); what comes back is the series since the last
+ * sample, as windows of min, max and mean. The first sample of a point
+ * only registers it and is empty.
+ */
 point_sample *SimCommunicator::computePointSample(sample_save_type * sample_desc)
 {
     point_sample *probe = new point_sample;
+    pointRequest request;
+    int local[3], sim = -1;
+
     probe->id = sample_desc->id;
-    probe->type = DATATYPE_VECTOR;
+    probe->type = DATATYPE_SCALAR;
+    probe->dimensionality = 3;
+    probe->count = 0;
+    probe->value = NULL;
+    probe->min = probe->max = 0.0;
+
+    request.id = sample_desc->id;
+    request.x = (int) sample_desc->points[0].x + x_sub;
+    request.y = (int) sample_desc->points[0].y + y_sub;
+    request.z = (int) sample_desc->points[0].z + z_sub;
+    request.type = sample_desc->type;
+    request.windows = POINT_WINDOWS;
+    request.drop = 0;
+
+    if (request.x >= 0 && request.y >= 0 && request.z >= 0 && request.x < dim_x && request.y < dim_y && request.z < dim_z)
+        sim = decomp.owner(request.x, request.y, request.z, local);
+
+    // the others drop the point in case it was theirs before
+    for (int s = 1; s < nprocs; s++)
+        sampling.Send(&request, sizeof(pointRequest), MPI::BYTE, s, MPI_Record_Point);
+
+    if (sim < 0)
+        return probe;
+
+    sampling.Probe(sim, MPI_Record_Point, status);
+
+    vector<pointWindow> windows(status.Get_count(MPI::BYTE) / sizeof(pointWindow));
+
+    sampling.Recv(windows.empty() ? NULL : &windows[0], windows.size() * sizeof(pointWindow), MPI::BYTE, sim, MPI_Record_Point, status);
+
+    probe->count = windows.size();
+    probe->value = new double[3 * probe->count];
+
+    for (unsigned int w = 0; w < probe->count; w++) {
+        probe->value[3 * w] = windows[w].min;
+        probe->value[3 * w + 1] = windows[w].max;
+        probe->value[3 * w + 2] = windows[w].mean;
+
+        if (w == 0 || windows[w].min < probe->min)
+            probe->min = windows[w].min;
+        if (w == 0 || windows[w].max > probe->max)
+            probe->max = windows[w].max;
+    }
 
     return probe;
 }
 
+/*
+ * The plane spanned by points 0, 1 and 3 of the sample, resampled like
+ * a volume one grid point thick. The grid follows the footprint of the
+ * plane in cells up to RES points per edge, so small slices come cheap.
+ * With stdInterpolation the values are interpolated between the cell
+ * centres instead of taken from the cell each point falls into.
+ */
 planar_sample *SimCommunicator::computePlanarSample(sample_save_type * sample_desc)
 {
     planar_sample *probe = new planar_sample;
+    volumeRequest request;
+    vertex_t *points = sample_desc->points;
 
 #define RES 256
 
+    request.origin[0] = points[0].x + x_sub;
+    request.origin[1] = points[0].y + y_sub;
+    request.origin[2] = points[0].z + z_sub;
+
+    request.u[0] = points[1].x - points[0].x;
+    request.u[1] = points[1].y - points[0].y;
+    request.u[2] = points[1].z - points[0].z;
+
+    request.v[0] = points[3].x - points[0].x;
+    request.v[1] = points[3].y - points[0].y;
+    request.v[2] = points[3].z - points[0].z;
+
+    request.w[0] = request.w[1] = request.w[2] = 0.0;
+
+    request.size[0] = gridSize(request.u, RES);
+    request.size[1] = gridSize(request.v, RES);
+    request.size[2] = 1;
+    request.type = sample_desc->type;
+    request.interpolate = stdInterpolation;
+
     probe->id = sample_desc->id;
     probe->type = DATATYPE_SCALAR;
-    probe->values = new double[RES * RES];
-    probe->u_size = RES;
-    probe->v_size = RES;
+    probe->u_size = request.size[0];
+    probe->v_size = request.size[1];
     probe->dimensionality = 1;
+    probe->values = new double[probe->u_size * probe->v_size];
+
+    sampleGrid(&request, probe->values, probe->min, probe->max);
 
-    float planarwidth_x = sample_desc->points[1].x - sample_desc->points[0].x;
-    float planarwidth_y = sample_desc->points[1].y - sample_desc->points[0].y;
-    float planarwidth_z = sample_desc->points[1].z - sample_desc->points[0].z;
+    return probe;
+}
 
-    float planarheight_x = sample_desc->points[3].x - sample_desc->points[0].x;
-    float planarheight_y = sample_desc->points[3].y - sample_desc->points[0].y;
-    float planarheight_z = sample_desc->points[3].z - sample_desc->points[0].z;
+/*
+ * Every stream of the emitter gets a row of glyphs, one every
+ * GLYPH_SPACING cells from its seed down to the outlet. All of them are
+ * fetched in a single batch, one round trip per worker; glyphs in solid
+ * cells are left out.
+ */
+glyph_probe_data *SimCommunicator::computeGlyphSample(sample_save_type * sample_desc, double voxelSize)
+{
+    glyph_probe_data *probe = new glyph_probe_data;
 
-    float x, y, z;
-    float start_x = sample_desc->points[0].x + (float) x_sub;
-    float start_y = sample_desc->points[0].y + (float) y_sub;
-    float start_z = sample_desc->points[0].z + (float) z_sub;
+    probe->id = sample_desc->id;
+    probe->num_streams = sample_desc->count;
+    probe->num_glyphs_per_stream = new unsigned int[probe->num_streams];
 
-    initSendBuffer();
+    vertex_t *voxelStartPoints = sample_desc->points;
+    vertex_t *startPoints = sample_desc->orig_points;
 
-    for (int v = 0; v < RES; v++) {
-        for (int u = 0; u < RES; u++) {
-            x = start_x + (planarwidth_x * (float) u / (float) RES) + (planarheight_x * (float) v / (float) RES);
-            y = start_y + (planarwidth_y * (float) u / (float) RES) + (planarheight_y * (float) v / (float) RES);
-            z = start_z + (planarwidth_z * (float) u / (float) RES) + (planarheight_z * (float) v / (float) RES);
+    vector<int> first(probe->num_streams + 1, 0);
 
-            pushBackCell(u, v, (int) floor(x), (int) floor(y), (int) floor(z));
+    for (unsigned int i = 0; i < probe->num_streams; i++) {
+        int x = (int) voxelStartPoints[i].x + x_sub;
+        int y = (int) voxelStartPoints[i].y + y_sub;
+        int z = (int) voxelStartPoints[i].z + z_sub;
 
-            probe->values[(RES * v) + u] = 0.0;
+        first[i + 1] = first[i];
+        for (int g = 0; x + g * GLYPH_SPACING < dim_x; g++) {
+            queueCell(x + g * GLYPH_SPACING, y, z);
+            first[i + 1]++;
         }
     }
 
-    getCells();
+    flushCells();
 
-    switch (sample_desc->type) {
-    case SAMPLETYPE_DENSITY:
-        probe->max = minmax.max_density;
-        probe->min = minmax.min_density;
-        break;
-    case SAMPLETYPE_VELOCITY:
-        probe->max = sqrt(minmax.max_v);
-        probe->min = sqrt(minmax.min_v);
-        break;
-    case SAMPLETYPE_PRESSURE:
-        probe->max = minmax.max_density / 3.0;
-        probe->min = minmax.min_density / 3.0;
-        break;
-    default:
-        probe->max = minmax.max_density;
-        probe->min = minmax.min_density;
-    }
+    probe->positions = new vertex_t[first[probe->num_streams]];
+    probe->directions = new vertex_t[first[probe->num_streams]];
+    probe->values = new double[first[probe->num_streams]];
+    probe->min_value = MAXFLOAT;
+    probe->max_value = MINFLOAT;
+    probe->num_total = 0;
 
+    for (unsigned int i = 0; i < probe->num_streams; i++) {
+        probe->num_glyphs_per_stream[i] = 0;
 
-    double currentValue = 0.0;
+        for (int n = first[i]; n < first[i + 1]; n++) {
+            const simProbe &cell = queued[n];
+            double v = sqrt(cell.mv_x * cell.mv_x + cell.mv_y * cell.mv_y + cell.mv_z * cell.mv_z);
+            double value;
 
-    for (unsigned i = 0; i < sendBuffer.size(); i++) {
-        bufferdata *cells = sendBuffer[i]->cells;
-        simProbe *probes = receiveBuffer[i]->probes;
+            if (cell.solid)
+                continue;
 
-        for (int j = 0; j < sendBuffer[i]->size; j++) {
-            bufferdata *cell = &cells[j];
-            simProbe *new_probe = &probes[j];
             switch (sample_desc->type) {
-            case SAMPLETYPE_DENSITY:
-                currentValue = new_probe->density;
-                break;
             case SAMPLETYPE_VELOCITY:
-                currentValue = sqrt(new_probe->mv_x * new_probe->mv_x + new_probe->mv_y * new_probe->mv_y + new_probe->mv_z * new_probe->mv_z);
+                value = v;
                 break;
             case SAMPLETYPE_PRESSURE:
-                currentValue = new_probe->density / 3.0;
+                value = cell.density / 3.0;
                 break;
             default:
-                currentValue = new_probe->density;
+                value = cell.density;
             }
 
-            if (new_probe->solid) {
-                probe->values[(RES * cell->v) + cell->u] = MINFLOAT;
-            } else {
-                probe->values[(RES * cell->v) + cell->u] = currentValue;
-            }
+            unsigned int k = probe->num_total++;
+
+            probe->positions[k].x = startPoints[i].x + (n - first[i]) * GLYPH_SPACING * voxelSize;
+            probe->positions[k].y = startPoints[i].y;
+            probe->positions[k].z = startPoints[i].z;
+
+            probe->directions[k].x = v > EPS ? cell.mv_x / v : 0.0;
+            probe->directions[k].y = v > EPS ? cell.mv_y / v : 0.0;
+            probe->directions[k].z = v > EPS ? cell.mv_z / v : 0.0;
+
+            probe->values[k] = value;
+            probe->num_glyphs_per_stream[i]++;
+
+            if (value < probe->min_value)
+                probe->min_value = value;
+            if (value > probe->max_value)
+                probe->max_value = value;
         }
     }
-    return probe;
-}
 
-glyph_probe_data *SimCommunicator::computeGlyphSample(sample_save_type * sample_desc)
-{
-    glyph_probe_data *probe = new glyph_probe_data;
+    if (probe->num_total == 0)
+        probe->min_value = probe->max_value = 0.0;
 
-    probe->id = sample_desc->id;
-    probe->num_streams = sample_desc->count;
-    //T B C
-    //
-    return NULL;
+    return probe;
 }
 
 void SimCommunicator::getDerivation(const vertex_t & v1, const vertex_t & v2, vertex_t & v, const double &h)
@@ -183,23 +418,45 @@ void SimCommunicator::getDerivation(const vertex_t & v1, const vertex_t & v2, ve
 
 void SimCommunicator::getRotation(const int &x, const int &y, const int &z, const double &h, simProbe & cell, vertex_t & rot)
 {
-    vertex_t x1, x2, y1, y2, z1, z2;
+    int around = queueAround(x, y, z);
 
-    getV(x - 1, y, z, cell, x1);
-    getV(x + 1, y, z, cell, x2);
-    getDerivation(x1, x2, x1, h);
+    flushCells();
+    cell = queued[around];
+    rotation(&queued[around], h, rot);
+}
 
-    getV(x, y - 1, z, cell, y1);
-    getV(x, y + 1, z, cell, y2);
-    getDerivation(y1, y2, y1, h);
+// queues the cell x,y,z and its six neighbours, see rotation()
+int SimCommunicator::queueAround(int x, int y, int z)
+{
+    int first = queueCell(x, y, z);
 
-    getV(x, y, z - 1, cell, z1);
-    getV(x, y, z + 1, cell, z2);
-    getDerivation(z1, z2, z1, h);
+    queueCell(x - 1, y, z);
+    queueCell(x + 1, y, z);
+    queueCell(x, y - 1, z);
+    queueCell(x, y + 1, z);
+    queueCell(x, y, z - 1);
+    queueCell(x, y, z + 1);
 
-    rot.x = z1.y - y1.z;
-    rot.y = x1.z - z1.x;
-    rot.z = y1.x - x1.y;
+    return first;
+}
+
+void SimCommunicator::rotation(const simProbe * around, const double &h, vertex_t & rot)
+{
+    vertex_t v[6];
+
+    for (int i = 0; i < 6; i++) {
+        v[i].x = around[i + 1].mv_x;
+        v[i].y = around[i + 1].mv_y;
+        v[i].z = around[i + 1].mv_z;
+    }
+
+    getDerivation(v[0], v[1], v[0], h);
+    getDerivation(v[2], v[3], v[2], h);
+    getDerivation(v[4], v[5], v[4], h);
+
+    rot.x = v[4].y - v[2].z;
+    rot.y = v[0].z - v[4].x;
+    rot.z = v[2].x - v[0].y;
 }
 
 void SimCommunicator::getVectorProduct(const vertex_t & v1, const vertex_t & v2, vertex_t & v)
@@ -214,13 +471,6 @@ double SimCommunicator::getAbs(const vertex_t & v)
     return sqrt(v.x * v.x + v.y * v.y + v.z * v.z);
 }
 
-void SimCommunicator::integrateEuler(const vertex_t & pos, const vertex_t & dir, vertex_t & out, double stepsize)
-{
-    out.x = pos.x + stepsize * dir.x;
-    out.y = pos.y + stepsize * dir.y;
-    out.z = pos.z + stepsize * dir.z;
-}
-
 void SimCommunicator::getV(const int &x, const int &y, const int &z, simProbe & cell, vertex_t & v)
 {
     getCell(x, y, z, cell);
@@ -229,6 +479,12 @@ void SimCommunicator::getV(const int &x, const int &y, const int &z, simProbe &
     v.z = cell.mv_z;
 }
 
+/*
+ * The ribbons are traced by the workers, each in its own block (see
+ * Tracer.h). The overmind hands out the seeds in lattice coordinates,
+ * waits for the workers to agree that they are done and then puts the
+ * vertices which come back in order.
+ */
 ribbon_probe_data *SimCommunicator::computeRibbonSample(sample_save_type * sample_desc, double voxelSize)
 {
     ribbon_probe_data *probe = new ribbon_probe_data;
@@ -239,121 +495,108 @@ ribbon_probe_data *SimCommunicator::computeRibbonSample(sample_save_type * sampl
 
     vertex_t *voxelStartPoints = sample_desc->points;
     vertex_t *startPoints = sample_desc->orig_points;
-    simProbe cell;
 
     probe->min_value = MAXFLOAT;
     probe->max_value = MINFLOAT;
     probe->num_total = 0;
 
-    vector < vertex_t > vertices;
-    vector < double >values;
-
-    vertices.reserve(probe->num_ribbons * dim_x * 2 * 2);
-    values.reserve(probe->num_ribbons * dim_x * 2);
+    for (unsigned int i = 0; i < probe->num_ribbons; i++)
+        probe->num_vertices[i] = 0;
 
-    for (int i = 0; i < (int) probe->num_ribbons; i++) {
-        int start_x = (int) voxelStartPoints[i].x + x_sub;
-        int start_y = (int) voxelStartPoints[i].y + y_sub;
-        int start_z = (int) voxelStartPoints[i].z + z_sub;
+    vector<traceVertex> vertices;
 
-        double sx = startPoints[i].x;
-        double sy = startPoints[i].y;
-        double sz = startPoints[i].z;
+    // the flow needs a while to develop before ribbons say anything
+    if (steps > 200 && probe->num_ribbons > 0) {
+        vector<unsigned char> request(sizeof(traceRequest) + probe->num_ribbons * sizeof(traceSeed));
+        traceRequest *header = (traceRequest *) &request[0];
+        traceSeed *seeds = (traceSeed *) (&request[0] + sizeof(traceRequest));
 
-        int size = 0;
+        header->seeds = probe->num_ribbons;
+        header->maxVertices = dim_x * 2;
+        header->height = sample_desc->height;
+        header->stepLength = 0.25;
 
-        vertex_t pos;
-        vertex_t pos_dist;
-        vertex_t last_pos;
-        vertex_t last_v;
-        vertex_t rot;
-
-        vertex_t v;
-        vertex_t v2;
-
-        pos.x = sx;
-        pos.y = sy;
-        pos.z = sz;
-
-        int last_x = -1;
-        int last_y = -1;
-        int last_z = -1;
-
-        double val = 0.0;
-
-        cell.solid = false;
-
-        while (last_x < dim_x && steps > 200 && size < dim_x * 2) {
-            int x = start_x + (int) ((pos.x - sx) / voxelSize);
-            int y = start_y + (int) ((pos.y - sy) / voxelSize);
-            int z = start_z + (int) ((pos.z - sz) / voxelSize);
-
-            if (x != last_x || y != last_y || z != last_z) {
-                getV(x, y, z, cell, v);
-                val = getAbs(v);
-
-                if (val < EPS2) {
-                    //                   cout << "Cut ribbon: ABS=" << val << endl;
-                    break;
-                }
-
-                if (val < EPS) {
-                    v.x = v.x / val * EPS;
-                    v.x = v.y / val * EPS;
-                    v.x = v.z / val * EPS;
-                    val = EPS;
-                }
-
-                vertices.push_back(pos);
-                pos_dist = pos;
+        for (unsigned int i = 0; i < probe->num_ribbons; i++) {
+            seeds[i].ribbon = i;
+            seeds[i].x = (int) voxelStartPoints[i].x + x_sub;
+            seeds[i].y = (int) voxelStartPoints[i].y + y_sub;
+            seeds[i].z = (int) voxelStartPoints[i].z + z_sub;
+        }
 
-                if (val < probe->min_value)
-                    probe->min_value = val;
-                if (val > probe->max_value)
-                    probe->max_value = val;
+        for (int sim = 1; sim < nprocs; sim++)
+            sampling.Send(&request[0], request.size(), MPI::BYTE, sim, MPI_Trace_Ribbons);
 
-                getRotation(x, y, z, voxelSize, cell, rot);
-                getVectorProduct(v, rot, v2);
+        // the workers' rounds, see Tracer::trace()
+        int none = 0, total;
+        do {
+            sampling.Allreduce(&none, &total, 1, MPI::INT, MPI::SUM);
+        } while (total);
 
-                pos_dist.x += rot.x * sample_desc->height / val;
-                pos_dist.y += rot.y * sample_desc->height / val;
-                pos_dist.z += rot.z * sample_desc->height / val;
+        for (int sim = 1; sim < nprocs; sim++) {
+            sampling.Probe(MPI_ANY_SOURCE, MPI_Trace_Ribbons, status);
 
-                vertices.push_back(pos_dist);
+            unsigned int size = vertices.size();
+            unsigned int count = status.Get_count(MPI::BYTE) / sizeof(traceVertex);
 
-                values.push_back(val);
+            vertices.resize(size + count);
+            sampling.Recv(count ? &vertices[size] : NULL, count * sizeof(traceVertex), MPI::BYTE, status.Get_source(), MPI_Trace_Ribbons, status);
+        }
+    }
 
-                last_x = x;
-                last_y = y;
-                last_z = z;
+    for (unsigned int k = 0; k < vertices.size(); k++)
+        probe->num_vertices[vertices[k].ribbon]++;
 
-                last_pos = pos;
-                last_v = v;
+    vector<unsigned int> first(probe->num_ribbons + 1, 0);
+    for (unsigned int i = 0; i < probe->num_ribbons; i++) {
+        first[i + 1] = first[i] + probe->num_vertices[i];
+        probe->num_vertices[i] *= 2;
+    }
 
-                size++;
-                probe->num_total++;
-            }
+    probe->num_total = vertices.size();
+    probe->values = new double[probe->num_total];
+    probe->ribbons = new vertex_t[probe->num_total * 2];
 
-            integrateEuler(pos, v, pos, 1.0);
-        }
+    for (unsigned int k = 0; k < vertices.size(); k++) {
+        const traceVertex &v = vertices[k];
+        unsigned int n = first[v.ribbon] + v.seq;
+        vertex_t pos;
 
-        probe->num_vertices[(unsigned int) i] = size * 2;
+        // back from the lattice into the coordinates of the seed
+        pos.x = startPoints[v.ribbon].x + (v.x - ((int) voxelStartPoints[v.ribbon].x + x_sub)) * voxelSize;
+        pos.y = startPoints[v.ribbon].y + (v.y - ((int) voxelStartPoints[v.ribbon].y + y_sub)) * voxelSize;
+        pos.z = startPoints[v.ribbon].z + (v.z - ((int) voxelStartPoints[v.ribbon].z + z_sub)) * voxelSize;
+
+        probe->ribbons[2 * n] = pos;
+        pos.x += v.dx;
+        pos.y += v.dy;
+        pos.z += v.dz;
+        probe->ribbons[2 * n + 1] = pos;
+        probe->values[n] = v.value;
+
+        if (v.value < probe->min_value)
+            probe->min_value = v.value;
+        if (v.value > probe->max_value)
+            probe->max_value = v.value;
     }
 
-    probe->values = new double[values.size()];
-    probe->ribbons = new vertex_t[vertices.size()];
-
-    for (unsigned int i = 0; i < values.size(); i++)
-        probe->values[i] = values[i];
+    return probe;
+}
 
-    for (unsigned int i = 0; i < vertices.size(); i++)
-        probe->ribbons[i] = vertices[i];
+// samples of the last run sent, which ended at step (0: none yet)
+void SimCommunicator::filter(int step)
+{
+    if (!step)
+        return;
 
-    return probe;
+    filterInit();
+    if (simMasterCom != NULL)
+        FAN_sendMessage(simMasterCom, "filter", (void *) step);
+    filterDone();
 }
 
 void SimCommunicator::simStepOn()
 {
+    int filtered = 0;
 
     m_running = true;
 
@@ -366,50 +609,24 @@ void SimCommunicator::simStepOn()
 //      MPI::COMM_WORLD.Barrier();
 //      cout << "\t OM " << " synched!";
 
-        for (int sim = 1; sim < nprocs; sim++) {
-//          cout << "Trying to trigger Sim " << sim << "." << endl;
-            //propagate
-//          MPI::COMM_WORLD.Sendrecv_replace(NULL, 0, MPI::BYTE, sim, MPI_Model_Propagate, sim, MPI_Ack, status);
-            MPI::COMM_WORLD.Send(NULL, 0, MPI::BYTE, sim, MPI_Model_Propagate);
-/*          if ((status.Get_tag() == MPI_Ack) && (status.Get_source() == sim ))
-            {
-//              cout << "PROPAGATION triggered on Sim " << sim << "; Received Ack.." << endl;
-            }           */
-        }
-        MPI::COMM_WORLD.Barrier();
-
-//      cout << "Waiting for propagations to finish.." << endl;
-        MPI::COMM_WORLD.Barrier();
+        // the workers run up to the next sample on their own, keeping
+        // each other in step through the halo; pausing takes effect there
+        int run = stdUpdateRate > 1 ? stdUpdateRate - steps % stdUpdateRate : 1;
 
-//      cout << "Waiting for even Sims to propagate their Buffers" << endl;
-        MPI::COMM_WORLD.Barrier();
-
-//      cout << "Waiting for odd Sims to propagate their Buffers" << endl;
-        MPI::COMM_WORLD.Barrier();
-
-        //collision     
         for (int sim = 1; sim < nprocs; sim++) {
-            //collision
-//          MPI::COMM_WORLD.Sendrecv_replace(NULL, 0, MPI::BYTE, sim, MPI_Model_Collision, sim, MPI_Ack, status);
-            MPI::COMM_WORLD.Send(NULL, 0, MPI::BYTE, sim, MPI_Model_Collision); // , sim, MPI_Ack, status);
-/*          if ((status.Get_tag() == MPI_Ack) && (status.Get_source() == sim ))
-            {
-//              cout << "COLLISION triggered on Sim" << sim << "; Received Ack.." << endl;
-            }       */
+            MPI::COMM_WORLD.Send(NULL, 0, MPI::BYTE, sim, MPI_Model_Run);
+            MPI::COMM_WORLD.Send(&run, sizeof(int), MPI::BYTE, sim, MPI_Model_Run);
         }
 
-//      cout << "Waiting for collision handling" << endl;
-        MPI::COMM_WORLD.Barrier();
-
-        filterInit();
-        if (!(steps % stdUpdateRate) && simMasterCom != NULL)
-            FAN_sendMessage(simMasterCom, "filter", (void *) steps);
-
-        filterDone();
+        // the samples of the run before are taken while this one goes on
+        filter(filtered);
+        steps += run;
+        runs++;
+        filtered = steps;
+    }
 
-        steps++;
+    filter(filtered);
 
-    }
     //MPI::COMM_WORLD.Send(NULL, 0, MPI::BYTE, OVERMIND, MPI_Sim_Halted);
     if (simMasterCom != NULL) {
         FAN_postMessage(simMasterCom, "paused", NULL, NULL);
@@ -451,6 +668,10 @@ void SimCommunicator::updateVars()
     myrank = MPI::COMM_WORLD.Get_rank();
     nprocs = MPI::COMM_WORLD.Get_size();
 
+    // the workers wait for this since they started, see MD3Q19b()
+    if (sampling == MPI::COMM_NULL)
+        sampling = MPI::COMM_WORLD.Dup();
+
     if (receiveBuffer.size() < (unsigned int) nprocs - 1) {
         for (int i = 0; i < nprocs - 1; i++) {
             receiveBufferInfo *rbi = new receiveBufferInfo;
@@ -472,6 +693,7 @@ void SimCommunicator::updateVars()
     updated.accel = stdAcceleration;
     updated.dense = stdDensity;
     updated.relax = stdRelaxation;
+    updated.threads = stdThreads;
 
     for (int sim = 1; sim < nprocs; sim++) {
         MPI::COMM_WORLD.Sendrecv_replace(NULL, 0, MPI::BYTE, sim, MPI_Update_Enviroment, sim, MPI_Ack, s);
@@ -507,21 +729,8 @@ void SimCommunicator::updateVoxels(const Voxels & v)
         MPI::COMM_WORLD.Sendrecv(NULL, 0, MPI::BYTE, sim, MPI_Update_Area, NULL, 0, MPI::BYTE, MPI_ANY_SOURCE, MPI_Ack, status);
     }
 
-    bufferdata out;
-
-    for (int z = z_sub; z < (dim_z - z_sub); z++) {
-        for (int y = y_sub; y < (dim_y - y_sub); y++) {
-            for (int x = x_sub; x < (dim_x - x_sub); x++) {
-                if (v[x - x_sub][y - y_sub][z - z_sub] != voxels[x - x_sub][y - y_sub][z - z_sub]) {
-                    out.x = x % sliceWidth;
-                    out.y = y;
-                    out.z = z;
-
-                    MPI::COMM_WORLD.Send(&out, sizeof(bufferdata), MPI::BYTE, x / sliceWidth + 1, MPI_Update_Field);
-                }
-            }
-        }
-    }
+    for (int sim = 1; sim < nprocs; sim++)
+        sendBlockUpdate(sim, v);
 
     for (int sim = 1; sim < nprocs; sim++) {
         MPI::COMM_WORLD.Send(NULL, 0, MPI::BYTE, sim, MPI_Update_Field_Done);
@@ -547,6 +756,7 @@ void SimCommunicator::setVoxels(const Voxels & v, double f)
 void SimCommunicator::setVoxels(const Voxels & v, double f_x, double f_y, double f_z)
 {
     steps = 0;
+    runs = 0;
 
     voxels = v;
     factor_x = f_x;
@@ -561,23 +771,6 @@ void SimCommunicator::setVoxels(const Voxels & v, double f_x, double f_y, double
     dim_y = (int) ((double) old_dim_y * factor_y);
     dim_z = (int) ((double) old_dim_z * factor_z);
 
-//        cout << "dim: " << dim_x << " procs: " << nprocs << endl;
-    sliceLastWidth = (int) (dim_x % (nprocs - 1));
-    sliceWidth = (int) (dim_x / (nprocs - 1));
-
-    if (sliceLastWidth != 0) {
-        sliceWidth = (int) (dim_x / (nprocs - 2));
-        sliceLastWidth = (int) (dim_x % (nprocs - 2));
-    } else {
-        sliceLastWidth = sliceWidth;
-    }
-
-    if (sliceLastWidth == 0) {
-        sliceLastWidth += 3;
-        dim_x += 3;
-    }
-
-
     if ((dim_x - old_dim_x) % 2)
         dim_x++;
     if ((dim_y - old_dim_y) % 2)
@@ -589,40 +782,27 @@ void SimCommunicator::setVoxels(const Voxels & v, double f_x, double f_y, double
     y_sub = (dim_y - old_dim_y) / 2;
     z_sub = (dim_z - old_dim_z) / 2;
 
-    cout << "DIM: " << dim_x << "/" << dim_y << "/" << dim_z << endl;
+    decomp.setup(dim_x, dim_y, dim_z, nprocs - 1, decompositionMode);
+
+    cout << "DIM: " << dim_x << "/" << dim_y << "/" << dim_z << " on " << decomp.procs[0] << "x" << decomp.procs[1] << "x" << decomp.procs[2] << " workers" << endl;
 
 
-    int last = nprocs - 1;
     for (int sim = 1; sim < nprocs; sim++) {
         MPI::COMM_WORLD.Sendrecv(NULL, 0, MPI::BYTE, sim, MPI_Set_Area, NULL, 0, MPI::BYTE, MPI_ANY_SOURCE, MPI_Ack, status);
         simField data;
 
-        data.dim_x = sliceWidth;
+        data.dim_x = dim_x;
         data.dim_y = dim_y;
         data.dim_z = dim_z;
-
-        if (sim == last) {
-            data.dim_x = sliceLastWidth;
-        }
+        data.procs_x = decomp.procs[0];
+        data.procs_y = decomp.procs[1];
+        data.procs_z = decomp.procs[2];
 
         MPI::COMM_WORLD.Send(&data, sizeof(simField), MPI::BYTE, sim, (MPI_Set_Area + 1));
     }
 
-    bufferdata out;
-
-    for (int z = z_sub; z < (dim_z - z_sub); z++) {
-        for (int y = y_sub; y < (dim_y - y_sub); y++) {
-            for (int x = x_sub; x < (dim_x - x_sub); x++) {
-                if (voxels[x - x_sub][y - y_sub][z - z_sub]) {
-                    out.x = x % sliceWidth;
-                    out.y = y;
-                    out.z = z;
-
-                    MPI::COMM_WORLD.Send(&out, sizeof(bufferdata), MPI::BYTE, x / sliceWidth + 1, MPI_Field);
-                }
-            }
-        }
-    }
+    for (int sim = 1; sim < nprocs; sim++)
+        sendBlock(sim);
 
     for (int sim = 1; sim < nprocs; sim++) {
         MPI::COMM_WORLD.Send(NULL, 0, MPI::BYTE, sim, MPI_Field_Done);
@@ -633,12 +813,80 @@ void SimCommunicator::setVoxels(const Voxels & v, double f_x, double f_y, double
 //  cout << "\t OM " << " synched!";
 }
 
+/*
+ * Sends the solid voxels of the block of sim, packed into a single
+ * MPI_Field_Bulk message (see VoxelCodec.h).
+ */
+void SimCommunicator::sendBlock(int sim)
+{
+    vector<unsigned char> mask;
+    vector<unsigned char> packed;
+
+    blockMask(voxels, NULL, sim, mask);
+    encodeVoxels(&mask[0], mask.size(), packed);
+    MPI::COMM_WORLD.Send(&packed[0], packed.size(), MPI::BYTE, sim, MPI_Field_Bulk);
+}
+
+/*
+ * Sends the cells of the block of sim which differ between the current
+ * voxels and v as a single MPI_Update_Bulk message; the worker toggles
+ * them.
+ */
+void SimCommunicator::sendBlockUpdate(int sim, const Voxels & v)
+{
+    vector<unsigned char> mask;
+    vector<unsigned char> packed;
+
+    blockMask(v, &voxels, sim, mask);
+    encodeVoxels(&mask[0], mask.size(), packed);
+    MPI::COMM_WORLD.Send(&packed[0], packed.size(), MPI::BYTE, sim, MPI_Update_Bulk);
+}
+
+/*
+ * Mask of the block of sim in the lattice order of the worker: the
+ * solid voxels of v, or where v differs from old if given.
+ */
+void SimCommunicator::blockMask(const Voxels & v, const Voxels * old, int sim, vector<unsigned char> &mask)
+{
+    int origin[3], dim[3];
+
+    decomp.box(sim, origin, dim);
+    mask.assign((unsigned long) dim[0] * dim[1] * dim[2], 0);
+
+    int sub[3] = { x_sub, y_sub, z_sub };
+    int lo[3], hi[3];
+    for (int a = 0; a < 3; a++) {
+        lo[a] = max(origin[a], sub[a]);
+        hi[a] = min(origin[a] + dim[a], decomp.size[a] - sub[a]);
+    }
+
+    for (int x = lo[0]; x < hi[0]; x++) {
+        for (int y = lo[1]; y < hi[1]; y++) {
+            const vector<bool> &column = v[x - x_sub][y - y_sub];
+
+            // whole columns compare a word at a time, most don't change
+            if (old && column == (*old)[x - x_sub][y - y_sub])
+                continue;
+
+            for (int z = lo[2]; z < hi[2]; z++) {
+                bool set = column[z - z_sub];
+
+                if (old)
+                    set = set != (*old)[x - x_sub][y - y_sub][z - z_sub];
+                if (set)
+                    mask[((unsigned long) (z - origin[2]) * dim[1] + y - origin[1]) * dim[0] + x - origin[0]] = 1;
+            }
+        }
+    }
+}
+
 void SimCommunicator::haltSim()
 {
     bPauseSim();
 //  cout << "Broadcasting Disconnect to all Processes..";
     for (int c = 1; c < nprocs; c++) {
         MPI::COMM_WORLD.Send(NULL, 0, MPI::BYTE, c, MPI_Disconnect);
+        sampling.Send(NULL, 0, MPI::BYTE, c, MPI_Disconnect);
     }
 }
 
@@ -655,12 +903,8 @@ void SimCommunicator::pushBackCell(int u, int v, int x, int y, int z)
         return;
     }
 
-    int targetSim = ((int) (x / sliceWidth)) + 1;
-
-    if (targetSim > nprocs - 1)
-        targetSim = nprocs - 1;
-
-    targetSim--;
+    int local[3];
+    int targetSim = decomp.owner(x, y, z, local) - 1;
 
     int size = sendBuffer[targetSim]->size;
     int bufferSize = sendBuffer[targetSim]->bufferSize;
@@ -676,9 +920,9 @@ void SimCommunicator::pushBackCell(int u, int v, int x, int y, int z)
 
     sendBuffer[targetSim]->cells[size].u = u;
     sendBuffer[targetSim]->cells[size].v = v;
-    sendBuffer[targetSim]->cells[size].x = x % sliceWidth;
-    sendBuffer[targetSim]->cells[size].y = y;
-    sendBuffer[targetSim]->cells[size].z = z;
+    sendBuffer[targetSim]->cells[size].x = local[0];
+    sendBuffer[targetSim]->cells[size].y = local[1];
+    sendBuffer[targetSim]->cells[size].z = local[2];
     sendBuffer[targetSim]->size++;
 }
 
@@ -695,21 +939,61 @@ void SimCommunicator::getCell(int x, int y, int z, simProbe & probe)
         return;
     }
 
-    int targetSim = ((int) (x / sliceWidth)) + 1;
-
-    if (targetSim > nprocs - 1)
-        targetSim = nprocs - 1;
+    int local[3];
+    int targetSim = decomp.owner(x, y, z, local);
 
     simCoord coord;
-    coord.x = x % sliceWidth;
-    coord.y = y;
-    coord.z = z;
+    coord.x = local[0];
+    coord.y = local[1];
+    coord.z = local[2];
 
-    MPI::COMM_WORLD.Send(&coord, sizeof(simCoord), MPI::BYTE, (int) targetSim, MPI_Get_Cell);
-    MPI::COMM_WORLD.Recv(&probe, sizeof(simProbe), MPI::BYTE, (int) targetSim, MPI_Get_Cell, status);
+    sampling.Send(&coord, sizeof(simCoord), MPI::BYTE, (int) targetSim, MPI_Get_Cell);
+    sampling.Recv(&probe, sizeof(simProbe), MPI::BYTE, (int) targetSim, MPI_Get_Cell, status);
 }
 
 
+/*
+ * Queries for single cells, collected until flushCells() fetches them
+ * with one request per worker. queueCell() returns where the cell will
+ * be found in queued[]; cells outside of the lattice read as solid.
+ */
+int SimCommunicator::queueCell(int x, int y, int z)
+{
+    simProbe outside;
+
+    outside.mv_x = outside.mv_y = outside.mv_z = 0;
+    outside.density = 0;
+    outside.solid = true;
+
+    if (queuedCells++ == 0) {
+        initSendBuffer();
+        queued.clear();
+    }
+
+    int ticket = queued.size();
+    queued.push_back(outside);
+
+    // u carries the ticket through the worker
+    pushBackCell(ticket, 0, x, y, z);
+
+    return ticket;
+}
+
+void SimCommunicator::flushCells()
+{
+    if (queuedCells == 0)
+        return;
+
+    getCells();
+
+    for (unsigned int i = 0; i < sendBuffer.size(); i++)
+        for (int j = 0; j < sendBuffer[i]->size; j++)
+            queued[sendBuffer[i]->cells[j].u] = receiveBuffer[i]->probes[j];
+
+    initSendBuffer();
+    queuedCells = 0;
+}
+
 void SimCommunicator::getCells()
 {
     unsigned int count = 0;
@@ -721,8 +1005,8 @@ void SimCommunicator::getCells()
 
         if (size > 0) {
             count++;
-            MPI::COMM_WORLD.Send(&size, sizeof(int), MPI::BYTE, (int) i + 1, MPI_Set_Req_Size);
-            MPI::COMM_WORLD.Send(buffer, sizeof(bufferdata) * size, MPI::BYTE, (int) i + 1, MPI_Get_Cells);
+            sampling.Send(&size, sizeof(int), MPI::BYTE, (int) i + 1, MPI_Set_Req_Size);
+            sampling.Send(buffer, sizeof(bufferdata) * size, MPI::BYTE, (int) i + 1, MPI_Get_Cells);
         }
     }
 
@@ -730,13 +1014,13 @@ void SimCommunicator::getCells()
     int rsize;
 
     for (unsigned int n = 0; n < count * 3; n++) {
-        MPI::COMM_WORLD.Probe(MPI_ANY_SOURCE, MPI_ANY_TAG, status);
+        sampling.Probe(MPI_ANY_SOURCE, MPI_ANY_TAG, status);
         i = status.Get_source() - 1;
 
         switch (status.Get_tag()) {
         case MPI_Send_MinMax:
             {
-                MPI::COMM_WORLD.Recv(&m_minmax, sizeof(minmax_t), MPI::BYTE, i + 1, MPI_Send_MinMax, status);
+                sampling.Recv(&m_minmax, sizeof(minmax_t), MPI::BYTE, i + 1, MPI_Send_MinMax, status);
                 if (m_minmax.min_density < minmax.min_density)
                     minmax.min_density = m_minmax.min_density;
                 if (m_minmax.max_density > minmax.max_density)
@@ -749,7 +1033,7 @@ void SimCommunicator::getCells()
             }
         case MPI_Set_Resp_Size:
             {
-                MPI::COMM_WORLD.Recv(&rsize, sizeof(int), MPI::BYTE, i + 1, MPI_Set_Resp_Size, status);
+                sampling.Recv(&rsize, sizeof(int), MPI::BYTE, i + 1, MPI_Set_Resp_Size, status);
                 if (rsize > receiveBuffer[i]->bufferSize) {
                     delete[]receiveBuffer[i]->probes;
                     receiveBuffer[i]->probes = new simProbe[rsize];
@@ -760,7 +1044,7 @@ void SimCommunicator::getCells()
             }
         case MPI_Get_Cells:
             {
-                MPI::COMM_WORLD.Recv(receiveBuffer[i]->probes, sizeof(simProbe) * receiveBuffer[i]->size, MPI::BYTE, i + 1, MPI_Get_Cells, status);
+                sampling.Recv(receiveBuffer[i]->probes, sizeof(simProbe) * receiveBuffer[i]->size, MPI::BYTE, i + 1, MPI_Get_Cells, status);
                 break;
             }
         }
@@ -2,8 +2,10 @@
 #define SIMCOMMUNICATOR_H
 
 #include <vector>
+#include <pthread.h>
 #include <mpi.h>
 #include "types.h"
+#include "Decomposition.h"
 #include "../common/simRemoteTypes.h"
 
 class SimCommunicator
@@ -26,6 +28,10 @@ class SimCommunicator
         void setDensity (double density)    {stdDensity = density;};
         void setRelax   (double relax)      {stdRelaxation = relax;};
         void setUpdateRate   (int rate)      {stdUpdateRate = rate;};
+        void setThreads (int threads)       {stdThreads = threads;};
+        void setDecomposition (int mode)    {decompositionMode = mode;};
+        void setVolumeResolution (int res)  {stdVolumeResolution = res > 0 ? res : 1;};
+        void setInterpolation (bool on)     {stdInterpolation = on;};
 
         double getAbs(const vertex_t &rot);
 
@@ -35,9 +41,11 @@ class SimCommunicator
         void getV(const int &x, const int &y, const int &z, simProbe &cell, vertex_t &v);
 
         point_sample      *computePointSample(sample_save_type *sample_desc);
+        // the workers stop recording the point with the next filterInit()
+        void forgetPoint(int id);
         planar_sample     *computePlanarSample(sample_save_type *sample_desc);
         volume_sample     *computeVolumeSample(sample_save_type *sample_desc);
-        glyph_probe_data  *computeGlyphSample(sample_save_type *sample_desc);
+        glyph_probe_data  *computeGlyphSample(sample_save_type *sample_desc, double voxelSize);
         ribbon_probe_data *computeRibbonSample(sample_save_type *sample_desc, double voxelSize);
         
         //Sim-Controllers
@@ -54,7 +62,13 @@ class SimCommunicator
         void simStepOn();
         
     private:
-        void sendSlice(int sim, int min_x, int max_x);
+        // voxels of one block, or what changed in it, as a single message
+        void sendBlock(int sim);
+        void sendBlockUpdate(int sim, const Voxels& v);
+        void blockMask(const Voxels& v, const Voxels* old, int sim, vector<unsigned char>& mask);
+
+        // one round of samples, see simStepOn()
+        void filter(int step);
         
         bool simulating;
         
@@ -62,12 +76,18 @@ class SimCommunicator
 
         //MPI variables
         MPI::Status status;
+
+        // everything but stepping the workers, they serve it from a
+        // snapshot of the last run in a thread of their own
+        MPI::Intracomm sampling;
     
         int steps;
+        int runs;       // sent since the area was set
         int myrank, nprocs;
         int dim_x, dim_y, dim_z;
         int z_sub, y_sub, x_sub;
-        int sliceWidth, sliceLastWidth;
+        Decomposition decomp;
+        int decompositionMode;
         double factor_x, factor_y, factor_z;
         bool m_running;
 
@@ -77,13 +97,31 @@ class SimCommunicator
         
         double stdAcceleration, stdDensity, stdRelaxation;
         int stdUpdateRate;
+        int stdThreads;
+        int stdVolumeResolution;    // grid points per edge of a volume sample
+        bool stdInterpolation;      // planar samples between the cell centres
         
         void initSendBuffer();
         void pushBackCell(int u, int v, int x, int y, int z);
         void getCell(int x, int y, int z, simProbe &probe);
         void getCells();
 
-        void integrateEuler(const vertex_t &pos, const vertex_t &dir, vertex_t &out, double stepsize);
+        // batched queries for single cells, one round trip per worker
+        int queueCell(int x, int y, int z);
+        int queueAround(int x, int y, int z);
+        void flushCells();
+        vector<simProbe> queued;
+        int queuedCells;
+
+        // deleted point probes, queued by the simMaster thread
+        vector<int> forgottenPoints;
+        pthread_mutex_t forgottenLock;
+
+        void rotation(const simProbe *around, const double &h, vertex_t &rot);
+
+        // resampling on the workers, see computeVolumeSample()
+        int gridSize(const double *edge, int limit);
+        void sampleGrid(const volumeRequest *request, double *values, double &min, double &max);
 };
 
 #endif
@@ -0,0 +1,76 @@
+/*
+ * Propagation and collision in a single sweep over the lattice, updated
+ * in place after the AA pattern (Bailey et al., 2009):
+ *
+ * even step (parity 0): every cell reads its f_i from plane i, collides
+ *	and writes the result back into its own cell, but into the plane
+ *	of the opposite direction.
+ *
+ * odd step (parity 1): every cell pulls f_i from the neighbour at
+ *	x - e_i (where the even step left it in the opposite plane),
+ *	collides and pushes the result to x + e_i, plane i.
+ *
+ * Both steps read and write each population once, and a cell only ever
+ * touches locations no other cell touches in the same step, so the
+ * cells can be processed in any order, or by several threads working on
+ * disjoint sets of rows without any locking. For a solid cell the bounceback
+ * writes every value back to where it was read, which means solid cells
+ * simply keep their memory untouched.
+ */
+#include <vector>
+
+using namespace std;
+
+#include "StreamCollide.h"
+
+void streamCollide(Lattice * lattice, collisionKernel collide, double tau_inv,
+                   unsigned long first, unsigned long last, minmax_t * minmax)
+{
+    streamCollide(lattice, collide, tau_inv, first, last, 0, lattice->dim_x, minmax);
+}
+
+void streamCollide(Lattice * lattice, collisionKernel collide, double tau_inv,
+                   unsigned long first, unsigned long last, int x0, int x1, minmax_t * minmax)
+{
+    double **f = lattice->f;
+    long offset[LATTICE_Q];
+
+    for (unsigned int i = 0; i < LATTICE_Q; i++)
+        offset[i] = lattice->offset(i);
+
+    collisionRow row;
+    row.cells = x1 - x0;
+    row.tau_inv = tau_inv;
+
+    for (unsigned long r = first; r < last; r++) {
+        long n = lattice->index(x0, r % lattice->dim_y, r / lattice->dim_y);
+
+        for (unsigned int i = 0; i < LATTICE_Q; i++) {
+            int inv = lattice_inv[i];
+
+            if (!lattice->parity) {
+                row.src[i] = f[i] + n;
+                row.dst[i] = f[inv] + n;
+            } else {
+                row.src[i] = f[inv] + n - offset[i];
+                row.dst[i] = f[i] + n + offset[i];
+            }
+        }
+        row.solid = lattice->solid + n;
+        row.density = lattice->density + n;
+        row.mv_x = lattice->mv_x + n;
+        row.mv_y = lattice->mv_y + n;
+        row.mv_z = lattice->mv_z + n;
+
+        collide(&row, minmax);
+    }
+}
+
+double *collided(Lattice * lattice, int i, long n)
+{
+    // parity was flipped by the step: 1 after an even, 0 after an odd one
+    if (lattice->parity)
+        return lattice->f[lattice_inv[i]] + n;
+
+    return lattice->f[i] + n + lattice->offset(i);
+}
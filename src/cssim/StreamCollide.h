@@ -0,0 +1,19 @@
+#ifndef STREAMCOLLIDE_H
+#define STREAMCOLLIDE_H
+
+#include "Lattice.h"
+#include "Collision.h"
+
+// one fused propagation and collision step of the rows first <= r < last
+// (see Lattice::rows()); flip lattice->parity once all rows are done
+void streamCollide(Lattice *lattice, collisionKernel collide, double tau_inv,
+                   unsigned long first, unsigned long last, minmax_t *minmax);
+
+// the same for the cells x0 <= x < x1 of the rows only
+void streamCollide(Lattice *lattice, collisionKernel collide, double tau_inv,
+                   unsigned long first, unsigned long last, int x0, int x1, minmax_t *minmax);
+
+// where the collided f_i of cell n went in the last step
+double *collided(Lattice *lattice, int i, long n);
+
+#endif
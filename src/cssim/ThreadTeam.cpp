@@ -0,0 +1,135 @@
+#include <vector>
+#include <iostream>
+
+using namespace std;
+
+#include "ThreadTeam.h"
+
+ThreadTeam::ThreadTeam()
+{
+    members = 1;
+    generation = 0;
+    pending = 0;
+    stopping = false;
+    job = NULL;
+    arg = NULL;
+
+    pthread_mutex_init(&lock, NULL);
+    pthread_cond_init(&started, NULL);
+    pthread_cond_init(&finished, NULL);
+}
+
+ThreadTeam::~ThreadTeam()
+{
+    stop();
+
+    pthread_cond_destroy(&finished);
+    pthread_cond_destroy(&started);
+    pthread_mutex_destroy(&lock);
+}
+
+void *ThreadTeam::startMember(void *info)
+{
+    memberInfo *member = (memberInfo *) info;
+
+    member->team->memberLoop(member);
+    return NULL;
+}
+
+void ThreadTeam::resize(int n)
+{
+    if (n < 1)
+        n = 1;
+    if (n == members)
+        return;
+
+    stop();
+
+    // the entries must not move once the threads got their address
+    threads.resize(n - 1);
+    members = n;
+
+    for (int k = 0; k < n - 1; k++) {
+        threads[k].team = this;
+        threads[k].id = k + 1;
+        threads[k].generation = generation;
+
+        int rc = pthread_create(&threads[k].thread, NULL, startMember, &threads[k]);
+        if (rc) {
+            cerr << "ThreadTeam: could not create member " << k + 1 << ", " << rc << " returned by pthread_create" << endl;
+            threads.resize(k);
+            members = k + 1;
+            break;
+        }
+    }
+}
+
+void ThreadTeam::stop()
+{
+    pthread_mutex_lock(&lock);
+    stopping = true;
+    pthread_cond_broadcast(&started);
+    pthread_mutex_unlock(&lock);
+
+    for (unsigned int k = 0; k < threads.size(); k++)
+        pthread_join(threads[k].thread, NULL);
+
+    threads.clear();
+    members = 1;
+    stopping = false;
+}
+
+void ThreadTeam::run(job_t job, void *arg)
+{
+    if (members > 1) {
+        pthread_mutex_lock(&lock);
+        this->job = job;
+        this->arg = arg;
+        pending = members - 1;
+        generation++;
+        pthread_cond_broadcast(&started);
+        pthread_mutex_unlock(&lock);
+    }
+
+    job(arg, 0, members);
+
+    if (members > 1) {
+        pthread_mutex_lock(&lock);
+        while (pending)
+            pthread_cond_wait(&finished, &lock);
+        pthread_mutex_unlock(&lock);
+    }
+}
+
+void ThreadTeam::memberLoop(memberInfo * info)
+{
+    pthread_mutex_lock(&lock);
+
+    for (;;) {
+        while (info->generation == generation && !stopping)
+            pthread_cond_wait(&started, &lock);
+        if (stopping)
+            break;
+
+        info->generation = generation;
+        job_t current = job;
+        void *currentArg = arg;
+        int count = members;
+        pthread_mutex_unlock(&lock);
+
+        current(currentArg, info->id, count);
+
+        pthread_mutex_lock(&lock);
+        if (!--pending)
+            pthread_cond_signal(&finished);
+    }
+
+    pthread_mutex_unlock(&lock);
+}
+
+void ThreadTeam::split(unsigned long count, int member, int members,
+                       unsigned long *first, unsigned long *last)
+{
+    *first = count * member / members;
+    *last = count * (member + 1) / members;
+}
@@ -0,0 +1,63 @@
+#ifndef THREADTEAM_H
+#define THREADTEAM_H
+
+#include <vector>
+#include <pthread.h>
+
+/*
+ * A fixed team of threads inside one worker process.
+ *
+ * run() hands the same job to every member, the calling thread takes
+ * part as member 0, and returns once all members are done (fork-join).
+ * Members keep waiting on a condition variable between two jobs, so a
+ * step does not pay for thread creation. Only member 0 may talk MPI.
+ */
+class ThreadTeam
+{
+public:
+	typedef void (*job_t)(void *arg, int member, int members);
+
+	ThreadTeam();
+	virtual ~ThreadTeam();
+
+	// (re)starts the team with n members, the caller included
+	void resize(int n);
+	int size() const { return members; };
+
+	void run(job_t job, void *arg);
+
+	// the part [first, last) of count items which belongs to member
+	static void split(unsigned long count, int member, int members,
+	                  unsigned long *first, unsigned long *last);
+
+private:
+	struct memberInfo
+	{
+		ThreadTeam *team;
+		int id;
+		unsigned long generation;
+		pthread_t thread;
+	};
+
+	static void *startMember(void *info);
+	void memberLoop(memberInfo *info);
+	void stop();
+
+	int members;
+
+	pthread_mutex_t lock;
+	pthread_cond_t started;
+	pthread_cond_t finished;
+
+	// bumped for every job, members compare against the one they ran last
+	unsigned long generation;
+	int pending;
+	bool stopping;
+
+	job_t job;
+	void *arg;
+
+	std::vector<memberInfo> threads;
+};
+
+#endif
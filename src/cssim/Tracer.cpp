@@ -0,0 +1,371 @@
+#include <vector>
+#include <math.h>
+
+using namespace std;
+
+#include "Tracer.h"
+#include "mpitags.h"
+
+// particles slower than this have come to a halt
+#define TRACE_EPS	0.00001
+
+// direction d as a number 0 .. 26, added to the tags
+static int direction(const int *d)
+{
+    return (d[0] + 1) * 9 + (d[1] + 1) * 3 + (d[2] + 1);
+}
+
+void Tracer::setup(const Decomposition * decomp, int rank, const MPI::Intracomm & comm)
+{
+    int c[3];
+
+    this->comm = comm;
+    this->decomp = decomp;
+    decomp->coords(rank, c);
+    decomp->box(rank, origin, dim);
+
+    links.clear();
+
+    int d[3];
+    for (d[0] = -1; d[0] <= 1; d[0]++) {
+        for (d[1] = -1; d[1] <= 1; d[1]++) {
+            for (d[2] = -1; d[2] <= 1; d[2]++) {
+                if (!d[0] && !d[1] && !d[2])
+                    continue;
+
+                int shift;
+                int nb = decomp->neighbour(c, d, &shift);
+                if (nb < 0)
+                    continue;
+
+                link l;
+                int back[3] = { -d[0], -d[1], -d[2] };
+                int cells = 1;
+
+                l.rank = nb;
+                l.sendTag = direction(d);
+                l.recvTag = direction(back);
+
+                for (int a = 0; a < 3; a++) {
+                    l.d[a] = d[a];
+                    l.lo[a] = d[a] > 0 ? dim[a] - 1 : 0;
+                    l.hi[a] = d[a] < 0 ? 1 : dim[a];
+                    l.ghostLo[a] = d[a] < 0 ? -1 : d[a] > 0 ? dim[a] : 0;
+                    l.ghostHi[a] = d[a] ? l.ghostLo[a] + 1 : dim[a];
+                    cells *= l.hi[a] - l.lo[a];
+                }
+
+                l.sendBuffer.resize(4 * cells);
+                l.recvBuffer.resize(4 * cells);
+                links.push_back(l);
+            }
+        }
+    }
+
+    requests.resize(2 * links.size());
+}
+
+/*
+ * Copies the density and velocity of the cells next to the block into
+ * our ghost shell. Solid cells go out as standing still and without
+ * density, the shell at the walls of the lattice stays zero.
+ */
+void Tracer::shareFields(Lattice * lattice)
+{
+    for (unsigned int k = 0; k < links.size(); k++) {
+        link &l = links[k];
+
+        requests[2 * k] = comm.Irecv(&l.recvBuffer[0], l.recvBuffer.size() * sizeof(double), MPI::BYTE, l.rank, MPI_Data_Velocity + l.recvTag);
+    }
+
+    for (unsigned int k = 0; k < links.size(); k++) {
+        link &l = links[k];
+        unsigned int s = 0;
+
+        for (int z = l.lo[2]; z < l.hi[2]; z++) {
+            for (int y = l.lo[1]; y < l.hi[1]; y++) {
+                for (int x = l.lo[0]; x < l.hi[0]; x++) {
+                    long n = lattice->index(x, y, z);
+
+                    l.sendBuffer[s] = lattice->solid[n] ? 0.0 : lattice->density[n];
+                    cellVelocity(lattice, x, y, z, &l.sendBuffer[s + 1]);
+                    s += 4;
+                }
+            }
+        }
+
+        requests[2 * k + 1] = comm.Isend(&l.sendBuffer[0], l.sendBuffer.size() * sizeof(double), MPI::BYTE, l.rank, MPI_Data_Velocity + l.sendTag);
+    }
+
+    if (!requests.empty())
+        MPI::Request::Waitall(requests.size(), &requests[0]);
+
+    for (unsigned int k = 0; k < links.size(); k++) {
+        link &l = links[k];
+        unsigned int s = 0;
+
+        for (int z = l.ghostLo[2]; z < l.ghostHi[2]; z++) {
+            for (int y = l.ghostLo[1]; y < l.ghostHi[1]; y++) {
+                for (int x = l.ghostLo[0]; x < l.ghostHi[0]; x++) {
+                    long n = lattice->index(x, y, z);
+
+                    lattice->density[n] = l.recvBuffer[s++];
+                    lattice->mv_x[n] = l.recvBuffer[s++];
+                    lattice->mv_y[n] = l.recvBuffer[s++];
+                    lattice->mv_z[n] = l.recvBuffer[s++];
+                }
+            }
+        }
+    }
+}
+
+// passes the particles which left the block on and takes in the new ones
+void Tracer::handOver(vector<particle> &local)
+{
+    MPI::Status status;
+
+    for (unsigned int k = 0; k < links.size(); k++) {
+        link &l = links[k];
+
+        requests[k] = comm.Isend(l.leaving.empty() ? NULL : &l.leaving[0], l.leaving.size() * sizeof(particle), MPI::BYTE, l.rank, MPI_Data_Particles + l.sendTag);
+    }
+
+    for (unsigned int k = 0; k < links.size(); k++) {
+        link &l = links[k];
+
+        comm.Probe(l.rank, MPI_Data_Particles + l.recvTag, status);
+        l.arriving.resize(status.Get_count(MPI::BYTE) / sizeof(particle));
+        comm.Recv(l.arriving.empty() ? NULL : &l.arriving[0], l.arriving.size() * sizeof(particle), MPI::BYTE, l.rank, MPI_Data_Particles + l.recvTag, status);
+
+        local.insert(local.end(), l.arriving.begin(), l.arriving.end());
+    }
+
+    if (!links.empty())
+        MPI::Request::Waitall(links.size(), &requests[0]);
+
+    for (unsigned int k = 0; k < links.size(); k++)
+        links[k].leaving.clear();
+}
+
+void Tracer::trace(Lattice * lattice, const traceRequest * request, const traceSeed * seeds, vector<traceVertex> &out)
+{
+    vector<particle> local;
+
+    out.clear();
+    shareFields(lattice);
+
+    for (int i = 0; i < request->seeds; i++) {
+        particle q;
+
+        q.ribbon = seeds[i].ribbon;
+        q.seq = 0;
+        q.steps = 0;
+        q.p[0] = seeds[i].x;
+        q.p[1] = seeds[i].y;
+        q.p[2] = seeds[i].z;
+        q.last[0] = q.last[1] = q.last[2] = -1;
+
+        int c[3] = { (int) floor(q.p[0]), (int) floor(q.p[1]), (int) floor(q.p[2]) };
+        if (inBlock(c))
+            local.push_back(q);
+    }
+
+    for (;;) {
+        for (unsigned int i = 0; i < local.size(); i++)
+            advance(lattice, request, local[i], out);
+
+        local.clear();
+        handOver(local);
+
+        int mine = local.size();
+        int total = 0;
+
+        comm.Allreduce(&mine, &total, 1, MPI::INT, MPI::SUM);
+        if (!total)
+            break;
+    }
+}
+
+bool Tracer::inBlock(const int *c) const
+{
+    for (int a = 0; a < 3; a++)
+        if (c[a] < origin[a] || c[a] >= origin[a] + dim[a])
+            return false;
+    return true;
+}
+
+void Tracer::cellVelocity(const Lattice * lattice, int x, int y, int z, double *u) const
+{
+    long n = lattice->index(x, y, z);
+
+    if (lattice->inside(x, y, z) && lattice->solid[n]) {
+        u[0] = u[1] = u[2] = 0.0;
+        return;
+    }
+
+    u[0] = lattice->mv_x[n];
+    u[1] = lattice->mv_y[n];
+    u[2] = lattice->mv_z[n];
+}
+
+/*
+ * Trilinear interpolation between the cell centres around p (global
+ * lattice coordinates). Points further out than the ghost shell are
+ * pulled back onto it.
+ */
+void Tracer::velocity(const Lattice * lattice, const double *p, double *u) const
+{
+    int i[3];
+    double w[3];
+
+    for (int a = 0; a < 3; a++) {
+        double q = p[a] - origin[a] - 0.5;
+
+        if (q < -1.0)
+            q = -1.0;
+        if (q > dim[a])
+            q = dim[a];
+
+        i[a] = (int) floor(q);
+        if (i[a] >= dim[a])
+            i[a] = dim[a] - 1;
+        w[a] = q - i[a];
+    }
+
+    u[0] = u[1] = u[2] = 0.0;
+
+    for (int k = 0; k < 8; k++) {
+        int dx = k & 1, dy = (k >> 1) & 1, dz = k >> 2;
+        double weight = (dx ? w[0] : 1.0 - w[0]) * (dy ? w[1] : 1.0 - w[1]) * (dz ? w[2] : 1.0 - w[2]);
+        double v[3];
+
+        cellVelocity(lattice, i[0] + dx, i[1] + dy, i[2] + dz, v);
+        u[0] += weight * v[0];
+        u[1] += weight * v[1];
+        u[2] += weight * v[2];
+    }
+}
+
+// widening of the ribbon at cell c, the same as SimCommunicator::rotation()
+void Tracer::rotation(const Lattice * lattice, const int *c, double *rot) const
+{
+    int x = c[0] - origin[0], y = c[1] - origin[1], z = c[2] - origin[2];
+    double v1[3], v2[3], dx[3], dy[3], dz[3];
+
+    cellVelocity(lattice, x - 1, y, z, v1);
+    cellVelocity(lattice, x + 1, y, z, v2);
+    for (int a = 0; a < 3; a++)
+        dx[a] = (v1[a] + v2[a]) / 2.0;
+
+    cellVelocity(lattice, x, y - 1, z, v1);
+    cellVelocity(lattice, x, y + 1, z, v2);
+    for (int a = 0; a < 3; a++)
+        dy[a] = (v1[a] + v2[a]) / 2.0;
+
+    cellVelocity(lattice, x, y, z - 1, v1);
+    cellVelocity(lattice, x, y, z + 1, v2);
+    for (int a = 0; a < 3; a++)
+        dz[a] = (v1[a] + v2[a]) / 2.0;
+
+    rot[0] = dz[1] - dy[2];
+    rot[1] = dx[2] - dz[0];
+    rot[2] = dy[0] - dx[1];
+}
+
+/*
+ * Follows particle q until it stops or leaves the block, RK4 with steps
+ * of request->stepLength cells.
+ */
+void Tracer::advance(Lattice * lattice, const traceRequest * request, particle &q, vector<traceVertex> &out)
+{
+    // enough to cross every cell of the ribbon a few times
+    int maxSteps = (int) (4 * request->maxVertices / request->stepLength);
+
+    for (;;) {
+        int c[3], d[3];
+        bool outside = false;
+
+        for (int a = 0; a < 3; a++) {
+            c[a] = (int) floor(q.p[a]);
+            if (c[a] < 0 || c[a] >= decomp->size[a])
+                return;
+            d[a] = c[a] < origin[a] ? -1 : c[a] >= origin[a] + dim[a] ? 1 : 0;
+            outside = outside || d[a];
+        }
+
+        if (outside) {
+            for (unsigned int k = 0; k < links.size(); k++) {
+                if (links[k].d[0] == d[0] && links[k].d[1] == d[1] && links[k].d[2] == d[2]) {
+                    links[k].leaving.push_back(q);
+                    break;
+                }
+            }
+            return;
+        }
+
+        double k1[3];
+        velocity(lattice, q.p, k1);
+        double val = sqrt(k1[0] * k1[0] + k1[1] * k1[1] + k1[2] * k1[2]);
+
+        if (val < TRACE_EPS)
+            return;
+
+        if (c[0] != q.last[0] || c[1] != q.last[1] || c[2] != q.last[2]) {
+            if (lattice->solid[lattice->index(c[0] - origin[0], c[1] - origin[1], c[2] - origin[2])])
+                return;
+
+            traceVertex v;
+            double rot[3];
+
+            rotation(lattice, c, rot);
+
+            v.ribbon = q.ribbon;
+            v.seq = q.seq;
+            v.x = q.p[0];
+            v.y = q.p[1];
+            v.z = q.p[2];
+            v.dx = rot[0] * request->height / val;
+            v.dy = rot[1] * request->height / val;
+            v.dz = rot[2] * request->height / val;
+            v.value = val;
+            out.push_back(v);
+
+            q.last[0] = c[0];
+            q.last[1] = c[1];
+            q.last[2] = c[2];
+
+            if (++q.seq >= request->maxVertices)
+                return;
+        }
+
+        if (++q.steps > maxSteps)
+            return;
+
+        double h = request->stepLength / val;
+        double k2[3], k3[3], k4[3], p[3];
+
+        for (int a = 0; a < 3; a++)
+            p[a] = q.p[a] + h / 2.0 * k1[a];
+        velocity(lattice, p, k2);
+
+        for (int a = 0; a < 3; a++)
+            p[a] = q.p[a] + h / 2.0 * k2[a];
+        velocity(lattice, p, k3);
+
+        for (int a = 0; a < 3; a++)
+            p[a] = q.p[a] + h * k3[a];
+        velocity(lattice, p, k4);
+
+        double step[3], length = 0.0;
+
+        for (int a = 0; a < 3; a++) {
+            step[a] = h / 6.0 * (k1[a] + 2.0 * k2[a] + 2.0 * k3[a] + k4[a]);
+            length += step[a] * step[a];
+        }
+
+        // never further than into the next block
+        length = sqrt(length);
+        for (int a = 0; a < 3; a++)
+            q.p[a] += length > 1.0 ? step[a] / length : step[a];
+    }
+}
@@ -0,0 +1,81 @@
+#ifndef TRACER_H
+#define TRACER_H
+
+#include <vector>
+#include <mpi.h>
+
+#include "types.h"
+#include "Lattice.h"
+#include "Decomposition.h"
+
+/*
+ * Ribbon tracing on the workers.
+ *
+ * Every worker integrates the seeds inside its own block with RK4 on
+ * the trilinearly interpolated velocity, so it first copies the
+ * velocities of the cells around its block into the ghost shell of the
+ * mv planes (corners included, which is why this does not go through
+ * Halo). shareFields() brings the density along, MD3Q19b::sampleVolume()
+ * interpolates with it too. A particle which crosses into a neighbour's block is handed
+ * over at the end of a round; the rounds end once no worker has any
+ * particles left. The overmind takes part in the Allreduce which
+ * decides that, with nothing to contribute.
+ *
+ * A vertex is emitted whenever a particle enters a new cell, like the
+ * overmind did when it traced the ribbons itself. A particle stops when
+ * it leaves the lattice, enters a solid cell, stalls or has its ribbon
+ * complete.
+ */
+class Tracer
+{
+public:
+	// all messages go through comm, which the overmind has to use too
+	void setup(const Decomposition *decomp, int rank, const MPI::Intracomm &comm);
+	void trace(Lattice *lattice, const traceRequest *request, const traceSeed *seeds,
+	           std::vector<traceVertex> &out);
+
+	// fills the ghost shell of the density and mv planes, all workers at once
+	void shareFields(Lattice *lattice);
+
+private:
+	struct particle
+	{
+		int ribbon;
+		int seq;		// vertices emitted so far
+		int steps;
+		int last[3];	// cell of the last vertex
+		double p[3];
+	};
+
+	struct link
+	{
+		int rank;
+		int d[3];
+		int sendTag;
+		int recvTag;
+		int lo[3], hi[3];		// our cells facing the neighbour
+		int ghostLo[3], ghostHi[3];	// ghost cells the neighbour fills
+		std::vector<double> sendBuffer;
+		std::vector<double> recvBuffer;
+		std::vector<particle> leaving;
+		std::vector<particle> arriving;
+	};
+
+	MPI::Intracomm comm;
+	const Decomposition *decomp;
+	int origin[3];
+	int dim[3];
+	std::vector<link> links;
+	std::vector<MPI::Request> requests;
+
+	void handOver(std::vector<particle> &local);
+
+	bool inBlock(const int *c) const;
+	void velocity(const Lattice *lattice, const double *p, double *u) const;
+	void cellVelocity(const Lattice *lattice, int x, int y, int z, double *u) const;
+	void rotation(const Lattice *lattice, const int *c, double *rot) const;
+	void advance(Lattice *lattice, const traceRequest *request, particle &q,
+	             std::vector<traceVertex> &out);
+};
+
+#endif
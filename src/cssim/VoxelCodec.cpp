@@ -0,0 +1,102 @@
+#include <vector>
+#include <string.h>
+
+using namespace std;
+
+#include "VoxelCodec.h"
+
+#define VOXELS_BITS	0
+#define VOXELS_RUNS	1
+
+// 7 bits per byte, the high bit marks that more bytes follow
+static void putVarint(vector<unsigned char> &out, unsigned long v)
+{
+    while (v >= 0x80) {
+        out.push_back((unsigned char) (v | 0x80));
+        v >>= 7;
+    }
+    out.push_back((unsigned char) v);
+}
+
+static bool getVarint(const unsigned char *&in, const unsigned char *end, unsigned long *v)
+{
+    *v = 0;
+    for (unsigned int shift = 0; in < end && shift < 8 * sizeof(unsigned long); shift += 7) {
+        unsigned char b = *in++;
+
+        *v |= (unsigned long) (b & 0x7f) << shift;
+        if (!(b & 0x80))
+            return true;
+    }
+    return false;
+}
+
+void encodeVoxels(const unsigned char *mask, unsigned long cells, vector<unsigned char> &out)
+{
+    out.clear();
+    out.push_back(VOXELS_RUNS);
+
+    unsigned long bitsSize = 1 + (cells + 7) / 8;
+    unsigned long n = 0;
+    bool solid = false;
+
+    while (n < cells) {
+        unsigned long run = 0;
+
+        while (n < cells && !mask[n] == !solid) {
+            run++;
+            n++;
+        }
+        putVarint(out, run);
+        solid = !solid;
+
+        // give up on runs as soon as they can't win anymore
+        if (out.size() >= bitsSize)
+            break;
+    }
+
+    if (out.size() < bitsSize)
+        return;
+
+    out.assign(bitsSize, 0);
+    out[0] = VOXELS_BITS;
+    for (n = 0; n < cells; n++)
+        if (mask[n])
+            out[1 + n / 8] |= 1 << (n % 8);
+}
+
+bool decodeVoxels(const unsigned char *in, unsigned long size, unsigned char *mask, unsigned long cells)
+{
+    const unsigned char *end = in + size;
+
+    if (!size)
+        return false;
+
+    switch (*in++) {
+    case VOXELS_BITS:
+        if (size != 1 + (cells + 7) / 8)
+            return false;
+        for (unsigned long n = 0; n < cells; n++)
+            mask[n] = (in[n / 8] >> (n % 8)) & 1;
+        return true;
+
+    case VOXELS_RUNS:
+        {
+            unsigned long n = 0;
+            unsigned char solid = 0;
+
+            while (in < end) {
+                unsigned long run;
+
+                if (!getVarint(in, end, &run) || run > cells - n)
+                    return false;
+                memset(mask + n, solid, run);
+                n += run;
+                solid = !solid;
+            }
+            return n == cells;
+        }
+    }
+
+    return false;
+}
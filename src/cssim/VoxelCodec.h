@@ -0,0 +1,21 @@
+#ifndef VOXELCODEC_H
+#define VOXELCODEC_H
+
+#include <vector>
+
+/*
+ * Compact encoding of a solid mask, so the voxels of a whole slice go to
+ * a worker in a single message.
+ *
+ * The mask holds one byte per cell (non zero = solid) in the order of
+ * the lattice rows, x fastest. The encoder writes whichever is shorter:
+ * the mask packed to one bit per cell, or the lengths of alternating
+ * fluid/solid runs (starting with fluid) as variable length integers.
+ * The first byte tells which one follows.
+ */
+void encodeVoxels(const unsigned char *mask, unsigned long cells, std::vector<unsigned char> &out);
+
+// false if the buffer is malformed or does not describe exactly cells cells
+bool decodeVoxels(const unsigned char *in, unsigned long size, unsigned char *mask, unsigned long cells);
+
+#endif
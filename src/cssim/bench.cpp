@@ -0,0 +1,322 @@
+/*
+ * Standalone benchmark of the worker's lattice kernels.
+ *
+ * Runs the fused propagation/collision sweep of MD3Q19b on synthetic
+ * domains, without MPI and without a ModelServer, and reports the
+ * throughput in MLUPS (million lattice cell updates per second) together
+ * with the memory traffic the AA pattern implies and the time spent in
+ * each phase of a step.
+ *
+ *	bench [-d channel|cavity|porous|all] [-s x,y,z] [-n steps]
+ *	      [-t threads] [-k scalar|sse2|avx2|avx512]
+ *
+ * The domain is periodic in x, exactly as the ring of workers sees it
+ * with a single rank. The mass printed last must not drift; use it to
+ * check a kernel variant before trusting its numbers.
+ */
+#include <vector>
+#include <iostream>
+#include <iomanip>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <time.h>
+
+using namespace std;
+
+#include "Lattice.h"
+#include "Collision.h"
+#include "StreamCollide.h"
+#include "ThreadTeam.h"
+#include "values.h"
+
+// 19 populations read and written, 4 macroscopic values and the solid flag
+#define BYTES_PER_CELL	((2 * LATTICE_Q + 4) * sizeof(double) + sizeof(unsigned char))
+
+enum domain_t
+{
+    DOMAIN_CHANNEL = 0,
+    DOMAIN_CAVITY,
+    DOMAIN_POROUS
+};
+
+static const char *domainNames[] = { "channel", "cavity", "porous" };
+
+struct bench
+{
+    Lattice lattice;
+    ThreadTeam team;
+    vector<minmax_t> memberMinmax;
+    collisionKernel collide;
+    double tau_inv;
+};
+
+static double now()
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static void touchMember(void *arg, int member, int members)
+{
+    bench *b = (bench *) arg;
+    unsigned long first, last;
+
+    ThreadTeam::split(b->lattice.rows(), member, members, &first, &last);
+    b->lattice.touch(first, last);
+}
+
+static void stepMember(void *arg, int member, int members)
+{
+    bench *b = (bench *) arg;
+    minmax_t *minmax = &b->memberMinmax[member];
+    unsigned long first, last;
+
+    minmax->min_density = MAXFLOAT;
+    minmax->max_density = MINFLOAT;
+    minmax->min_v = MAXFLOAT;
+    minmax->max_v = MINFLOAT;
+
+    ThreadTeam::split(b->lattice.rows(), member, members, &first, &last);
+    streamCollide(&b->lattice, b->collide, b->tau_inv, first, last, minmax);
+}
+
+/*
+ * Closes the ring in x the way MD3Q19b::step() does with itself as both
+ * neighbours.
+ */
+static void periodic(Lattice * lattice)
+{
+    static const int left[5] = { V2, V8, V10, V12, V14 };
+    static const int right[5] = { V1, V7, V9, V11, V13 };
+    int max_x = lattice->dim_x;
+
+    for (unsigned int z = 0; z < lattice->dim_z; z++) {
+        for (unsigned int y = 0; y < lattice->dim_y; y++) {
+            for (unsigned int i = 0; i < 5; i++) {
+                double *l = lattice->f[left[i]];
+                double *r = lattice->f[right[i]];
+
+                if (lattice->parity) {
+                    r[lattice->index(max_x, y, z)] = r[lattice->index(0, y, z)];
+                    l[lattice->index(-1, y, z)] = l[lattice->index(max_x - 1, y, z)];
+                } else {
+                    l[lattice->index(max_x - 1, y, z)] = l[lattice->index(-1, y, z)];
+                    r[lattice->index(0, y, z)] = r[lattice->index(max_x, y, z)];
+                }
+            }
+        }
+    }
+}
+
+static void setupDomain(Lattice * lattice, domain_t domain)
+{
+    const double density = 1.0;
+    const double mv_x = 0.05;
+
+    srand48(1);
+
+    for (unsigned int z = 0; z < lattice->dim_z; z++) {
+        for (unsigned int y = 0; y < lattice->dim_y; y++) {
+            for (unsigned int x = 0; x < lattice->dim_x; x++) {
+                long n = lattice->index(x, y, z);
+                bool wall = z < 1 || z > lattice->dim_z - 2 || y < 1 || y > lattice->dim_y - 2;
+
+                switch (domain) {
+                case DOMAIN_CHANNEL:
+                    break;
+                case DOMAIN_CAVITY:
+                    wall = wall || x < 1 || x > lattice->dim_x - 2;
+                    break;
+                case DOMAIN_POROUS:
+                    // about a third of the cells, in 2x2x2 blocks
+                    if (!((x | y | z) & 1))
+                        lattice->solid[n] = drand48() < 0.33;
+                    else
+                        lattice->solid[n] = lattice->solid[lattice->index(x & ~1, y & ~1, z & ~1)];
+                    break;
+                }
+                if (wall)
+                    lattice->solid[n] = 1;
+
+                // start from the equilibrium of a slow flow in x, so the
+                // kernels see realistic values
+                double u = lattice->solid[n] ? 0. : mv_x;
+                double fix = 1.0 - 1.5 * u * u;
+
+                lattice->density[n] = density;
+                for (unsigned int i = 0; i < LATTICE_Q; i++) {
+                    double w = i == 0 ? 1. / 3. : (i <= 6 ? 1. / 18. : 1. / 36.);
+                    double cu = lattice_e[i][0] * u;
+
+                    lattice->f[i][n] = w * density * (fix + 3.0 * cu + 4.5 * cu * cu);
+                }
+            }
+        }
+    }
+}
+
+// total of all populations, only meaningful with parity 0
+static double mass(Lattice * lattice)
+{
+    double sum = 0.;
+
+    for (unsigned int z = 0; z < lattice->dim_z; z++)
+        for (unsigned int y = 0; y < lattice->dim_y; y++)
+            for (unsigned int x = 0; x < lattice->dim_x; x++)
+                for (unsigned int i = 0; i < LATTICE_Q; i++)
+                    sum += lattice->f[i][lattice->index(x, y, z)];
+
+    return sum;
+}
+
+static void run(bench * b, domain_t domain, unsigned int dim_x, unsigned int dim_y, unsigned int dim_z, int steps)
+{
+    Lattice *lattice = &b->lattice;
+
+    lattice->allocate(dim_x, dim_y, dim_z);
+    b->team.run(touchMember, b);
+    setupDomain(lattice, domain);
+
+    long cells = (long) dim_x * dim_y * dim_z;
+    long fluid = 0;
+    for (unsigned int z = 0; z < dim_z; z++)
+        for (unsigned int y = 0; y < dim_y; y++)
+            for (unsigned int x = 0; x < dim_x; x++)
+                fluid += !lattice->solid[lattice->index(x, y, z)];
+
+    double before = mass(lattice);
+
+    // one step of each parity to warm up caches and page tables
+    for (int s = 0; s < 2; s++) {
+        b->team.run(stepMember, b);
+        lattice->parity = !lattice->parity;
+        periodic(lattice);
+    }
+
+    // even step, odd step, boundary, min/max reduction
+    double phase[4] = { 0., 0., 0., 0. };
+    double start = now();
+
+    for (int s = 0; s < steps; s++) {
+        double t0 = now();
+        int parity = lattice->parity;
+
+        b->team.run(stepMember, b);
+        lattice->parity = !lattice->parity;
+
+        double t1 = now();
+        periodic(lattice);
+
+        double t2 = now();
+        minmax_t minmax = b->memberMinmax[0];
+        for (unsigned int k = 1; k < b->memberMinmax.size(); k++) {
+            if (b->memberMinmax[k].min_density < minmax.min_density)
+                minmax.min_density = b->memberMinmax[k].min_density;
+            if (b->memberMinmax[k].max_density > minmax.max_density)
+                minmax.max_density = b->memberMinmax[k].max_density;
+            if (b->memberMinmax[k].min_v < minmax.min_v)
+                minmax.min_v = b->memberMinmax[k].min_v;
+            if (b->memberMinmax[k].max_v > minmax.max_v)
+                minmax.max_v = b->memberMinmax[k].max_v;
+        }
+
+        double t3 = now();
+        phase[parity] += t1 - t0;
+        phase[2] += t2 - t1;
+        phase[3] += t3 - t2;
+    }
+
+    double total = now() - start;
+    double after = mass(lattice);
+    double mlups = cells * (double) steps / total * 1e-6;
+
+    cout << setw(8) << left << domainNames[domain] << right
+         << setw(5) << dim_x << "x" << setw(4) << dim_y << "x" << setw(4) << dim_z
+         << setw(7) << fixed << setprecision(1) << 100.0 * fluid / cells
+         << setw(7) << steps
+         << setw(9) << setprecision(1) << mlups
+         << setw(9) << setprecision(1) << fluid * (double) steps / total * 1e-6
+         << setw(7) << BYTES_PER_CELL
+         << setw(8) << setprecision(2) << mlups * BYTES_PER_CELL * 1e-3
+         << setw(10) << setprecision(3) << phase[0] * 1e3 / (steps / 2)
+         << setw(10) << setprecision(3) << phase[1] * 1e3 / (steps / 2)
+         << setw(10) << setprecision(3) << phase[2] * 1e3 / steps
+         << setw(10) << setprecision(3) << phase[3] * 1e3 / steps
+         << setw(11) << scientific << setprecision(2) << (after - before) / before << endl;
+}
+
+static void usage()
+{
+    cerr << "usage: bench [-d channel|cavity|porous|all] [-s x,y,z] [-n steps]" << endl
+         << "             [-t threads] [-k scalar|sse2|avx2|avx512]" << endl;
+    exit(1);
+}
+
+int main(int argc, char *argv[])
+{
+    unsigned int dim_x = 128, dim_y = 64, dim_z = 64;
+    int steps = 100;
+    int threads = 1;
+    int domains = 7;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "d:s:n:t:k:")) != -1) {
+        switch (opt) {
+        case 'd':
+            if (!strcmp(optarg, "all"))
+                domains = 7;
+            else if (!strcmp(optarg, "channel"))
+                domains = 1 << DOMAIN_CHANNEL;
+            else if (!strcmp(optarg, "cavity"))
+                domains = 1 << DOMAIN_CAVITY;
+            else if (!strcmp(optarg, "porous"))
+                domains = 1 << DOMAIN_POROUS;
+            else
+                usage();
+            break;
+        case 's':
+            if (sscanf(optarg, "%u,%u,%u", &dim_x, &dim_y, &dim_z) != 3 || dim_x < 3 || dim_y < 3 || dim_z < 3)
+                usage();
+            break;
+        case 'n':
+            steps = atoi(optarg);
+            break;
+        case 't':
+            threads = atoi(optarg);
+            break;
+        case 'k':
+            // picked up by selectCollisionKernel()
+            setenv("CSSIM_KERNEL", optarg, 1);
+            break;
+        default:
+            usage();
+        }
+    }
+
+    // whole AA pairs, so the mass is compared at parity 0
+    if (steps < 2)
+        steps = 2;
+    steps &= ~1;
+
+    bench b;
+    const char *kernel;
+
+    b.collide = selectCollisionKernel(&kernel);
+    b.tau_inv = 1.2;
+    b.team.resize(threads);
+    b.memberMinmax.resize(b.team.size());
+
+    cout << "kernel " << kernel << ", " << b.team.size() << " thread(s)" << endl;
+    cout << "domain        size        fluid%  steps    MLUPS   MFLUPS B/cell    GB/s"
+         << "  even[ms]   odd[ms]  halo[ms]  mmax[ms]   mass drift" << endl;
+
+    for (int d = DOMAIN_CHANNEL; d <= DOMAIN_POROUS; d++)
+        if (domains & (1 << d))
+            run(&b, (domain_t) d, dim_x, dim_y, dim_z, steps);
+
+    return 0;
+}
@@ -26,7 +26,12 @@ int main(int argc, char* argv[])
     	signal(SIGINT,SIG_IGN);
     	signal(SIGTERM,SIG_IGN);
 
-	MPI::Init_thread(MPI_THREAD_MULTIPLE);
+	// the sampler thread talks MPI while the solver does
+	int provided = MPI::Init_thread(MPI_THREAD_MULTIPLE);
+	if (provided != MPI_THREAD_MULTIPLE) {
+		cerr << "\t\t\t Sim: MPI only provides thread level " << provided << ", the sampler needs MPI_THREAD_MULTIPLE" << endl;
+		MPI::COMM_WORLD.Abort(1);
+	}
 	// MPI::Init(argc, argv);
 /*	int myrank = MPI::COMM_WORLD.Get_rank();
 	int nprocs = MPI::COMM_WORLD.Get_size();*/
@@ -15,7 +15,16 @@
 #define MPI_Data_OutRight		311
 #define MPI_Data_OutLeft		312
 
+// + direction of the link, 0 .. 26 (see Halo.cpp)
+#define MPI_Data_Halo			320
+#define MPI_Data_Accel			350
+// + direction, 0 .. 26, see Tracer.cpp
+#define MPI_Data_Velocity		360
+#define MPI_Data_Particles		390
+
 #define MPI_Model_Propagate 	500
+#define MPI_Model_Step			550
+#define MPI_Model_Run			551	// followed by the number of steps
 #define MPI_Model_Collision		600
 
 #define MPI_Update_Enviroment	700
@@ -23,18 +32,24 @@
 #define MPI_Set_Area			800
 #define MPI_Field				805
 #define MPI_Field_Done			806
+#define MPI_Field_Bulk			807
 
-#define MPI_Filter			900
+// 900 .. 909 on the sampling communicator, see MD3Q19b::serve()
+#define MPI_Filter			900	// with the number of the run to sample
 #define MPI_Get_Cells			901
 #define MPI_Set_Req_Size		902
 #define MPI_Set_Resp_Size		903
 #define MPI_Filter_Done			904
 #define MPI_Send_MinMax			905
 #define MPI_Get_Cell			906
+#define MPI_Trace_Ribbons		907
+#define MPI_Sample_Volume		908
+#define MPI_Record_Point		909
 
 #define MPI_Update_Area			850
 #define MPI_Update_Field		855
 #define MPI_Update_Field_Done		856
+#define MPI_Update_Bulk			857
 
 
 
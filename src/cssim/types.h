@@ -81,6 +81,7 @@ struct enviroment
 	double dense;
 	double accel;
 	double relax;
+	int threads;	// per worker
 };
 
 typedef struct 
@@ -101,9 +102,62 @@ struct simCoord
 
 struct simField
 {
-	int dim_x,
+	int dim_x,		// whole lattice
 		dim_y,
 		dim_z;
+	int procs_x,	// process grid, see Decomposition.h
+		procs_y,
+		procs_z;
+};
+
+// ribbons traced by the workers, see Tracer.h
+struct traceRequest
+{
+	int seeds;			// traceSeed records follow in the same message
+	int maxVertices;	// per ribbon
+	double height;		// ribbon width, model units
+	double stepLength;	// integration step, in cells
+};
+
+struct traceSeed
+{
+	int ribbon;
+	double x, y, z;		// global lattice coordinates
+};
+
+struct traceVertex
+{
+	int ribbon;
+	int seq;			// position along the ribbon
+	double x, y, z;		// global lattice coordinates
+	double dx, dy, dz;	// to the other edge of the ribbon, model units
+	double value;		// speed
+};
+
+// a box of the lattice resampled on a regular grid, see MD3Q19b::sampleVolume();
+// planes are boxes one grid point thick
+struct volumeRequest
+{
+	double origin[3];	// global lattice coordinates
+	double u[3], v[3], w[3];	// edges of the box
+	int size[3];		// grid points along u, v and w
+	int type;			// sample_type
+	int interpolate;	// between the cell centres, else the cell's own value
+};
+
+// time series of a point probe, see PointRecorder.h
+struct pointRequest
+{
+	int id;				// of the probe
+	int x, y, z;		// global lattice coordinates
+	int type;			// sample_type
+	int windows;		// at most this many pointWindow records back
+	int drop;			// the probe is gone, forget it and send nothing back
+};
+
+struct pointWindow
+{
+	double min, max, mean;
 };
 
 typedef struct
@@ -0,0 +1,148 @@
+/*
+ * Round trip test of the voxel codec (see VoxelCodec.h).
+ *
+ *	voxeltest [-n grids] [-s seed]
+ *
+ * Encodes random and sparse solid masks of various sizes, checks that
+ * both the bitmap and the run length encoding get used and that every
+ * mask decodes to exactly what went in. Broken buffers must be refused.
+ * Exits with 1 if anything does not hold.
+ */
+#include <vector>
+#include <iostream>
+#include <stdlib.h>
+#include <unistd.h>
+
+using namespace std;
+
+#include "VoxelCodec.h"
+
+// the first byte of an encoded mask, see VoxelCodec.cpp
+#define VOXELS_BITS	0
+#define VOXELS_RUNS	1
+
+static int failures = 0;
+static int encodings[2] = { 0, 0 };
+
+// solid with the given probability in percent, in blocks of up to [block] cells
+static void fill(vector<unsigned char> &mask, int percent, int block)
+{
+    unsigned long n = 0;
+
+    while (n < mask.size()) {
+        unsigned char solid = rand() % 100 < percent ? 1 + rand() % 255 : 0;
+        unsigned long len = 1 + rand() % block;
+
+        for (; len && n < mask.size(); len--)
+            mask[n++] = solid;
+    }
+}
+
+static void roundTrip(const char *name, const vector<unsigned char> &mask)
+{
+    vector<unsigned char> encoded;
+    unsigned long cells = mask.size();
+
+    encodeVoxels(cells ? &mask[0] : NULL, cells, encoded);
+
+    if (encoded.empty() || encoded[0] > VOXELS_RUNS) {
+        cerr << name << " (" << cells << " cells): no valid encoding" << endl;
+        failures++;
+        return;
+    }
+    encodings[encoded[0]]++;
+
+    // one spare cell to see that nothing is written past the end
+    vector<unsigned char> decoded(cells + 1, 0xaa);
+
+    if (!decodeVoxels(&encoded[0], encoded.size(), &decoded[0], cells)) {
+        cerr << name << " (" << cells << " cells): refused its own encoding" << endl;
+        failures++;
+        return;
+    }
+
+    for (unsigned long n = 0; n < cells; n++) {
+        if (decoded[n] != (mask[n] ? 1 : 0)) {
+            cerr << name << " (" << cells << " cells): cell " << n << " differs" << endl;
+            failures++;
+            return;
+        }
+    }
+    if (decoded[cells] != 0xaa) {
+        cerr << name << " (" << cells << " cells): wrote past the mask" << endl;
+        failures++;
+        return;
+    }
+
+    // a cut off buffer or a mask a byte larger must not decode (a
+    // bitmap is padded to whole bytes, so one cell more may well fit)
+    vector<unsigned char> larger(cells + 8);
+
+    if (decodeVoxels(&encoded[0], encoded.size(), &larger[0], cells + 8) ||
+        (encoded.size() > 1 && decodeVoxels(&encoded[0], encoded.size() - 1, &decoded[0], cells))) {
+        cerr << name << " (" << cells << " cells): accepted a broken buffer" << endl;
+        failures++;
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    int grids = 200;
+    unsigned int seed = 1;
+    int c;
+
+    while ((c = getopt(argc, argv, "n:s:")) != -1) {
+        switch (c) {
+        case 'n':
+            grids = atoi(optarg);
+            break;
+        case 's':
+            seed = atoi(optarg);
+            break;
+        default:
+            cerr << "usage: voxeltest [-n grids] [-s seed]" << endl;
+            return 1;
+        }
+    }
+    srand(seed);
+
+    // the corner cases
+    static const unsigned long sizes[] = { 0, 1, 7, 8, 9, 64, 1000 };
+    for (unsigned int i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+        vector<unsigned char> mask(sizes[i], 0);
+
+        roundTrip("fluid", mask);
+        mask.assign(sizes[i], 1);
+        roundTrip("solid", mask);
+    }
+
+    unsigned char garbage[] = { 7, 1, 2, 3 };
+    unsigned char mask[32];
+    if (decodeVoxels(garbage, sizeof(garbage), mask, sizeof(mask)) || decodeVoxels(garbage, 0, mask, sizeof(mask))) {
+        cerr << "accepted an unknown encoding" << endl;
+        failures++;
+    }
+
+    for (int g = 0; g < grids; g++) {
+        // a slice of a small lattice, x*y*z cells
+        unsigned long cells = (1 + rand() % 40) * (1 + rand() % 40) * (1 + rand() % 20);
+        vector<unsigned char> grid(cells);
+
+        fill(grid, 50, 1);
+        roundTrip("random", grid);
+
+        fill(grid, 5, 32);
+        roundTrip("sparse", grid);
+
+        fill(grid, 30, 500);
+        roundTrip("blocks", grid);
+    }
+
+    if (!encodings[VOXELS_BITS] || !encodings[VOXELS_RUNS]) {
+        cerr << "only one encoding was used: " << encodings[VOXELS_BITS] << " bitmaps, " << encodings[VOXELS_RUNS] << " runs" << endl;
+        failures++;
+    }
+
+    cout << encodings[VOXELS_BITS] << " bitmaps, " << encodings[VOXELS_RUNS] << " run lists, " << failures << " failures" << endl;
+    return failures ? 1 : 0;
+}
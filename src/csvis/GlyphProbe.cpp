@@ -195,10 +195,11 @@ void GlyphProbe::update()
 
             // calculate the position and rotation
             osg::Vec3 position(m_lastSample->positions[index].x, m_lastSample->positions[index].y, m_lastSample->positions[index].z);
-            osg::Vec3 direction(m_lastSample->directions[index].x, m_lastSample->directions[index].x, m_lastSample->directions[index].z);
+            osg::Vec3 direction(m_lastSample->directions[index].x, m_lastSample->directions[index].y, m_lastSample->directions[index].z);
 
+            // the cone and the cylinder point along Z
             osg::Quat rotation;
-            rotation.makeRotate(position, direction);
+            rotation.makeRotate(osg::Vec3(0.0f, 0.0f, 1.0f), direction);
 
             // create the cone part of the arrow
             osg::Cone* cone = new osg::Cone(osg::Vec3(), 0.3f, 0.6f);
@@ -236,6 +236,8 @@ void LoginWindow::loginButtonPressed()
 	    delete modelConn;
 	    modelConn = NULL;
 	}
+        // the model server starts its streams over with key frames
+        resetSamples();
         modelConn = getModelConn();
         if(modelConn != NULL && 
            modelConn->rpc("model::login", 2, g_fan->config->getValue("VISHOST"), g_fan->config->getValue("VISPORT"))
@@ -38,7 +38,9 @@
 #include "ProbeManager.h"
 #include "FANClasses.h"
 #include "CommonServer.h"
+#include "Server.h"
 #include "GUIController.h"
+#include "SampleCodec.h"
 
 
 ProbeManager* g_ProbeManager = 0;
@@ -158,6 +160,7 @@ void ProbeManager::removeProbe(unsigned int id)
     m_probeGroup->removeChild(probe);
 
     m_probeMap.erase(m_probeMap.find(id));
+    forgetSample(id);
 }
 
 void ProbeManager::removeAllProbes()
@@ -166,8 +169,10 @@ void ProbeManager::removeAllProbes()
 
     std::map<unsigned int, Probe*>::iterator it;
 
-    for (it = m_probeMap.begin(); it != m_probeMap.end(); ++it)
+    for (it = m_probeMap.begin(); it != m_probeMap.end(); ++it) {
         m_probeGroup->removeChild(it->second);
+        forgetSample(it->first);
+    }
 
     m_probeMap.clear();
 }
@@ -227,7 +232,7 @@ void ProbeManager::deselectProbe()
 // Data update
 // ----------------------------------------------------------------------------
 
-void ProbeManager::updateSliceProbe(planar_sample *data)
+void ProbeManager::updateSliceProbe(planar_sample *data, int format, const unsigned char *packed, unsigned long length)
 {
     // check parameter
     if (!data) {
@@ -237,13 +242,26 @@ void ProbeManager::updateSliceProbe(planar_sample *data)
 
     // find the probe
     SliceProbe* probe = dynamic_cast<SliceProbe*>(findProbe(data->id));
-    if (!probe)
+    if (!probe) {
+        zap(data);
         return;
+    }
+
+    unsigned long count = (unsigned long)data->u_size * data->v_size;
+
+    if (sampleSize(format) == 0 || length != count * sampleSize(format)) {
+        FAN_xlog(FAN_ERROR, "Dropped slice sample %d: %lu bytes for %lu values in format %d", data->id, length, count, format);
+        zap(data);
+        return;
+    }
+
+    data->values = new double[count];
+    decodeSamples(packed, count, format, data->min, data->max, data->values);
 
     probe->setData(data);
 }
 
-void ProbeManager::updateRibbonProbe(ribbon_probe_data *data)
+void ProbeManager::updateRibbonProbe(ribbon_probe_data *data, int format, const unsigned char *packed, unsigned long length)
 {
     // check parameter
     if (!data) {
@@ -253,8 +271,25 @@ void ProbeManager::updateRibbonProbe(ribbon_probe_data *data)
 
     // find the probe
     RibbonProbe* probe = dynamic_cast<RibbonProbe*>(findProbe(data->id));
-    if (!probe)
+    if (!probe) {
+        zap_array(data->num_vertices);
+        zap_array(data->ribbons);
+        zap(data);
+        return;
+    }
+
+    unsigned long count = data->num_total;
+
+    if (sampleSize(format) == 0 || length != count * sampleSize(format)) {
+        FAN_xlog(FAN_ERROR, "Dropped ribbon sample %d: %lu bytes for %lu values in format %d", data->id, length, count, format);
+        zap_array(data->num_vertices);
+        zap_array(data->ribbons);
+        zap(data);
         return;
+    }
+
+    data->values = new double[data->num_total];
+    decodeSamples(packed, data->num_total, format, data->min_value, data->max_value, data->values);
 
     probe->setData(data);
 }
@@ -60,8 +60,12 @@ public:
     Probe* selectedProbe() { return m_currentSelection; }
     void deselectProbe();
 
-    void updateSliceProbe(planar_sample *data);
-    void updateRibbonProbe(ribbon_probe_data *data);
+    // the values arrive packed in one of the SAMPLEFORMATs (see
+    // SampleCodec.h) and are unpacked here, once the probe is known;
+    // [length] bytes that do not hold exactly one value per cell are
+    // dropped with the sample
+    void updateSliceProbe(planar_sample *data, int format, const unsigned char *packed, unsigned long length);
+    void updateRibbonProbe(ribbon_probe_data *data, int format, const unsigned char *packed, unsigned long length);
     void updateGlyphProbe(glyph_probe_data *data);
 };
 
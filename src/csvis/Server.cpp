@@ -31,6 +31,7 @@
 
 #include "Application.h"
 #include "simRemoteTypes.h"
+#include "SampleStream.h"
 #include "TriangulatedModel.h"
 #include "CommonServer.h"
 #include "Server.h"
@@ -43,6 +44,26 @@ osg::ref_ptr<TriangulatedModel> g_model = NULL;
 int g_current_face = 0;
 int g_num_faces = 0;
 
+// last frames of the slices and ribbons, the model only sends changes
+SampleStream g_sampleStream;
+static std::vector<unsigned char> g_frame;
+// samples arrive on the connection thread, probes go away on the GUI thread
+static pthread_mutex_t g_sampleMutex = PTHREAD_MUTEX_INITIALIZER;
+
+void forgetSample(int id)
+{
+    pthread_mutex_lock(&g_sampleMutex);
+    g_sampleStream.forget(id);
+    pthread_mutex_unlock(&g_sampleMutex);
+}
+
+void resetSamples()
+{
+    pthread_mutex_lock(&g_sampleMutex);
+    g_sampleStream.reset();
+    pthread_mutex_unlock(&g_sampleMutex);
+}
+
 void rPutSample(FAN_Hash *ret, char **params)
 {
     void      **data   = (void**)params;
@@ -55,7 +76,8 @@ void rPutSample(FAN_Hash *ret, char **params)
     	int        *dim    = (int*)        data[4];
     	double     *min    = (double*)     data[5];
     	double     *max    = (double*)     data[6];
-    	double     *values = (double*)     data[7];
+    	int        *count  = (int*)        data[7];
+    	double     *values = (double*)     data[8];
 
         point_sample *sample   = new point_sample();
 	sample->id             = *(id);
@@ -63,7 +85,9 @@ void rPutSample(FAN_Hash *ret, char **params)
 	sample->dimensionality = (unsigned int)*(dim);
 	sample->min            = *(min);
 	sample->max            = *(max);
-	sample->value          = (double*)values;  
+	sample->count          = (unsigned int)*(count);
+	sample->value          = (double*)values;  // min, max, mean per window
+	// no point probe on this side yet
 	delete sample;
     }else if(ptype == PROBETYPE_PLANE)
     {
@@ -73,7 +97,17 @@ void rPutSample(FAN_Hash *ret, char **params)
     	double     *max    = (double*)     data[6];
     	int        *u_size = (int*)        data[7];
     	int        *v_size = (int*)        data[8];
-    	double     *values = (double*)     data[9];
+    	int        *format = (int*)        data[9];
+    	int        *length = (int*)        data[10];
+    	unsigned char *stream = (unsigned char*) data[11];
+
+	pthread_mutex_lock(&g_sampleMutex);
+	// a delta to a frame we missed, wait for the next key frame
+	if (!g_sampleStream.decode(*id, stream, *length, g_frame))
+	{
+	    pthread_mutex_unlock(&g_sampleMutex);
+	    return;
+	}
 
         planar_sample *sample  = new planar_sample();
 	sample->id             = (int)*id;
@@ -83,10 +117,10 @@ void rPutSample(FAN_Hash *ret, char **params)
 	sample->max            = (double)*max;
 	sample->u_size         = (int)*u_size;
 	sample->v_size         = (int)*v_size;
-	sample->values = new double[sample->u_size*sample->v_size];
-	memcpy(sample->values, values, sample->u_size*sample->v_size*sizeof(double));
+	sample->values         = NULL;
 
-	g_ProbeManager->updateSliceProbe(sample);
+	g_ProbeManager->updateSliceProbe(sample, *format, g_frame.empty() ? NULL : &g_frame[0], g_frame.size());
+	pthread_mutex_unlock(&g_sampleMutex);
     }else if(ptype == PROBETYPE_GLYPH)
     {
 	int *num_streams   = (int*)          data[3];
@@ -117,8 +151,16 @@ void rPutSample(FAN_Hash *ret, char **params)
 	int 	 total       = *(int*)       data[6];
         int *num_vertices    = (int*)        data[7];
     	vertex_t *ribbons    = (vertex_t*)   data[8];
-    	double   *values     = (double*)     data[9];
+    	int      *format     = (int*)        data[9];
+    	int      *length     = (int*)        data[10];
+    	unsigned char *stream = (unsigned char*) data[11];
 
+	pthread_mutex_lock(&g_sampleMutex);
+	if (!g_sampleStream.decode(*id, stream, *length, g_frame))
+	{
+	    pthread_mutex_unlock(&g_sampleMutex);
+	    return;
+	}
 
         ribbon_probe_data *sample  = new ribbon_probe_data();
 	memcpy(&sample->id, id, sizeof(int));
@@ -129,10 +171,11 @@ void rPutSample(FAN_Hash *ret, char **params)
 	memcpy(sample->num_vertices, num_vertices, sample->num_ribbons*sizeof(unsigned int));
         sample->ribbons        = new vertex_t[total*2];
 	memcpy(sample->ribbons, ribbons, total*2*sizeof(vertex_t));
-        sample->values         = new double[total];
-	memcpy(sample->values, values, total*sizeof(double));
+        sample->num_total      = total;
+        sample->values         = NULL;
 
-        g_ProbeManager->updateRibbonProbe(sample);
+        g_ProbeManager->updateRibbonProbe(sample, *format, g_frame.empty() ? NULL : &g_frame[0], g_frame.size());
+	pthread_mutex_unlock(&g_sampleMutex);
     }else if(ptype == PROBETYPE_VOLUME)
     {
 	data_type  *type   = (data_type*)  data[3];
@@ -142,7 +185,6 @@ void rPutSample(FAN_Hash *ret, char **params)
     	int        *u_size = (int*)        data[7];
     	int        *v_size = (int*)        data[8];
     	int        *w_size = (int*)        data[9];
-    	double     *values = (double*)     data[10];
 
         volume_sample *sample  = new volume_sample();
 	sample->id             = (int)*id;
@@ -153,7 +195,8 @@ void rPutSample(FAN_Hash *ret, char **params)
 	sample->u_size         = (int)*u_size;
 	sample->v_size         = (int)*v_size;
 	sample->w_size         = (int)*w_size;
-	sample->values         = (double*)values;  
+	sample->values         = NULL;
+	// no volume probe on this side yet, the packed values are not unpacked
 	delete sample;
     }
 }
@@ -43,6 +43,10 @@ void rStopData(FAN_Hash *ret, char **params);
 void rPutData(FAN_Hash *ret, char **params);
 void rPutSample(FAN_Hash *ret, char **params);
 
+// drop the last frames the model sent, of one probe or of all
+void forgetSample(int id);
+void resetSamples();
+
 void *mStartData(FAN_Hash *ret, void *data);
 void *mStopData(FAN_Hash *ret, void *data);
 void *mPutData(FAN_Hash *ret, void *data);